@@ -0,0 +1,543 @@
+#pragma once
+
+#include <stdexcept>
+#include <optional>
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+
+struct BenchmarkOptions
+{
+	bool enabled = false;
+	uint32_t frameCount = 1000; // measured frames, ignored when durationSeconds is set
+	std::optional<double> durationSeconds;
+	uint32_t warmupFrames = 100; // rendered before measuring starts, so pipeline and cache warm-up don't skew results
+	std::string outputPath = "benchmark.json";
+	std::vector<uint32_t> instanceCounts; // runs the benchmark once per count if not empty, each with its own report
+};
+
+struct StreamingOptions
+{
+	uint32_t virtualTextureSize = 16384; // width and height in texels
+	uint32_t textureBudgetMegabytes = 256; // device memory the resident tiles may use
+};
+
+struct SceneOptions
+{
+	uint32_t instanceCount = 1; // more than one are laid out in a grid, partly outside the view to exercise culling
+	uint32_t instancesPerObject = 64; // instances culled together and drawn with one instanced draw
+};
+
+enum class GeometryPath
+{
+	Auto, // mesh shaders if the gpu supports them, vertex input otherwise
+	Vertex, // vertex input, the culling pass on the compute queue culls whole objects
+	Mesh // task and mesh shaders that cull every meshlet of every instance, fails if the gpu doesn't support them
+};
+
+struct RenderOptions
+{
+	uint32_t msaaSamples = 4; // lowered to what the gpu supports, 1 disables multisampling
+	GeometryPath geometry = GeometryPath::Auto;
+	uint32_t shadingRateWidth = 1; // fragment size every draw is shaded with, 1x1 shades every pixel
+	uint32_t shadingRateHeight = 1;
+	bool adaptiveShading = true; // coarser where the previous frame was flat, if the gpu supports shading rate attachments
+	bool dynamicResolution = false; // renders the scene at a lower resolution while the gpu misses the frame budget
+	double frameBudgetMilliseconds = 16.6; // of GPU time
+	uint32_t minRenderScalePercent = 50; // of the output resolution, per axis
+};
+
+enum class DeviceGroupMode
+{
+	Off,
+	AlternateFrame, // every frame in flight renders on one gpu of the group
+	SplitFrame // every gpu renders a band of every frame
+};
+
+enum class SyncBackend
+{
+	Auto, // timeline semaphores if the gpu supports them and no device group is used
+	Timeline, // one timeline semaphore per queue, fails if the gpu doesn't support them
+	Fences // a fence per frame in flight and binary semaphores between the queues
+};
+
+struct DeviceOptions
+{
+	std::string gpu; // an index into the enumerated gpus or part of a gpu name, overrides the scoring if not empty
+	DeviceGroupMode groupMode = DeviceGroupMode::Off;
+	SyncBackend sync = SyncBackend::Auto;
+};
+
+enum class LatencyProfile
+{
+	Throughput, // presents as fast as possible without tearing if the display allows it, else with tearing
+	Vsync, // waits for vertical blank, frames queue up behind it
+	LowLatency // waits for vertical blank, but starts every frame as late as possible to present fresh input
+};
+
+struct PresentOptions
+{
+	LatencyProfile latencyProfile = LatencyProfile::Throughput;
+	uint32_t framesInFlight = 2; // how many frames the CPU may record ahead of the GPU, at most one per swapchain image
+};
+
+// Renders without a window or surface and reads every frame back, for machines without a display.
+struct OffscreenOptions
+{
+	bool enabled = false;
+	uint32_t width = 1920;
+	uint32_t height = 1080;
+	uint32_t frameCount = 100; // rendered before exiting, unless benchmarking
+	std::string outputDirectory; // frames are written here as PPM files if not empty
+};
+
+struct StartupOptions
+{
+	std::string reportPath; // per-step startup timings are written here as JSON after the first frame, if not empty
+};
+
+enum class ValidationSeverity
+{
+	Verbose,
+	Info,
+	Warning,
+	Error
+};
+
+// Only used by debug builds, which enable the validation layers.
+struct ValidationOptions
+{
+	ValidationSeverity minimumSeverity = ValidationSeverity::Warning;
+	bool general = true;
+	bool validation = true;
+	bool performance = true;
+};
+
+struct AppOptions
+{
+	BenchmarkOptions benchmark;
+	StreamingOptions streaming;
+	SceneOptions scene;
+	RenderOptions render;
+	StartupOptions startup;
+	DeviceOptions device;
+	PresentOptions present;
+	ValidationOptions validation;
+	OffscreenOptions offscreen;
+};
+
+inline std::optional<std::string> getEnvironmentVariable(const char* name)
+{
+#ifdef _MSC_VER
+	char* value = nullptr;
+	size_t length = 0;
+	if (_dupenv_s(&value, &length, name) != 0 || value == nullptr)
+	{
+		return std::nullopt;
+	}
+	std::string result = value;
+	std::free(value);
+	return result;
+#else
+	const char* value = std::getenv(name);
+	return value != nullptr ? std::optional<std::string>(value) : std::nullopt;
+#endif
+}
+
+inline uint32_t parseUnsignedOption(const std::string& option, const std::string& value)
+{
+	try
+	{
+		size_t parsedLength = 0;
+		unsigned long result = std::stoul(value, &parsedLength);
+		if (parsedLength == value.size() && result <= UINT32_MAX)
+		{
+			return static_cast<uint32_t>(result);
+		}
+	}
+	catch (const std::exception&)
+	{
+	}
+	throw std::runtime_error("invalid value '" + value + "' for " + option);
+}
+
+// a comma separated list like "1,1000,100000"
+inline std::vector<uint32_t> parseUnsignedListOption(const std::string& option, const std::string& value)
+{
+	std::vector<uint32_t> result;
+	size_t start = 0;
+	while (start <= value.size())
+	{
+		size_t end = value.find(',', start);
+		if (end == std::string::npos)
+		{
+			end = value.size();
+		}
+		result.push_back(parseUnsignedOption(option, value.substr(start, end - start)));
+		start = end + 1;
+	}
+	return result;
+}
+
+inline double parsePositiveNumberOption(const std::string& option, const std::string& value)
+{
+	try
+	{
+		size_t parsedLength = 0;
+		double result = std::stod(value, &parsedLength);
+		if (parsedLength == value.size() && result > 0)
+		{
+			return result;
+		}
+	}
+	catch (const std::exception&)
+	{
+	}
+	throw std::runtime_error("invalid value '" + value + "' for " + option);
+}
+
+// Options are given as "--name value". Any benchmark option implies --benchmark, any offscreen option --offscreen,
+// --frame-budget and --min-render-scale imply --dynamic-resolution on.
+// VULKAN_LEARNING_GPU selects the gpu like --gpu, which takes precedence.
+inline AppOptions parseAppOptions(int argc, const char* const* argv)
+{
+	AppOptions options;
+	options.device.gpu = getEnvironmentVariable("VULKAN_LEARNING_GPU").value_or("");
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string option = argv[i];
+		auto nextValue = [&]() -> std::string {
+			if (i + 1 >= argc)
+			{
+				throw std::runtime_error("missing value for " + option);
+			}
+			return argv[++i];
+		};
+
+		if (option == "--benchmark")
+		{
+			options.benchmark.enabled = true;
+		}
+		else if (option == "--benchmark-frames")
+		{
+			options.benchmark.enabled = true;
+			options.benchmark.frameCount = parseUnsignedOption(option, nextValue());
+		}
+		else if (option == "--benchmark-seconds")
+		{
+			options.benchmark.enabled = true;
+			options.benchmark.durationSeconds = parsePositiveNumberOption(option, nextValue());
+		}
+		else if (option == "--benchmark-warmup")
+		{
+			options.benchmark.enabled = true;
+			options.benchmark.warmupFrames = parseUnsignedOption(option, nextValue());
+		}
+		else if (option == "--benchmark-output")
+		{
+			options.benchmark.enabled = true;
+			options.benchmark.outputPath = nextValue();
+		}
+		else if (option == "--benchmark-instances")
+		{
+			options.benchmark.enabled = true;
+			options.benchmark.instanceCounts = parseUnsignedListOption(option, nextValue());
+			for (uint32_t count : options.benchmark.instanceCounts)
+			{
+				if (count == 0)
+				{
+					throw std::runtime_error("--benchmark-instances must not contain 0");
+				}
+			}
+		}
+		else if (option == "--virtual-texture-size")
+		{
+			options.streaming.virtualTextureSize = parseUnsignedOption(option, nextValue());
+			if (options.streaming.virtualTextureSize == 0)
+			{
+				throw std::runtime_error("--virtual-texture-size must not be 0");
+			}
+		}
+		else if (option == "--texture-budget")
+		{
+			options.streaming.textureBudgetMegabytes = parseUnsignedOption(option, nextValue());
+		}
+		else if (option == "--instances")
+		{
+			options.scene.instanceCount = parseUnsignedOption(option, nextValue());
+			if (options.scene.instanceCount == 0)
+			{
+				throw std::runtime_error("--instances must not be 0");
+			}
+		}
+		else if (option == "--instances-per-object")
+		{
+			options.scene.instancesPerObject = parseUnsignedOption(option, nextValue());
+			if (options.scene.instancesPerObject == 0)
+			{
+				throw std::runtime_error("--instances-per-object must not be 0");
+			}
+		}
+		else if (option == "--msaa")
+		{
+			options.render.msaaSamples = parseUnsignedOption(option, nextValue());
+			const uint32_t samples = options.render.msaaSamples;
+			if (samples == 0 || (samples & (samples - 1)) != 0 || samples > 64)
+			{
+				throw std::runtime_error("--msaa must be 1, 2, 4, 8, 16, 32 or 64");
+			}
+		}
+		else if (option == "--geometry")
+		{
+			const std::string path = nextValue();
+			if (path == "auto")
+			{
+				options.render.geometry = GeometryPath::Auto;
+			}
+			else if (path == "vertex")
+			{
+				options.render.geometry = GeometryPath::Vertex;
+			}
+			else if (path == "mesh")
+			{
+				options.render.geometry = GeometryPath::Mesh;
+			}
+			else
+			{
+				throw std::runtime_error("invalid value '" + path + "' for --geometry, expected auto, vertex or mesh");
+			}
+		}
+		else if (option == "--shading-rate")
+		{
+			const std::string size = nextValue();
+			const size_t separator = size.find('x');
+			if (separator == std::string::npos)
+			{
+				throw std::runtime_error("invalid value '" + size + "' for --shading-rate, expected WIDTHxHEIGHT");
+			}
+			const uint32_t width = parseUnsignedOption(option, size.substr(0, separator));
+			const uint32_t height = parseUnsignedOption(option, size.substr(separator + 1));
+			auto isFragmentSize = [](uint32_t size) { return size == 1 || size == 2 || size == 4; };
+			if (!isFragmentSize(width) || !isFragmentSize(height) || width > 2 * height || height > 2 * width)
+			{
+				throw std::runtime_error("--shading-rate must be 1x1, 1x2, 2x1, 2x2, 2x4, 4x2 or 4x4");
+			}
+			options.render.shadingRateWidth = width;
+			options.render.shadingRateHeight = height;
+		}
+		else if (option == "--adaptive-shading")
+		{
+			const std::string value = nextValue();
+			if (value != "on" && value != "off")
+			{
+				throw std::runtime_error("invalid value '" + value + "' for --adaptive-shading, expected on or off");
+			}
+			options.render.adaptiveShading = value == "on";
+		}
+		else if (option == "--dynamic-resolution")
+		{
+			const std::string value = nextValue();
+			if (value != "on" && value != "off")
+			{
+				throw std::runtime_error("invalid value '" + value + "' for --dynamic-resolution, expected on or off");
+			}
+			options.render.dynamicResolution = value == "on";
+		}
+		else if (option == "--frame-budget")
+		{
+			options.render.frameBudgetMilliseconds = parsePositiveNumberOption(option, nextValue());
+			options.render.dynamicResolution = true;
+		}
+		else if (option == "--min-render-scale")
+		{
+			options.render.minRenderScalePercent = parseUnsignedOption(option, nextValue());
+			if (options.render.minRenderScalePercent < 10 || options.render.minRenderScalePercent > 100)
+			{
+				throw std::runtime_error("--min-render-scale must be between 10 and 100");
+			}
+			options.render.dynamicResolution = true;
+		}
+		else if (option == "--startup-report")
+		{
+			options.startup.reportPath = nextValue();
+		}
+		else if (option == "--gpu")
+		{
+			options.device.gpu = nextValue();
+		}
+		else if (option == "--device-group")
+		{
+			const std::string mode = nextValue();
+			if (mode == "afr")
+			{
+				options.device.groupMode = DeviceGroupMode::AlternateFrame;
+			}
+			else if (mode == "sfr")
+			{
+				options.device.groupMode = DeviceGroupMode::SplitFrame;
+			}
+			else
+			{
+				throw std::runtime_error("invalid value '" + mode + "' for --device-group, expected afr or sfr");
+			}
+		}
+		else if (option == "--sync")
+		{
+			const std::string backend = nextValue();
+			if (backend == "auto")
+			{
+				options.device.sync = SyncBackend::Auto;
+			}
+			else if (backend == "timeline")
+			{
+				options.device.sync = SyncBackend::Timeline;
+			}
+			else if (backend == "fences")
+			{
+				options.device.sync = SyncBackend::Fences;
+			}
+			else
+			{
+				throw std::runtime_error("invalid value '" + backend + "' for --sync, expected auto, timeline or fences");
+			}
+		}
+		else if (option == "--latency-profile")
+		{
+			const std::string profile = nextValue();
+			if (profile == "throughput")
+			{
+				options.present.latencyProfile = LatencyProfile::Throughput;
+			}
+			else if (profile == "vsync")
+			{
+				options.present.latencyProfile = LatencyProfile::Vsync;
+			}
+			else if (profile == "low-latency")
+			{
+				options.present.latencyProfile = LatencyProfile::LowLatency;
+			}
+			else
+			{
+				throw std::runtime_error("invalid value '" + profile + "' for --latency-profile, expected throughput, vsync or low-latency");
+			}
+		}
+		else if (option == "--frames-in-flight")
+		{
+			options.present.framesInFlight = parseUnsignedOption(option, nextValue());
+			if (options.present.framesInFlight < 1 || options.present.framesInFlight > 8)
+			{
+				throw std::runtime_error("--frames-in-flight must be between 1 and 8");
+			}
+		}
+		else if (option == "--offscreen")
+		{
+			options.offscreen.enabled = true;
+		}
+		else if (option == "--offscreen-size")
+		{
+			const std::string size = nextValue();
+			const size_t separator = size.find('x');
+			if (separator == std::string::npos)
+			{
+				throw std::runtime_error("invalid value '" + size + "' for --offscreen-size, expected WIDTHxHEIGHT");
+			}
+			options.offscreen.width = parseUnsignedOption(option, size.substr(0, separator));
+			options.offscreen.height = parseUnsignedOption(option, size.substr(separator + 1));
+			if (options.offscreen.width == 0 || options.offscreen.height == 0)
+			{
+				throw std::runtime_error("--offscreen-size must not be 0");
+			}
+			options.offscreen.enabled = true;
+		}
+		else if (option == "--offscreen-frames")
+		{
+			options.offscreen.frameCount = parseUnsignedOption(option, nextValue());
+			options.offscreen.enabled = true;
+		}
+		else if (option == "--offscreen-output")
+		{
+			options.offscreen.outputDirectory = nextValue();
+			options.offscreen.enabled = true;
+		}
+		else if (option == "--validation-severity")
+		{
+			const std::string severity = nextValue();
+			if (severity == "verbose")
+			{
+				options.validation.minimumSeverity = ValidationSeverity::Verbose;
+			}
+			else if (severity == "info")
+			{
+				options.validation.minimumSeverity = ValidationSeverity::Info;
+			}
+			else if (severity == "warning")
+			{
+				options.validation.minimumSeverity = ValidationSeverity::Warning;
+			}
+			else if (severity == "error")
+			{
+				options.validation.minimumSeverity = ValidationSeverity::Error;
+			}
+			else
+			{
+				throw std::runtime_error("invalid value '" + severity + "' for --validation-severity, expected verbose, info, warning or error");
+			}
+		}
+		else if (option == "--validation-types")
+		{
+			const std::string types = nextValue();
+			options.validation.general = false;
+			options.validation.validation = false;
+			options.validation.performance = false;
+
+			size_t start = 0;
+			while (start <= types.size())
+			{
+				size_t end = types.find(',', start);
+				if (end == std::string::npos)
+				{
+					end = types.size();
+				}
+				const std::string type = types.substr(start, end - start);
+				if (type == "general")
+				{
+					options.validation.general = true;
+				}
+				else if (type == "validation")
+				{
+					options.validation.validation = true;
+				}
+				else if (type == "performance")
+				{
+					options.validation.performance = true;
+				}
+				else
+				{
+					throw std::runtime_error("invalid value '" + type + "' for --validation-types, expected general, validation or performance");
+				}
+				start = end + 1;
+			}
+		}
+		else
+		{
+			throw std::runtime_error("unknown command line option " + option);
+		}
+	}
+
+	if (options.offscreen.enabled && options.device.groupMode != DeviceGroupMode::Off)
+	{
+		throw std::runtime_error("--device-group needs a window to present to and can't be combined with offscreen rendering");
+	}
+	if (options.render.dynamicResolution && options.device.groupMode == DeviceGroupMode::SplitFrame)
+	{
+		throw std::runtime_error("--dynamic-resolution can't be combined with --device-group sfr");
+	}
+	if (options.device.sync == SyncBackend::Timeline && options.device.groupMode != DeviceGroupMode::Off)
+	{
+		throw std::runtime_error("--sync timeline can't be combined with --device-group");
+	}
+
+	return options;
+}
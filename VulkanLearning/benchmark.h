@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <vector>
+#include <string>
+
+// Collects per-frame samples of named metrics and summarizes them as JSON.
+// Metrics, info and counters are written in the order they were first reported,
+// so reports of different runs diff cleanly.
+class BenchmarkRecorder
+{
+public:
+	struct Summary
+	{
+		size_t count = 0;
+		double min = 0, avg = 0, p50 = 0, p95 = 0, p99 = 0, max = 0;
+	};
+
+private:
+	std::vector<std::pair<std::string, std::vector<double>>> metrics;
+	std::vector<std::pair<std::string, std::string>> info;
+	std::vector<std::pair<std::string, double>> counters;
+
+public:
+	void record(const std::string& metric, double sample)
+	{
+		findOrInsert(metrics, metric).push_back(sample);
+	}
+
+	void setInfo(const std::string& key, const std::string& value)
+	{
+		findOrInsert(info, key) = value;
+	}
+
+	void setCounter(const std::string& key, double value)
+	{
+		findOrInsert(counters, key) = value;
+	}
+
+	static Summary summarize(std::vector<double> samples)
+	{
+		Summary summary;
+		if (samples.empty())
+		{
+			return summary;
+		}
+
+		std::sort(samples.begin(), samples.end());
+
+		double sum = 0;
+		for (double sample : samples)
+		{
+			sum += sample;
+		}
+
+		summary.count = samples.size();
+		summary.min = samples.front();
+		summary.avg = sum / samples.size();
+		summary.p50 = percentile(samples, 50);
+		summary.p95 = percentile(samples, 95);
+		summary.p99 = percentile(samples, 99);
+		summary.max = samples.back();
+		return summary;
+	}
+
+	std::string toJson() const
+	{
+		std::ostringstream json;
+		json << std::setprecision(6) << std::fixed;
+
+		json << "{\n\t\"info\": {";
+		for (size_t i = 0; i < info.size(); ++i)
+		{
+			json << (i == 0 ? "\n" : ",\n") << "\t\t" << quoted(info[i].first) << ": " << quoted(info[i].second);
+		}
+		json << "\n\t},\n\t\"metrics\": {";
+		for (size_t i = 0; i < metrics.size(); ++i)
+		{
+			const Summary summary = summarize(metrics[i].second);
+			json << (i == 0 ? "\n" : ",\n") << "\t\t" << quoted(metrics[i].first) << ": { "
+				<< "\"count\": " << summary.count
+				<< ", \"min\": " << summary.min
+				<< ", \"avg\": " << summary.avg
+				<< ", \"p50\": " << summary.p50
+				<< ", \"p95\": " << summary.p95
+				<< ", \"p99\": " << summary.p99
+				<< ", \"max\": " << summary.max
+				<< " }";
+		}
+		json << "\n\t},\n\t\"counters\": {";
+		for (size_t i = 0; i < counters.size(); ++i)
+		{
+			json << (i == 0 ? "\n" : ",\n") << "\t\t" << quoted(counters[i].first) << ": " << counters[i].second;
+		}
+		json << "\n\t}\n}\n";
+
+		return json.str();
+	}
+
+private:
+	template<typename T>
+	static T& findOrInsert(std::vector<std::pair<std::string, T>>& entries, const std::string& key)
+	{
+		for (auto& entry : entries)
+		{
+			if (entry.first == key)
+			{
+				return entry.second;
+			}
+		}
+		return entries.emplace_back(key, T{}).second;
+	}
+
+	// nearest-rank percentile of already sorted samples
+	static double percentile(const std::vector<double>& sortedSamples, double percent)
+	{
+		size_t rank = static_cast<size_t>(std::ceil(percent / 100 * sortedSamples.size()));
+		return sortedSamples[std::clamp<size_t>(rank, 1, sortedSamples.size()) - 1];
+	}
+
+	static std::string quoted(const std::string& text)
+	{
+		std::ostringstream result;
+		result << '"';
+		for (char c : text)
+		{
+			switch (c)
+			{
+			case '"': result << "\\\""; break;
+			case '\\': result << "\\\\"; break;
+			case '\n': result << "\\n"; break;
+			case '\t': result << "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+				{
+					result << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+				}
+				else
+				{
+					result << c;
+				}
+			}
+		}
+		result << '"';
+		return result.str();
+	}
+};
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <volk.h>
+
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+// Hands out slots of a fixed size descriptor array. A released slot may still be used by the frames in flight,
+// so it only becomes free again once the frame that released it comes around again.
+class DescriptorSlotAllocator
+{
+private:
+	uint32_t capacity = 0;
+	uint32_t nextUnused = 0;
+	std::vector<uint32_t> freeSlots;
+	std::vector<std::vector<uint32_t>> releasedSlots; // per frame in flight
+
+public:
+	void create(uint32_t capacity, size_t framesInFlight)
+	{
+		this->capacity = capacity;
+		nextUnused = 0;
+		freeSlots.clear();
+		releasedSlots.assign(framesInFlight, {});
+	}
+
+	uint32_t allocate()
+	{
+		if (!freeSlots.empty())
+		{
+			const uint32_t slot = freeSlots.back();
+			freeSlots.pop_back();
+			return slot;
+		}
+		if (nextUnused == capacity)
+		{
+			throw std::runtime_error("out of bindless descriptor slots");
+		}
+		return nextUnused++;
+	}
+
+	void release(uint32_t slot, size_t frameIndex)
+	{
+		releasedSlots[frameIndex].push_back(slot);
+	}
+
+	// Call once the fence of frameIndex has signaled.
+	void beginFrame(size_t frameIndex)
+	{
+		freeSlots.insert(freeSlots.end(), releasedSlots[frameIndex].begin(), releasedSlots[frameIndex].end());
+		releasedSlots[frameIndex].clear();
+	}
+
+	uint32_t getCapacity() const
+	{
+		return capacity;
+	}
+
+	uint32_t getUsedCount() const
+	{
+		uint32_t released = 0;
+		for (const auto& slots : releasedSlots)
+		{
+			released += static_cast<uint32_t>(slots.size());
+		}
+		return nextUnused - static_cast<uint32_t>(freeSlots.size()) - released;
+	}
+};
+
+// One descriptor set with every sampled image and storage buffer the shaders use, bound once per command buffer.
+// Shaders index its arrays with slots passed as push constants, so nothing is bound or allocated per draw.
+// Descriptors are written when a resource is added and may be replaced while the set is bound (update after bind),
+// slots that were never written are fine as long as no shader reads them (partially bound).
+//
+//   layout (set = 0, binding = 0) uniform sampler2D textures[];
+//   layout (set = 0, binding = 1) buffer Buffer { ... } buffers[];
+class BindlessDescriptors
+{
+public:
+	static constexpr uint32_t SAMPLED_IMAGE_BINDING = 0;
+	static constexpr uint32_t STORAGE_BUFFER_BINDING = 1;
+	static constexpr uint32_t MAX_SAMPLED_IMAGES = 16384;
+	static constexpr uint32_t MAX_STORAGE_BUFFERS = 16384;
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	size_t currentFrame = 0;
+
+	std::mutex mutex; // slots are added by startup steps running in parallel
+	DescriptorSlotAllocator sampledImageSlots;
+	DescriptorSlotAllocator storageBufferSlots;
+
+public:
+	// Only what this class relies on, to be chained into VkDeviceCreateInfo when supported.
+	static VkPhysicalDeviceDescriptorIndexingFeatures getRequiredFeatures()
+	{
+		VkPhysicalDeviceDescriptorIndexingFeatures features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+		features.runtimeDescriptorArray = VK_TRUE;
+		features.descriptorBindingPartiallyBound = VK_TRUE;
+		features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+		return features;
+	}
+
+	// Needs VK_EXT_descriptor_indexing to be supported by the device.
+	static bool isSupported(VkPhysicalDevice physicalDevice)
+	{
+		VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &indexingFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+		return indexingFeatures.runtimeDescriptorArray
+			&& indexingFeatures.descriptorBindingPartiallyBound
+			&& indexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+			&& indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind;
+	}
+
+	// The arrays are as large as the device allows in a single stage, up to the maximums above.
+	void create(VkPhysicalDevice physicalDevice, VkDevice device, VkShaderStageFlags stages, size_t framesInFlight)
+	{
+		this->device = device;
+
+		VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+		indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &indexingProperties;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+		// both arrays count against the per stage and per pool totals, which are split evenly
+		const uint32_t resourceShare = std::min(indexingProperties.maxPerStageUpdateAfterBindResources,
+			indexingProperties.maxUpdateAfterBindDescriptorsInAllPools) / 2;
+		const uint32_t sampledImageCount = std::min({ MAX_SAMPLED_IMAGES, resourceShare,
+			indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+			indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+			indexingProperties.maxDescriptorSetUpdateAfterBindSamplers });
+		const uint32_t storageBufferCount = std::min({ MAX_STORAGE_BUFFERS, resourceShare,
+			indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+			indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers });
+		sampledImageSlots.create(sampledImageCount, framesInFlight);
+		storageBufferSlots.create(storageBufferCount, framesInFlight);
+
+		createSetLayout(stages, sampledImageCount, storageBufferCount);
+		createPool(sampledImageCount, storageBufferCount);
+		allocateSet();
+	}
+
+	void destroy()
+	{
+		vkDestroyDescriptorPool(device, pool, nullptr);
+		vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+		pool = VK_NULL_HANDLE;
+		setLayout = VK_NULL_HANDLE;
+		set = VK_NULL_HANDLE;
+	}
+
+	VkDescriptorSetLayout getSetLayout() const
+	{
+		return setLayout;
+	}
+
+	VkDescriptorSet getSet() const
+	{
+		return set;
+	}
+
+	// Call once the fence of frameIndex has signaled, afterwards released slots are credited to this frame.
+	void beginFrame(size_t frameIndex)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		currentFrame = frameIndex;
+		sampledImageSlots.beginFrame(frameIndex);
+		storageBufferSlots.beginFrame(frameIndex);
+	}
+
+	uint32_t addSampledImage(VkImageView view, VkSampler sampler, VkImageLayout layout)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const uint32_t slot = sampledImageSlots.allocate();
+		writeSampledImage(slot, view, sampler, layout);
+		return slot;
+	}
+
+	uint32_t addStorageBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const uint32_t slot = storageBufferSlots.allocate();
+		writeStorageBuffer(slot, buffer, offset, range);
+		return slot;
+	}
+
+	// The slot must not be used by commands recorded after this.
+	void releaseSampledImage(uint32_t slot)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		sampledImageSlots.release(slot, currentFrame);
+	}
+
+	void releaseStorageBuffer(uint32_t slot)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		storageBufferSlots.release(slot, currentFrame);
+	}
+
+	uint32_t getUsedSampledImageCount()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return sampledImageSlots.getUsedCount();
+	}
+
+	uint32_t getUsedStorageBufferCount()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return storageBufferSlots.getUsedCount();
+	}
+
+private:
+	void createSetLayout(VkShaderStageFlags stages, uint32_t sampledImageCount, uint32_t storageBufferCount)
+	{
+		VkDescriptorSetLayoutBinding bindings[2]{};
+		bindings[SAMPLED_IMAGE_BINDING].binding = SAMPLED_IMAGE_BINDING;
+		bindings[SAMPLED_IMAGE_BINDING].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[SAMPLED_IMAGE_BINDING].descriptorCount = sampledImageCount;
+		bindings[SAMPLED_IMAGE_BINDING].stageFlags = stages;
+		bindings[STORAGE_BUFFER_BINDING].binding = STORAGE_BUFFER_BINDING;
+		bindings[STORAGE_BUFFER_BINDING].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[STORAGE_BUFFER_BINDING].descriptorCount = storageBufferCount;
+		bindings[STORAGE_BUFFER_BINDING].stageFlags = stages;
+
+		const VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+		const VkDescriptorBindingFlags bindingFlags[] = { flags, flags };
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfo flagsCreateInfo{};
+		flagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		flagsCreateInfo.bindingCount = 2;
+		flagsCreateInfo.pBindingFlags = bindingFlags;
+
+		VkDescriptorSetLayoutCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		createInfo.pNext = &flagsCreateInfo;
+		createInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		createInfo.bindingCount = 2;
+		createInfo.pBindings = bindings;
+
+		if (vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &setLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create bindless descriptor set layout");
+		}
+	}
+
+	void createPool(uint32_t sampledImageCount, uint32_t storageBufferCount)
+	{
+		const VkDescriptorPoolSize poolSizes[] = {
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, sampledImageCount },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, storageBufferCount }
+		};
+
+		VkDescriptorPoolCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		createInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		createInfo.maxSets = 1;
+		createInfo.poolSizeCount = 2;
+		createInfo.pPoolSizes = poolSizes;
+
+		if (vkCreateDescriptorPool(device, &createInfo, nullptr, &pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create bindless descriptor pool");
+		}
+	}
+
+	void allocateSet()
+	{
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = pool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &setLayout;
+
+		if (vkAllocateDescriptorSets(device, &allocateInfo, &set) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate the bindless descriptor set");
+		}
+	}
+
+	void writeSampledImage(uint32_t slot, VkImageView view, VkSampler sampler, VkImageLayout layout)
+	{
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.sampler = sampler;
+		imageInfo.imageView = view;
+		imageInfo.imageLayout = layout;
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = set;
+		write.dstBinding = SAMPLED_IMAGE_BINDING;
+		write.dstArrayElement = slot;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	}
+
+	void writeStorageBuffer(uint32_t slot, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+	{
+		VkDescriptorBufferInfo bufferInfo{ buffer, offset, range };
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = set;
+		write.dstBinding = STORAGE_BUFFER_BINDING;
+		write.dstArrayElement = slot;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	}
+};
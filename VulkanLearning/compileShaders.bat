@@ -1,2 +1,8 @@
 @echo off
-for /r %%i in (*.frag, *.vert) do %VULKAN_SDK%/Bin/glslangValidator.exe -V %%i
\ No newline at end of file
+for /r %%i in (*.frag, *.vert) do %VULKAN_SDK%/Bin/glslangValidator.exe -V %%i
+rem mesh shading needs SPIR-V 1.4, the files are named after their stage like the ones above
+for /r %%i in (*.task, *.mesh) do %VULKAN_SDK%/Bin/glslangValidator.exe -V --target-env spirv1.4 %%i
+rem compute shaders are named after their file, since a program has more than one
+for /r %%i in (*.comp) do %VULKAN_SDK%/Bin/glslangValidator.exe -V %%i -o %%~ni.spv
+rem the app loads the shaders from a single archive
+powershell -NoProfile -ExecutionPolicy Bypass -File "%~dp0packShaders.ps1"
\ No newline at end of file
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <volk.h>
+
+#include "appOptions.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+
+// Several linked GPUs driven through one logical device (device groups, core since Vulkan 1.1).
+// Device local memory is replicated on every GPU and command buffers run on the GPUs of their device mask.
+//  - AlternateFrame: each frame in flight renders on one GPU, which presents its image itself or through a GPU with a display.
+//  - SplitFrame: every GPU runs the whole frame but only rasterizes its horizontal band, the images are summed on present.
+// An inactive group stands for a single GPU: one device, mask 1, and no device group structures are chained.
+class DeviceGroup
+{
+private:
+	DeviceGroupMode mode = DeviceGroupMode::Off;
+	std::vector<VkPhysicalDevice> physicalDevices; // in device index order, empty when inactive
+	VkDeviceGroupDeviceCreateInfo deviceCreateInfo{};
+
+	VkDeviceGroupPresentModeFlagsKHR swapchainModes = 0;
+	std::vector<uint32_t> frameDeviceMasks; // used round robin by the frames in flight
+	std::vector<VkDeviceGroupPresentModeFlagBitsKHR> framePresentModes;
+
+public:
+	// The GPUs physicalDevice is linked with, including itself. Just physicalDevice if it isn't part of a group.
+	static std::vector<VkPhysicalDevice> findLinkedDevices(VkInstance instance, VkPhysicalDevice physicalDevice)
+	{
+		uint32_t groupCount = 0;
+		vkEnumeratePhysicalDeviceGroups(instance, &groupCount, nullptr);
+		std::vector<VkPhysicalDeviceGroupProperties> groups(groupCount);
+		for (auto& group : groups)
+		{
+			group.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GROUP_PROPERTIES;
+		}
+		vkEnumeratePhysicalDeviceGroups(instance, &groupCount, groups.data());
+
+		for (const auto& group : groups)
+		{
+			const VkPhysicalDevice* first = group.physicalDevices;
+			const VkPhysicalDevice* last = group.physicalDevices + group.physicalDeviceCount;
+			if (std::find(first, last, physicalDevice) != last)
+			{
+				return { first, last };
+			}
+		}
+		return { physicalDevice };
+	}
+
+	// Stays inactive with fewer than two devices.
+	void select(DeviceGroupMode mode, const std::vector<VkPhysicalDevice>& physicalDevices)
+	{
+		if (mode == DeviceGroupMode::Off || physicalDevices.size() < 2)
+		{
+			return;
+		}
+
+		this->mode = mode;
+		this->physicalDevices = physicalDevices;
+		deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_DEVICE_CREATE_INFO;
+		deviceCreateInfo.physicalDeviceCount = static_cast<uint32_t>(this->physicalDevices.size());
+		deviceCreateInfo.pPhysicalDevices = this->physicalDevices.data();
+	}
+
+	bool isActive() const
+	{
+		return !physicalDevices.empty();
+	}
+
+	DeviceGroupMode getMode() const
+	{
+		return mode;
+	}
+
+	uint32_t getDeviceCount() const
+	{
+		return isActive() ? static_cast<uint32_t>(physicalDevices.size()) : 1;
+	}
+
+	uint32_t getAllDevicesMask() const
+	{
+		return (1u << getDeviceCount()) - 1;
+	}
+
+	// the device indices of mask's bits in ascending order
+	std::vector<uint32_t> getDeviceIndices(uint32_t mask) const
+	{
+		std::vector<uint32_t> indices;
+		for (uint32_t i = 0; i < getDeviceCount(); ++i)
+		{
+			if (mask & (1u << i))
+			{
+				indices.push_back(i);
+			}
+		}
+		return indices;
+	}
+
+	// to be chained into VkDeviceCreateInfo, nullptr when inactive
+	const void* getDeviceCreateInfo() const
+	{
+		return isActive() ? &deviceCreateInfo : nullptr;
+	}
+
+	// Decides how every frame is presented, once the device exists. Split frame rendering falls back to alternate frames
+	// if the images can't be summed, GPUs that can't get their image to the window are left out.
+	void configurePresentation(VkDevice device, VkSurfaceKHR surface)
+	{
+		if (!isActive())
+		{
+			return;
+		}
+
+		VkDeviceGroupPresentCapabilitiesKHR capabilities{};
+		capabilities.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_CAPABILITIES_KHR;
+		if (vkGetDeviceGroupPresentCapabilitiesKHR(device, &capabilities) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to query device group present capabilities");
+		}
+		VkDeviceGroupPresentModeFlagsKHR surfaceModes = 0;
+		if (vkGetDeviceGroupSurfacePresentModesKHR(device, surface, &surfaceModes) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to query device group surface present modes");
+		}
+		const VkDeviceGroupPresentModeFlagsKHR modes = capabilities.modes & surfaceModes;
+
+		// a GPU can present the images of the GPUs in its present mask
+		auto canBePresented = [&](uint32_t presentedMask) {
+			for (uint32_t i = 0; i < getDeviceCount(); ++i)
+			{
+				if ((capabilities.presentMask[i] & presentedMask) == presentedMask)
+				{
+					return true;
+				}
+			}
+			return false;
+		};
+
+		if (mode == DeviceGroupMode::SplitFrame)
+		{
+			if ((modes & VK_DEVICE_GROUP_PRESENT_MODE_SUM_BIT_KHR) && canBePresented(getAllDevicesMask()))
+			{
+				swapchainModes = VK_DEVICE_GROUP_PRESENT_MODE_SUM_BIT_KHR;
+				frameDeviceMasks = { getAllDevicesMask() };
+				framePresentModes = { VK_DEVICE_GROUP_PRESENT_MODE_SUM_BIT_KHR };
+				return;
+			}
+			std::cerr << "the device group can't sum the images of its gpus, falling back to alternate frame rendering\n";
+			mode = DeviceGroupMode::AlternateFrame;
+		}
+
+		for (uint32_t i = 0; i < getDeviceCount(); ++i)
+		{
+			const uint32_t mask = 1u << i;
+			if ((modes & VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR) && (capabilities.presentMask[i] & mask))
+			{
+				frameDeviceMasks.push_back(mask);
+				framePresentModes.push_back(VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR);
+			}
+			else if ((modes & VK_DEVICE_GROUP_PRESENT_MODE_REMOTE_BIT_KHR) && canBePresented(mask))
+			{
+				frameDeviceMasks.push_back(mask);
+				framePresentModes.push_back(VK_DEVICE_GROUP_PRESENT_MODE_REMOTE_BIT_KHR);
+			}
+			else
+			{
+				std::cerr << "gpu " << i << " of the device group can't present to the window and only mirrors resources\n";
+				continue;
+			}
+			swapchainModes |= framePresentModes.back();
+		}
+
+		if (frameDeviceMasks.empty())
+		{
+			throw std::runtime_error("no gpu of the device group can present to the window");
+		}
+	}
+
+	// to be chained into VkSwapchainCreateInfoKHR when active
+	VkDeviceGroupSwapchainCreateInfoKHR getSwapchainCreateInfo() const
+	{
+		VkDeviceGroupSwapchainCreateInfoKHR createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SWAPCHAIN_CREATE_INFO_KHR;
+		createInfo.modes = swapchainModes;
+		return createInfo;
+	}
+
+	// how many GPUs render frames, the rest only keep their copies of the resources up to date
+	size_t getRenderingDeviceCount() const
+	{
+		return isActive() ? frameDeviceMasks.size() : 1;
+	}
+
+	// the GPUs the frame in flight frameIndex renders on
+	uint32_t getFrameDeviceMask(size_t frameIndex) const
+	{
+		return isActive() ? frameDeviceMasks[frameIndex % frameDeviceMasks.size()] : 1;
+	}
+
+	VkDeviceGroupPresentModeFlagBitsKHR getFramePresentMode(size_t frameIndex) const
+	{
+		return framePresentModes[frameIndex % framePresentModes.size()];
+	}
+
+	// the band of the image the GPU deviceIndex rasterizes when splitting frames
+	VkRect2D getSplitFrameScissor(uint32_t deviceIndex, VkExtent2D extent) const
+	{
+		const uint32_t top = extent.height * deviceIndex / getDeviceCount();
+		const uint32_t bottom = extent.height * (deviceIndex + 1) / getDeviceCount();
+
+		VkRect2D scissor{};
+		scissor.offset = { 0, static_cast<int32_t>(top) };
+		scissor.extent = { extent.width, bottom - top };
+		return scissor;
+	}
+};
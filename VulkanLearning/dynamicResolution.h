@@ -0,0 +1,70 @@
+#pragma once
+
+#include <volk.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Holds the GPU time of a frame near a budget by scaling the resolution the scene is rendered at, the frame is then
+// upscaled to the output resolution. The GPU time is mostly proportional to the number of pixels shaded, so the scale
+// that would meet the budget is estimated from the square root of budget over measured time. Measurements arrive a few
+// frames late and were taken at an older scale, so every one only moves part of the way there.
+class DynamicResolution
+{
+public:
+	static constexpr double HEADROOM = 0.9; // of the budget that is aimed for, so a spike doesn't overshoot it right away
+	static constexpr float GAIN = 0.25f; // fraction of the way to the estimate covered per measurement
+	static constexpr float DEADBAND = 0.02f; // smaller changes of the scale are ignored, so the resolution doesn't flicker
+	static constexpr uint32_t EXTENT_GRANULARITY = 8; // pixels, the scaled extent is a multiple of it
+
+private:
+	double budgetMilliseconds = 0;
+	float minScale = 1;
+	float scale = 1;
+
+public:
+	void configure(double budgetMilliseconds, float minScale)
+	{
+		this->budgetMilliseconds = budgetMilliseconds;
+		this->minScale = std::clamp(minScale, 0.0f, 1.0f);
+		scale = 1;
+	}
+
+	// Call once per new GPU timing of a whole frame.
+	void update(double gpuMilliseconds)
+	{
+		if (gpuMilliseconds <= 0 || budgetMilliseconds <= 0)
+		{
+			return;
+		}
+
+		const float estimate = scale * static_cast<float>(std::sqrt(budgetMilliseconds * HEADROOM / gpuMilliseconds));
+		const float next = std::clamp(scale + (estimate - scale) * GAIN, minScale, 1.0f);
+		if (std::abs(next - scale) >= DEADBAND || next == minScale || next == 1)
+		{
+			scale = next;
+		}
+	}
+
+	// the same for width and height, between the minimum scale and 1
+	float getScale() const
+	{
+		return scale;
+	}
+
+	// The part of an image of outputExtent the scene is rendered into, at the top left.
+	VkExtent2D getRenderExtent(VkExtent2D outputExtent) const
+	{
+		if (scale >= 1)
+		{
+			return outputExtent;
+		}
+
+		auto scaled = [this](uint32_t size) {
+			const uint32_t rounded = static_cast<uint32_t>(size * scale) / EXTENT_GRANULARITY * EXTENT_GRANULARITY;
+			return std::clamp(rounded, std::min(size, EXTENT_GRANULARITY), size);
+		};
+		return { scaled(outputExtent.width), scaled(outputExtent.height) };
+	}
+};
@@ -1,12 +1,65 @@
 #version 450
 #extension GL_KHR_vulkan_glsl : enable
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout (location = 0) in vec3 vertColor;
+layout (location = 1) in vec2 vertTexCoord;
 
 layout (location = 0) out vec4 fragColor;
 
+// the bindless set, see BindlessDescriptors
+layout (set = 0, binding = 0) uniform sampler2D textures[];
+
+// matches VirtualTexture::ResidencyHeader
+layout (std430, set = 0, binding = 1) readonly buffer Residency
+{
+	uint mipTailStart;
+	uint residencyColumns;
+	uint residencyRows;
+	uint tileWidth;
+	uint tileHeight;
+	uvec4 mips[16]; // tiles per row, tile rows, first feedback index
+	uint minResidentMip[];
+} residencies[];
+
+layout (std430, set = 0, binding = 1) writeonly buffer Feedback
+{
+	uint requestedTiles[];
+} feedbacks[];
+
+// matches ScenePushConstants, slots in the arrays above
+layout (push_constant) uniform SceneSlots
+{
+	uint virtualTextureSlot;
+	uint residencySlot;
+	uint feedbackSlot;
+};
+
+#define virtualTexture textures[virtualTextureSlot]
+#define residency residencies[residencySlot]
+
+void requestTile(uint mip)
+{
+	uvec2 tile = uvec2(vertTexCoord * vec2(textureSize(virtualTexture, int(mip))) / vec2(residency.tileWidth, residency.tileHeight));
+	tile = min(tile, residency.mips[mip].xy - 1);
+	feedbacks[feedbackSlot].requestedTiles[residency.mips[mip].z + tile.y * residency.mips[mip].x + tile.x] = 1;
+}
+
 void main()
 {
-	fragColor = vec4(vertColor, 0);
+	float wantedLod = max(textureQueryLod(virtualTexture, vertTexCoord).y, 0);
+	uint wantedMip = uint(wantedLod);
+	if (wantedMip < residency.mipTailStart)
+	{
+		requestTile(wantedMip);
+	}
+
+	// never sample finer than what is resident
+	uvec2 regions = uvec2(residency.residencyColumns, residency.residencyRows);
+	uvec2 region = min(uvec2(vertTexCoord * vec2(regions)), regions - 1);
+	float residentLod = float(residency.minResidentMip[region.y * regions.x + region.x]);
+	vec4 texel = textureLod(virtualTexture, vertTexCoord, max(wantedLod, residentLod));
+
+	fragColor = vec4(vertColor * texel.rgb, 0);
 }
\ No newline at end of file
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <volk.h>
+
+#include "memoryAllocator.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+
+// Every implementation has at least this many bytes of push constants.
+constexpr uint32_t GUARANTEED_PUSH_CONSTANTS_SIZE = 128;
+
+// A push constant range holding a T at offset, for small per draw data.
+template<typename T>
+VkPushConstantRange makePushConstantRange(VkShaderStageFlags stages, uint32_t offset = 0)
+{
+	static_assert(sizeof(T) % 4 == 0, "push constant sizes are a multiple of 4");
+
+	if (offset % 4 != 0 || offset + sizeof(T) > GUARANTEED_PUSH_CONSTANTS_SIZE)
+	{
+		throw std::runtime_error("push constant range exceeds the guaranteed push constant size");
+	}
+
+	VkPushConstantRange range{};
+	range.stageFlags = stages;
+	range.offset = offset;
+	range.size = sizeof(T);
+	return range;
+}
+
+// Per frame and per view data that is too large for push constants. The buffer is mapped once and holds one
+// region of bytesPerFrame per frame in flight, a frame's constants are appended to its region and bound with
+// the dynamic offset push() returns. The single descriptor set never changes, so nothing is mapped or
+// updated per frame. Not thread safe: push on the thread that records the frame, the offsets can be shared.
+class UniformRing
+{
+public:
+	static constexpr uint32_t BINDING = 0;
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;
+	AllocatedBuffer buffer;
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VkDescriptorSet set = VK_NULL_HANDLE;
+
+	VkDeviceSize alignment = 0;
+	VkDeviceSize blockSize = 0; // the range of the descriptor, no push may be larger
+	VkDeviceSize bytesPerFrame = 0;
+	VkDeviceSize frameStart = 0;
+	VkDeviceSize cursor = 0; // relative to frameStart
+
+public:
+	// blockSize is the largest constants struct that is pushed, bytesPerFrame how much a frame may push in total.
+	void create(VkDevice device, MemoryAllocator& allocator, const VkPhysicalDeviceLimits& limits, VkShaderStageFlags stages,
+		VkDeviceSize blockSize, VkDeviceSize bytesPerFrame, size_t framesInFlight)
+	{
+		this->device = device;
+		this->allocator = &allocator;
+
+		alignment = limits.minUniformBufferOffsetAlignment;
+		this->blockSize = alignUp(blockSize);
+		if (this->blockSize > limits.maxUniformBufferRange)
+		{
+			throw std::runtime_error("uniform ring block size exceeds maxUniformBufferRange");
+		}
+		this->bytesPerFrame = alignUp(std::max(bytesPerFrame, this->blockSize));
+		frameStart = 0;
+		cursor = 0;
+
+		buffer = allocator.createBuffer(this->bytesPerFrame * framesInFlight, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MemoryUsage::CpuToGpu);
+		if (!buffer.allocation.mapped)
+		{
+			allocator.destroyBuffer(buffer);
+			throw std::runtime_error("uniform ring memory isn't host visible");
+		}
+
+		createSetLayout(stages);
+		createPool();
+		allocateSet();
+	}
+
+	void destroy()
+	{
+		vkDestroyDescriptorPool(device, pool, nullptr);
+		vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+		allocator->destroyBuffer(buffer);
+		pool = VK_NULL_HANDLE;
+		setLayout = VK_NULL_HANDLE;
+		set = VK_NULL_HANDLE;
+	}
+
+	VkDescriptorSetLayout getSetLayout() const
+	{
+		return setLayout;
+	}
+
+	VkDescriptorSet getSet() const
+	{
+		return set;
+	}
+
+	// Call once the fence of frameIndex has signaled, the region of that frame is then overwritten.
+	void beginFrame(size_t frameIndex)
+	{
+		frameStart = bytesPerFrame * frameIndex;
+		cursor = 0;
+	}
+
+	// Copies data into the current frame's region and returns the dynamic offset to bind it with.
+	template<typename T>
+	uint32_t push(const T& data)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "uniform data is copied byte by byte");
+
+		if (sizeof(T) > blockSize)
+		{
+			throw std::runtime_error("uniform data is larger than the uniform ring's block size");
+		}
+		if (cursor + blockSize > bytesPerFrame)
+		{
+			throw std::runtime_error("uniform ring is full for this frame");
+		}
+
+		const VkDeviceSize offset = frameStart + cursor;
+		std::memcpy(static_cast<char*>(buffer.allocation.mapped) + offset, &data, sizeof(T));
+		cursor += alignUp(sizeof(T));
+		return static_cast<uint32_t>(offset);
+	}
+
+	// Call after the last push of the frame and before submitting it.
+	void flush()
+	{
+		if (cursor != 0)
+		{
+			allocator->flush(buffer.allocation, frameStart, cursor);
+		}
+	}
+
+	VkDeviceSize getUsedBytes() const
+	{
+		return cursor;
+	}
+
+private:
+	VkDeviceSize alignUp(VkDeviceSize size) const
+	{
+		return (size + alignment - 1) / alignment * alignment;
+	}
+
+	void createSetLayout(VkShaderStageFlags stages)
+	{
+		VkDescriptorSetLayoutBinding binding{};
+		binding.binding = BINDING;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		binding.descriptorCount = 1;
+		binding.stageFlags = stages;
+
+		VkDescriptorSetLayoutCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		createInfo.bindingCount = 1;
+		createInfo.pBindings = &binding;
+
+		if (vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &setLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create uniform ring descriptor set layout");
+		}
+	}
+
+	void createPool()
+	{
+		const VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 };
+
+		VkDescriptorPoolCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		createInfo.maxSets = 1;
+		createInfo.poolSizeCount = 1;
+		createInfo.pPoolSizes = &poolSize;
+
+		if (vkCreateDescriptorPool(device, &createInfo, nullptr, &pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create uniform ring descriptor pool");
+		}
+	}
+
+	// written once, the offset into the buffer is supplied when binding
+	void allocateSet()
+	{
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = pool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &setLayout;
+
+		if (vkAllocateDescriptorSets(device, &allocateInfo, &set) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate the uniform ring descriptor set");
+		}
+
+		VkDescriptorBufferInfo bufferInfo{};
+		bufferInfo.buffer = buffer.buffer;
+		bufferInfo.offset = 0;
+		bufferInfo.range = blockSize;
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = set;
+		write.dstBinding = BINDING;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		write.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	}
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <volk.h>
+
+#include "appOptions.h"
+
+#include <optional>
+#include <chrono>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <cstdint>
+
+// Tags every present with an id (VK_KHR_present_id) and finds out when it reached the screen (VK_KHR_present_wait),
+// which gives the latency from sampling input to the image being presented.
+// With the low latency profile each frame only starts once the previous one was presented, and then sleeps
+// until just enough time is left to finish before the next refresh, so the input it samples is as fresh as possible.
+// Without present wait nothing is measured and the low latency profile only keeps a single frame in flight.
+class FramePacer
+{
+public:
+	static constexpr auto PRESENT_WAIT_TIMEOUT = std::chrono::milliseconds(100); // a minimized window may never present
+	static constexpr double WAKE_UP_MARGIN_MILLISECONDS = 1; // slack for the sleep and the estimates
+	static constexpr double ESTIMATE_WEIGHT = 0.1; // of a new sample in the moving averages
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct PendingPresent
+	{
+		uint64_t id;
+		Clock::time_point inputSampled;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	LatencyProfile profile = LatencyProfile::Throughput;
+	bool presentWaitEnabled = false;
+
+	uint64_t nextPresentId = 1;
+	Clock::time_point inputSampled;
+	std::deque<PendingPresent> pendingPresents; // oldest first
+	std::optional<Clock::time_point> lastPresented;
+	double refreshIntervalMilliseconds = 0; // 0 until measured
+	double frameCostMilliseconds = 0; // from sampling input until the GPU is done with the frame
+	std::vector<double> latencies; // since the last takeLatencies
+
+public:
+	void create(VkDevice device, LatencyProfile profile, bool presentWaitEnabled)
+	{
+		this->device = device;
+		this->profile = profile;
+		this->presentWaitEnabled = presentWaitEnabled;
+	}
+
+	bool isMeasuring() const
+	{
+		return presentWaitEnabled;
+	}
+
+	// Call before polling input. Collects the frames that were presented meanwhile and, for the low latency profile,
+	// waits for the previous frame to be presented and then until the next frame has to start.
+	void waitForFrameStart(VkSwapchainKHR swapchain)
+	{
+		if (!presentWaitEnabled)
+		{
+			return;
+		}
+
+		if (profile != LatencyProfile::LowLatency || pendingPresents.empty())
+		{
+			collectPresented(swapchain, 0);
+			return;
+		}
+
+		const uint64_t timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(PRESENT_WAIT_TIMEOUT).count();
+		if (!collectPresented(swapchain, timeout) || refreshIntervalMilliseconds == 0)
+		{
+			return;
+		}
+
+		const double delay = refreshIntervalMilliseconds - frameCostMilliseconds - WAKE_UP_MARGIN_MILLISECONDS;
+		if (delay > 0)
+		{
+			std::this_thread::sleep_until(*lastPresented + std::chrono::duration<double, std::milli>(delay));
+		}
+	}
+
+	// Call with the time input was polled at, before the frame that uses it is recorded.
+	void markInputSampled(Clock::time_point sampled)
+	{
+		inputSampled = sampled;
+	}
+
+	// the time since markInputSampled, to report how long the frame took on the CPU
+	double getMillisecondsSinceInputSampled() const
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - inputSampled).count();
+	}
+
+	// The CPU time from sampling input to submitting plus the GPU time of the frame, the low latency profile leaves this much time.
+	void recordFrameCost(double milliseconds)
+	{
+		frameCostMilliseconds = frameCostMilliseconds == 0 ? milliseconds : frameCostMilliseconds + (milliseconds - frameCostMilliseconds) * ESTIMATE_WEIGHT;
+	}
+
+	// The id to attach to the present of the current frame, 0 if presents aren't tracked.
+	uint64_t beginPresent()
+	{
+		if (!presentWaitEnabled)
+		{
+			return 0;
+		}
+		pendingPresents.push_back({ nextPresentId, inputSampled });
+		return nextPresentId++;
+	}
+
+	// Ids belong to a swapchain, the ones pending on a replaced swapchain are dropped.
+	void onSwapchainRecreated()
+	{
+		pendingPresents.clear();
+		lastPresented.reset();
+	}
+
+	// the input to present latencies measured since the last call, in milliseconds
+	std::vector<double> takeLatencies()
+	{
+		std::vector<double> result;
+		result.swap(latencies);
+		return result;
+	}
+
+private:
+	// Waits up to timeout nanoseconds for the newest pending present and records every present that completed.
+	// When polling with a timeout of 0, completions are seen up to a frame late, so the latencies are upper bounds.
+	bool collectPresented(VkSwapchainKHR swapchain, uint64_t timeout)
+	{
+		bool any = false;
+		while (!pendingPresents.empty())
+		{
+			// presents complete in order, so waiting for the newest one covers all older ones, polling goes through them one by one
+			const uint64_t waitedId = timeout != 0 ? pendingPresents.back().id : pendingPresents.front().id;
+			const VkResult result = vkWaitForPresentKHR(device, swapchain, waitedId, timeout);
+			if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+			{
+				if (result != VK_TIMEOUT)
+				{
+					pendingPresents.clear(); // e.g. out of date, the swapchain is about to be recreated
+				}
+				return any;
+			}
+
+			const Clock::time_point now = Clock::now();
+			while (!pendingPresents.empty() && pendingPresents.front().id <= waitedId)
+			{
+				latencies.push_back(std::chrono::duration<double, std::milli>(now - pendingPresents.front().inputSampled).count());
+				pendingPresents.pop_front();
+			}
+			updateRefreshInterval(now);
+			any = true;
+
+			if (timeout != 0)
+			{
+				return true;
+			}
+		}
+		return any;
+	}
+
+	void updateRefreshInterval(Clock::time_point presented)
+	{
+		if (lastPresented)
+		{
+			const double interval = std::chrono::duration<double, std::milli>(presented - *lastPresented).count();
+			if (interval < std::chrono::duration<double, std::milli>(PRESENT_WAIT_TIMEOUT).count()) // skip stalls
+			{
+				refreshIntervalMilliseconds = refreshIntervalMilliseconds == 0 ? interval
+					: refreshIntervalMilliseconds + (interval - refreshIntervalMilliseconds) * ESTIMATE_WEIGHT;
+			}
+		}
+		lastPresented = presented;
+	}
+};
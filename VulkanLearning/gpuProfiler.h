@@ -0,0 +1,200 @@
+#pragma once
+
+#include <volk.h>
+
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Measures GPU time of named zones with timestamp queries.
+// Every frame in flight gets its own range of queries, which is only read back once
+// the frame's fence has signaled, so results arrive a few frames late but never stall.
+class GpuProfiler
+{
+public:
+	static constexpr uint32_t MAX_ZONES_PER_FRAME = 32;
+	static constexpr uint32_t INVALID_ZONE = UINT32_MAX;
+
+	struct ZoneResult
+	{
+		std::string name;
+		double milliseconds;
+	};
+
+	// Writes the begin timestamp on construction and the end timestamp on destruction.
+	class ScopedZone
+	{
+	private:
+		GpuProfiler& profiler;
+		VkCommandBuffer commandBuffer;
+		uint32_t zone;
+	public:
+		ScopedZone(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const char* name) :
+			profiler{ profiler },
+			commandBuffer{ commandBuffer },
+			zone{ profiler.beginZone(commandBuffer, name) }
+		{
+		}
+
+		ScopedZone(const ScopedZone&) = delete;
+		ScopedZone& operator=(const ScopedZone&) = delete;
+
+		~ScopedZone()
+		{
+			profiler.endZone(commandBuffer, zone);
+		}
+	};
+
+private:
+	static constexpr uint32_t QUERIES_PER_FRAME = MAX_ZONES_PER_FRAME * 2;
+
+	struct FrameZones
+	{
+		std::vector<std::string> names; // zone i uses queries 2i (begin) and 2i + 1 (end)
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	double nanosecondsPerTick = 0;
+	uint64_t timestampMask = 0;
+	std::vector<FrameZones> frames;
+	size_t currentFrame = 0;
+	std::vector<uint64_t> readbackScratch;
+	std::vector<ZoneResult> latestResults;
+	uint64_t completedFrameCount = 0;
+
+public:
+	// timestampValidBits of 0 means the queue can't write timestamps, in which case every call is a no-op
+	void create(VkDevice device, float timestampPeriod, uint32_t timestampValidBits, size_t frameCount)
+	{
+		this->device = device;
+		frames.assign(frameCount, {});
+
+		if (timestampValidBits == 0)
+		{
+			return;
+		}
+
+		nanosecondsPerTick = timestampPeriod;
+		timestampMask = timestampValidBits >= 64 ? UINT64_MAX : (uint64_t(1) << timestampValidBits) - 1;
+
+		VkQueryPoolCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		createInfo.queryCount = QUERIES_PER_FRAME * frameCount;
+
+		if (vkCreateQueryPool(device, &createInfo, nullptr, &queryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timestamp query pool");
+		}
+	}
+
+	void destroy()
+	{
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(device, queryPool, nullptr);
+			queryPool = VK_NULL_HANDLE;
+		}
+	}
+
+	bool isSupported() const
+	{
+		return queryPool != VK_NULL_HANDLE;
+	}
+
+	// Must be recorded outside of a render pass, once the fence of frameIndex has signaled.
+	// Collects the results the frame slot produced last time and resets its queries.
+	void beginFrame(VkCommandBuffer commandBuffer, size_t frameIndex)
+	{
+		currentFrame = frameIndex;
+		if (!isSupported())
+		{
+			return;
+		}
+
+		collectResults(frameIndex);
+		frames[frameIndex].names.clear();
+		vkCmdResetQueryPool(commandBuffer, queryPool, firstQuery(frameIndex), QUERIES_PER_FRAME);
+	}
+
+	uint32_t beginZone(VkCommandBuffer commandBuffer, const char* name, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT)
+	{
+		auto& names = frames[currentFrame].names;
+		if (!isSupported() || names.size() == MAX_ZONES_PER_FRAME)
+		{
+			return INVALID_ZONE;
+		}
+
+		const uint32_t zone = names.size();
+		names.emplace_back(name);
+		vkCmdWriteTimestamp(commandBuffer, stage, queryPool, firstQuery(currentFrame) + zone * 2);
+		return zone;
+	}
+
+	void endZone(VkCommandBuffer commandBuffer, uint32_t zone, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT)
+	{
+		if (zone == INVALID_ZONE)
+		{
+			return;
+		}
+
+		vkCmdWriteTimestamp(commandBuffer, stage, queryPool, firstQuery(currentFrame) + zone * 2 + 1);
+	}
+
+	// GPU time of every zone of the most recently completed frame
+	const std::vector<ZoneResult>& getLatestResults() const
+	{
+		return latestResults;
+	}
+
+	// increases every time new results are read back
+	uint64_t getCompletedFrameCount() const
+	{
+		return completedFrameCount;
+	}
+
+private:
+	uint32_t firstQuery(size_t frameIndex) const
+	{
+		return static_cast<uint32_t>(frameIndex) * QUERIES_PER_FRAME;
+	}
+
+	void collectResults(size_t frameIndex)
+	{
+		const auto& names = frames[frameIndex].names;
+		if (names.empty())
+		{
+			return;
+		}
+
+		// every query yields its value followed by its availability
+		const uint32_t queryCount = names.size() * 2;
+		readbackScratch.resize(queryCount * 2);
+		VkResult result = vkGetQueryPoolResults(
+			device, queryPool, firstQuery(frameIndex), queryCount,
+			readbackScratch.size() * sizeof(uint64_t), readbackScratch.data(), 2 * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+		);
+		if (result != VK_SUCCESS && result != VK_NOT_READY)
+		{
+			return;
+		}
+
+		latestResults.clear();
+		for (uint32_t zone = 0; zone < names.size(); ++zone)
+		{
+			const uint64_t* begin = &readbackScratch[zone * 4];
+			const uint64_t* end = &readbackScratch[zone * 4 + 2];
+			if (begin[1] == 0 || end[1] == 0) // not available, e.g. a zone that was never ended
+			{
+				continue;
+			}
+
+			const uint64_t ticks = (end[0] - begin[0]) & timestampMask;
+			latestResults.push_back({ names[zone], ticks * nanosecondsPerTick / 1e6 });
+		}
+		++completedFrameCount;
+	}
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <vector>
+#include <deque>
+
+// A fixed set of worker threads that runs batches of jobs.
+// Every job is told the index of the worker running it, so it can use
+// per-worker resources (like command pools) without any locking.
+class JobSystem
+{
+private:
+	using Job = std::function<void(size_t workerIndex)>;
+
+	std::vector<std::thread> workers;
+	std::deque<Job> queue;
+	std::mutex queueMutex;
+	std::condition_variable workAvailable;
+	bool stopping = false;
+
+public:
+	void start(size_t workerCount)
+	{
+		stopping = false;
+		workers.reserve(workerCount);
+		for (size_t i = 0; i < workerCount; ++i)
+		{
+			workers.emplace_back(&JobSystem::workerLoop, this, i);
+		}
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		workAvailable.notify_all();
+
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+		workers.clear();
+	}
+
+	// the number of distinct worker indices jobs can be given
+	size_t getWorkerCount() const
+	{
+		return workers.empty() ? 1 : workers.size(); // without workers jobs run on the calling thread as worker 0
+	}
+
+	// Runs job(jobIndex, workerIndex) for every jobIndex in [0, jobCount) and blocks until all of them finished.
+	// The first exception thrown by a job is rethrown here. Must not be called from inside a job.
+	void parallelFor(size_t jobCount, const std::function<void(size_t jobIndex, size_t workerIndex)>& job)
+	{
+		if (workers.empty())
+		{
+			for (size_t i = 0; i < jobCount; ++i)
+			{
+				job(i, 0);
+			}
+			return;
+		}
+
+		struct Batch
+		{
+			std::mutex mutex;
+			std::condition_variable finished;
+			size_t remaining;
+			std::exception_ptr error;
+		} batch;
+		batch.remaining = jobCount;
+
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			for (size_t i = 0; i < jobCount; ++i)
+			{
+				queue.emplace_back([&batch, &job, i](size_t workerIndex) {
+					std::exception_ptr error;
+					try
+					{
+						job(i, workerIndex);
+					}
+					catch (...)
+					{
+						error = std::current_exception();
+					}
+
+					std::lock_guard<std::mutex> lock(batch.mutex);
+					if (error && !batch.error)
+					{
+						batch.error = error;
+					}
+					if (--batch.remaining == 0)
+					{
+						batch.finished.notify_one();
+					}
+				});
+			}
+		}
+		workAvailable.notify_all();
+
+		std::unique_lock<std::mutex> lock(batch.mutex);
+		batch.finished.wait(lock, [&batch] { return batch.remaining == 0; });
+
+		if (batch.error)
+		{
+			std::rethrow_exception(batch.error);
+		}
+	}
+
+private:
+	void workerLoop(size_t workerIndex)
+	{
+		while (true)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				workAvailable.wait(lock, [this] { return stopping || !queue.empty(); });
+				if (queue.empty()) // stopping and nothing left to do
+				{
+					return;
+				}
+				job = std::move(queue.front());
+				queue.pop_front();
+			}
+			job(workerIndex);
+		}
+	}
+};
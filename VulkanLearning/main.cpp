@@ -15,6 +15,42 @@
 #include <fstream>
 #include <string>
 #include <cerrno>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <cctype>
+#include <climits>
+#include <bit>
+
+#include "jobSystem.h"
+#include "gpuProfiler.h"
+#include "appOptions.h"
+#include "benchmark.h"
+#include "memoryAllocator.h"
+#include "uploadEngine.h"
+#include "virtualTexture.h"
+#include "mesh.h"
+#include "meshlets.h"
+#include "shadingRate.h"
+#include "dynamicResolution.h"
+#include "pipelineHotReloader.h"
+#include "shaderArchive.h"
+#include "specialization.h"
+#include "startupGraph.h"
+#include "deviceGroup.h"
+#include "framePacer.h"
+#include "renderGraph.h"
+#include "bindlessDescriptors.h"
+#include "frameConstants.h"
+#include "validationLog.h"
+#include "offscreenReadback.h"
+#include "timelineSemaphore.h"
+#include "tripleBuffer.h"
 
 #ifdef NDEBUG
 #	define IS_DEBUG_BUILD false
@@ -24,7 +60,14 @@
 
 #define ARRAY_SIZE(x) (sizeof(x)/sizeof(0[x]))
 
-std::string readFile(const char* const filename)
+using Clock = std::chrono::steady_clock;
+
+double millisecondsBetween(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+std::optional<std::string> tryReadFile(const char* const filename)
 {
 	std::ifstream in(filename, std::ios::in | std::ios::binary);
 	if (in)
@@ -37,7 +80,32 @@ std::string readFile(const char* const filename)
 		in.close();
 		return(contents);
 	}
-	throw std::runtime_error("failed to open file (error code " + std::to_string(errno) + ")");
+	return std::nullopt;
+}
+
+// Writes to a temporary file first and then renames it over the destination,
+// so a crash mid-write never leaves a truncated file behind
+void writeFileAtomically(const char* const filename, const void* const data, size_t size)
+{
+	const std::filesystem::path path = filename;
+	std::filesystem::path temporaryPath = path;
+	temporaryPath += ".tmp";
+
+	{
+		std::ofstream out(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			throw std::runtime_error("failed to open file for writing (error code " + std::to_string(errno) + ")");
+		}
+		out.write(static_cast<const char*>(data), size);
+		out.flush();
+		if (!out)
+		{
+			throw std::runtime_error("failed to write file (error code " + std::to_string(errno) + ")");
+		}
+	}
+
+	std::filesystem::rename(temporaryPath, path);
 }
 
 class VulkanApplication
@@ -68,7 +136,8 @@ private: //static
 		void* pUserData
 	) 
 	{
-		std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+		auto app = static_cast<HelloTriangleApp*>(pUserData);
+		app->validationLog.post(messageSeverity, messageType, *pCallbackData);
 
 		if (messageSeverity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
 		{
@@ -78,6 +147,18 @@ private: //static
 		return VK_FALSE;
 	}
 
+	static void framebufferResizeCallback(GLFWwindow* window, int width, int height)
+	{
+		auto app = static_cast<HelloTriangleApp*>(glfwGetWindowUserPointer(window));
+		app->framebufferResized = true;
+	}
+
+	static void scrollCallback(GLFWwindow* window, double xOffset, double yOffset)
+	{
+		auto app = static_cast<HelloTriangleApp*>(glfwGetWindowUserPointer(window));
+		app->viewZoom = std::clamp(app->viewZoom * static_cast<float>(std::pow(VIEW_ZOOM_STEP, yOffset)), MIN_VIEW_ZOOM, MAX_VIEW_ZOOM);
+	}
+
 	struct QueueFamilyIndices
 	{
 		std::optional<uint32_t> graphicsFamily;
@@ -88,7 +169,14 @@ private: //static
 	};
 
 	static inline const std::vector<const char*> deviceExtensions = {
-		VK_KHR_SWAPCHAIN_EXTENSION_NAME
+		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+		VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
+	};
+
+	// enabled when supported, the app falls back to core functionality otherwise
+	static inline const std::vector<const char*> optionalDeviceExtensions = {
+		VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,
+		VK_EXT_MEMORY_BUDGET_EXTENSION_NAME
 	};
 
 	struct SwapChainSupportDetails 
@@ -98,37 +186,281 @@ private: //static
 		std::vector<VkPresentModeKHR> presentModes;
 	};
 
-	static constexpr inline const char* const VERTEX_SHADER_PATH = "vert.spv";
-	static constexpr inline const char* const FRAGMENT_SHADER_PATH = "frag.spv";
+	static constexpr inline const char* const SHADER_ARCHIVE_PATH = "shaders.pack"; // written by packShaders.ps1
+	static constexpr inline const char* const VERTEX_SHADER_NAME = "vert.spv";
+	static constexpr inline const char* const FRAGMENT_SHADER_NAME = "frag.spv";
+	static constexpr inline const char* const CULL_OBJECTS_SHADER_NAME = "cullObjects.spv";
+	static constexpr inline const char* const TASK_SHADER_NAME = "task.spv";
+	static constexpr inline const char* const MESH_SHADER_NAME = "mesh.spv";
+	static constexpr inline const char* const SHADING_RATE_SHADER_NAME = "shadingRate.spv";
+	static constexpr inline const char* const PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+	static constexpr size_t MAX_RECORDING_THREADS = 8;
+	static constexpr auto GPU_TIMING_REPORT_INTERVAL = std::chrono::seconds(1);
+	static constexpr uint32_t COMPUTE_WORKGROUP_SIZE = 64; // local_size_x of the compute shaders, set as a specialization constant
+	static constexpr uint32_t TASK_WORKGROUP_SIZE = 32; // local_size_x of meshlet.task, which culls one task per invocation
+	static constexpr VkShaderStageFlags MESHLET_PUSH_CONSTANT_STAGES = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	static constexpr uint32_t SHADING_RATE_WORKGROUP_SIZE = 8; // local_size_x and y of shadingRate.comp
+	static constexpr float HALF_RATE_CONTRAST = 0.1f; // luminance contrast of a tile below which the next frame shades it in 2x2 fragments
+	static constexpr float QUARTER_RATE_CONTRAST = 0.025f; // and in 4x4 fragments
+	static constexpr float MESH_INSTANCE_RADIUS = 0.71f; // bounding sphere of the scene mesh at scale 1
+	static constexpr VkDeviceSize UNIFORM_BLOCK_SIZE = 256; // the largest struct pushed to the uniform ring
+	static constexpr VkDeviceSize UNIFORM_BYTES_PER_FRAME = 64 * 1024;
+	static constexpr float VIEW_ZOOM_STEP = 1.1f; // per notch of the mouse wheel
+	static constexpr float MIN_VIEW_ZOOM = 0.1f;
+	static constexpr float MAX_VIEW_ZOOM = 10;
+	static constexpr VkFormat OFFSCREEN_FORMAT = VK_FORMAT_R8G8B8A8_UNORM; // what FrameFileWriter expects
+	static constexpr uint32_t OFFSCREEN_BYTES_PER_PIXEL = 4;
+
+	// Secondary command buffers are allocated on demand and reused every frame.
+	struct WorkerCommandPool
+	{
+		VkCommandPool pool;
+		std::vector<VkCommandBuffer> secondaries;
+		size_t usedSecondaryCount = 0;
+	};
+
+	// Everything needed to record one frame in flight. Each pool is only ever used by one thread.
+	struct FrameCommandBuffers
+	{
+		VkCommandPool primaryPool;
+		VkCommandBuffer primary;
+		std::vector<WorkerCommandPool> workerPools; // indexed by job system worker
+	};
+
+	// Matches SceneObject in cullObjects.comp
+	struct SceneObject
+	{
+		float center[2];
+		float radius;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+		uint32_t padding;
+	};
+
+	// Matches the push constants of cullObjects.comp
+	struct CullPushConstants
+	{
+		float frustumPlanes[6][4];
+		uint32_t objectCount;
+		uint32_t indexCount;
+	};
+
+	// Matches the push constants of shadingRate.comp
+	struct ShadingRatePushConstants
+	{
+		uint32_t texelSize[2];
+		float halfRateContrast;
+		float quarterRateContrast;
+	};
+
+	// Matches the push constants of fragment.frag: slots in the bindless descriptor arrays
+	struct ScenePushConstants
+	{
+		uint32_t virtualTexture;
+		uint32_t residency;
+		uint32_t feedback;
+	};
+
+	// Matches the push constants of meshlet.task and meshlet.mesh, which start with those of fragment.frag.
+	// A task is one meshlet of one instance, they are numbered instance after instance.
+	struct MeshletPushConstants
+	{
+		ScenePushConstants scene;
+		uint32_t vertices; // slots of the storage buffers of the scene's MeshletMesh and of the instance buffer
+		uint32_t meshlets;
+		uint32_t meshletVertices;
+		uint32_t meshletTriangles;
+		uint32_t instances;
+		uint32_t firstTask; // of the draw
+		uint32_t taskCount;
+		uint32_t meshletCount; // of the mesh
+	};
+
+	// Matches ViewConstants in vertex.vert: maps the scene to clip space
+	struct ViewConstants
+	{
+		float scale[2];
+		float offset[2];
+	};
+
+	// Matches the specialization constants of cullObjects.comp: the workgroup size and whether visible draws are compacted
+	using CullSpecialization = Specialization<SpecializationConstant<0, uint32_t>, SpecializationConstant<1, bool>>;
+
+	// Compute work of one frame in flight. It runs on the compute queue and the frame's graphics submit waits for it.
+	struct ComputeFrame
+	{
+		VkCommandPool pool;
+		VkCommandBuffer commandBuffer;
+		std::vector<VkSemaphore> finished; // indexed by device index, one per gpu of a device group, empty with timeline semaphores
+		uint64_t finishedValue = 0; // signaled on the compute timeline instead
+		AllocatedBuffer objects; // written by the CPU
+		AllocatedBuffer drawCommands; // written by the culling pass, one per object
+		AllocatedBuffer drawCount; // visible objects, written by the culling pass if it compacts
+		VkDescriptorSet descriptorSet;
+	};
+
+	// What the main thread simulated for a frame, handed to the render thread, see renderThreadLoop
+	struct FrameState
+	{
+		Clock::time_point inputSampled;
+		float viewZoom = 1;
+		int framebufferWidth = 0; // 0 while minimized
+		int framebufferHeight = 0;
+		bool quit = false; // the last state, the render thread stops instead of rendering it
+	};
+
+	// CPU time spent in the parts of drawFrame() that can block
+	struct FrameTimings
+	{
+		bool presented = false; // false if the frame was skipped to recreate the swapchain
+		double acquireWaitMilliseconds = 0; // waiting for the frame's fence, the next image and that image's previous frame
+		double submitMilliseconds = 0;
+		double presentMilliseconds = 0;
+	};
 private:
-	GLFWwindow* window;
+	AppOptions options;
+	GLFWwindow* window = nullptr; // stays null when rendering offscreen
 	VkInstance instance;
 	VkDebugUtilsMessengerEXT debugMessenger;
-	VkSurfaceKHR surface;
+	ValidationLogSink validationLog;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
 	VkPhysicalDevice physicalDevice;
+	VkPhysicalDeviceProperties physicalDeviceProperties;
+	VkPhysicalDeviceFeatures physicalDeviceFeatures;
+	VkPhysicalDeviceFeatures enabledFeatures{};
+	std::vector<const char*> enabledDeviceExtensions;
+	bool drawIndirectCountEnabled = false;
+	bool memoryBudgetEnabled = false;
+	uint32_t framesInFlight = 2; // how many frames the CPU may record ahead of the GPU, see chooseFramesInFlight
+	bool meshShadingEnabled = false; // the scene is drawn by task and mesh shaders instead of vertex input
+	uint32_t maxTaskWorkGroupCount = 0; // per draw
+	FragmentShadingRateSupport shadingRateSupport;
+	bool shadingRateEnabled = false; // every draw sets its fragment size, see setFragmentShadingRate
+	bool adaptiveShadingEnabled = false; // the main pass reads a shading rate attachment the previous frame wrote
+	bool dynamicResolutionEnabled = false; // the scene is rendered into sceneColorResource and upscaled
 	QueueFamilyIndices queueFamilyIndices;
+	DeviceGroup deviceGroup; // inactive unless --device-group found linked gpus
+	FramePacer framePacer;
 	VkDevice device;
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
-	VkSwapchainKHR swapChain;
+	VkQueue transferQueue;
+	VkQueue computeQueue;
+	VkQueue sparseQueue = VK_NULL_HANDLE; // only if the device has a sparse binding family
+	MemoryAllocator memoryAllocator;
+	UploadEngine uploadEngine;
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
 	std::vector<VkImage> swapChainImages;
 	std::vector<VkImageView> swapChainImageViews;
+	std::vector<AllocatedImage> offscreenTargets; // stand in for the swapchain images when rendering offscreen, one per frame in flight
+	ReadbackRing offscreenReadback;
+	FrameFileWriter offscreenFileWriter;
+	uint64_t offscreenFrameNumber = 0; // of the next frame to submit
+	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	RenderGraph renderGraph; // rebuilt with the swapchain
+	RenderGraph::ResourceId swapChainImageResource = 0;
+	std::optional<RenderGraph::ResourceId> msaaColorResource; // rendered to and resolved into the swapchain image
+	std::optional<RenderGraph::ResourceId> shadingRateResource; // only with adaptive shading
+	std::optional<RenderGraph::ResourceId> sceneColorResource; // only with dynamic resolution, at the swapchain's extent
+	DynamicResolution dynamicResolution;
+	uint64_t lastResolutionUpdate = 0; // the gpu profiler's completed frame count the scale was last updated at
+	VkExtent2D renderExtent{}; // of the frame being recorded, the top left of the scene color image with dynamic resolution
+	uint32_t recordingImageIndex = 0; // what the passes of the frame being recorded render to
+	std::vector<VkCommandBuffer> recordingSceneParts;
 	VkRenderPass renderPass;
+	VkPipelineCache pipelineCache;
+	ShaderArchive shaderArchive; // only mapped while the startup pipelines are created
+	BindlessDescriptors bindlessDescriptors;
+	UniformRing uniformRing;
+	uint32_t viewConstantsOffset = 0; // of the current frame in uniformRing
 	VkPipelineLayout pipelineLayout;
 	VkPipeline graphicsPipeline;
+	VkDescriptorSetLayout cullSetLayout;
+	VkPipelineLayout cullPipelineLayout;
+	VkPipeline cullPipeline;
+	AdaptiveShadingRate adaptiveShadingRate; // only with adaptive shading, like the pipeline below
+	VkPipelineLayout shadingRatePipelineLayout = VK_NULL_HANDLE;
+	VkPipeline shadingRatePipeline = VK_NULL_HANDLE;
+	PipelineHotReloader graphicsPipelineReloader;
+	PipelineHotReloader cullPipelineReloader;
+	VkDescriptorPool descriptorPool;
+	std::vector<ComputeFrame> computeFrames; // one per frame in flight
+	VirtualTexture virtualTexture;
+	std::vector<ScenePushConstants> scenePushConstants; // one per frame in flight
 	std::vector<VkFramebuffer> framebuffers;
-	VkCommandPool commandPool;
-	std::vector<VkCommandBuffer> commandBuffers;
-	VkSemaphore imageAvailbleSemaphore;
-	VkSemaphore renderFinishedSemaphore;
+	JobSystem jobSystem;
+	std::vector<FrameCommandBuffers> frameCommandBuffers; // one per frame in flight
+	Mesh sceneMesh; // only with vertex input
+	MeshletMesh sceneMeshlets; // only with mesh shading
+	MeshletPushConstants meshletPushConstants{}; // the slots of the scene, the rest is filled per draw
+	std::vector<MeshInstance> sceneInstances;
+	std::vector<SceneObject> sceneObjects;
+	AllocatedBuffer instanceBuffer; // holds the most instances any scene of this run has
+	std::vector<VkSemaphore> imageAvailableSemaphores; // one per frame in flight
+	std::vector<VkFence> acquireFences; // one per frame in flight when splitting frames, see acquireNextImage
+	std::vector<VkSemaphore> renderFinishedSemaphores; // one per swapchain image and gpu, see getRenderFinishedSemaphore
+	std::vector<VkFence> inFlightFences; // one per frame in flight, unless the frames signal the graphics timeline
+	std::vector<uint64_t> imageFrameValues; // the number of the frame that last rendered to each swapchain image
+	size_t currentFrame = 0;
+
+	// Frames are numbered from 1 in submission order. With timeline semaphores a frame signals its number on the
+	// graphics timeline, and the compute and upload submits signal timelines of their own that the frame waits for.
+	// Without them every frame in flight has a fence and binary semaphores connect the queues.
+	bool timelineSyncEnabled = false;
+	TimelineSemaphore graphicsTimeline;
+	TimelineSemaphore computeTimeline;
+	TimelineSemaphore transferTimeline;
+	std::vector<uint64_t> frameValues; // the number of the frame last recorded in each frame in flight, 0 before the first
+	uint64_t currentFrameValue = 0; // of the frame being recorded, or of the latest one between frames
+	uint64_t completedFrameValue = 0; // every frame up to this one has finished on the GPU
+	RetirementQueue frameRetirement; // objects replaced while frames were in flight, by the last frame using them
+	std::atomic<bool> framebufferResized{ false }; // set on the main thread, taken by the frame that recreates the swapchain
+	float viewZoom = 1; // changed with the mouse wheel, only touched by the main thread
+	FrameState frameState; // the state the current frame renders
+	TripleBuffer<FrameState> frameStates; // from the main thread to the render thread
+	TripleBuffer<std::string> windowTitles; // from the render thread to the main thread, glfw only sets them on the main thread
+	std::thread renderThread;
+	std::atomic<bool> renderThreadFinished{ false };
+	std::exception_ptr renderThreadError;
+	bool renderingOnRenderThread = false;
+	FrameTimings frameTimings;
+	GpuProfiler gpuProfiler;
+	Clock::time_point lastGpuTimingReport;
+	double reportedLatencySum = 0; // input to present latencies since the title was last updated
+	uint32_t reportedLatencyCount = 0;
+	StartupGraph startupGraph;
+	Clock::time_point runStart;
+	bool firstFramePresented = false;
 public:
+	explicit HelloTriangleApp(const AppOptions& options) :
+		options{ options }
+	{
+	}
+
 	virtual void run() override
 	{
-		initWindow();
+		runStart = Clock::now();
+		if (!isOffscreen())
+		{
+			initWindow();
+		}
+		startJobSystem();
+		if (enableValidationLayers)
+		{
+			validationLog.start(getValidationLogFilter());
+		}
 		initVulkan();
-		mainLoop();
+		if (options.benchmark.enabled)
+		{
+			benchmarkLoop();
+		}
+		else
+		{
+			mainLoop();
+		}
 		cleanup();
 	}
 
@@ -138,32 +470,103 @@ private:
 		glfwInit();
 
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 		window = glfwCreateWindow(WIDTH, HEIGHT, TITLE, nullptr, nullptr);
+		glfwSetWindowUserPointer(window, this);
+		glfwSetFramebufferSizeCallback(window, &HelloTriangleApp::framebufferResizeCallback);
+		glfwSetScrollCallback(window, &HelloTriangleApp::scrollCallback);
+	}
+
+	void startJobSystem()
+	{
+		// leave one core for the main thread, which submits while the workers record
+		const unsigned hardwareThreads = std::thread::hardware_concurrency();
+		const size_t workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+		jobSystem.start(std::min(workerCount, MAX_RECORDING_THREADS));
 	}
 
+	bool isOffscreen() const
+	{
+		return options.offscreen.enabled;
+	}
+
+	// the window was closed, rendering offscreen never stops this way
+	bool shouldClose() const
+	{
+		return window != nullptr && glfwWindowShouldClose(window);
+	}
+
+	// Independent steps run concurrently once the device exists, each line lists the steps it has to wait for.
+	// Anything touching the window or the upload engine's queue stays on the main thread.
 	void initVulkan()
 	{
-		loadGlobalFunctions();
-		createInstance();
-		loadInstanceFunctions();
-		setupDebugMessenger();
-		createSurface();
-		pickPhysicalDevice();
-		cacheQueueFamilyIndices();
-		createLogicalDevice();
-		retrieveQueueHandles();
-		loadDeviceFunctions();
-		createSwapChain();
-		retrieveSwapChainImageHandles();
-		createSwapChainImageViews();
-		createRenderPass();
-		createGraphicsPipeline();
-		createFramebuffers();
-		createCommandPool();
-		createCommandBuffers();
-		createSemaphores();
+		using Affinity = StartupGraph::Affinity;
+		StartupGraph& graph = startupGraph;
+
+		const auto shaders = graph.add("openShaderArchive", {}, [this] { shaderArchive.open(SHADER_ARCHIVE_PATH); });
+		const auto globals = graph.add("loadGlobalFunctions", {}, [this] { loadGlobalFunctions(); });
+		const auto instance = graph.add("createInstance", { globals }, [this] { createInstance(); loadInstanceFunctions(); });
+		graph.add("setupDebugMessenger", { instance }, [this] { setupDebugMessenger(); });
+		const auto surface = graph.add("createSurface", { instance }, [this] { createSurface(); }, Affinity::MainThread);
+		const auto physical = graph.add("pickPhysicalDevice", { surface }, [this] {
+			pickPhysicalDevice();
+			cachePhysicalDeviceProperties();
+			cacheQueueFamilyIndices();
+			chooseMsaaSamples();
+			chooseDynamicResolution();
+			chooseFramesInFlight();
+		});
+		const auto logical = graph.add("createLogicalDevice", { physical }, [this] {
+			createLogicalDevice();
+			retrieveQueueHandles();
+			loadDeviceFunctions();
+			configureDeviceGroupPresentation();
+			createTimelines();
+		});
+
+		const auto allocator = graph.add("createMemoryAllocator", { logical }, [this] { createMemoryAllocator(); });
+		const auto uploads = graph.add("createUploadEngine", { allocator }, [this] { createUploadEngine(); }, Affinity::MainThread);
+		const auto cache = graph.add("createPipelineCache", { logical }, [this] { createPipelineCache(); });
+		const auto swapchain = isOffscreen()
+			? graph.add("createOffscreenTargets", { allocator }, [this] { createOffscreenTargets(); })
+			: graph.add("createSwapChain", { logical }, [this] {
+				createSwapChain();
+				retrieveSwapChainImageHandles();
+			}, Affinity::MainThread);
+		const auto imageViews = graph.add("createSwapChainImageViews", { swapchain }, [this] { createSwapChainImageViews(); });
+		const auto adaptiveShading = graph.add("createAdaptiveShadingRate", { logical }, [this] { createAdaptiveShadingRate(); });
+		const auto renderPass = graph.add("createRenderPass", { swapchain, adaptiveShading }, [this] { createRenderPass(); });
+		const auto frameGraph = graph.add("buildRenderGraph", { allocator, swapchain }, [this] {
+			buildRenderGraph();
+			printRenderGraphStats();
+		});
+		const auto shadingRateTargets = graph.add("createShadingRateTargets", { adaptiveShading, uploads, imageViews, frameGraph }, [this] { createShadingRateTargets(); }, Affinity::MainThread);
+		const auto bindless = graph.add("createBindlessDescriptors", { logical }, [this] { createBindlessDescriptors(); });
+		const auto uniforms = graph.add("createUniformRing", { allocator }, [this] { createUniformRing(); });
+		const auto graphicsPipeline = graph.add("createGraphicsPipeline", { shaders, cache, renderPass, bindless, uniforms }, [this] { createGraphicsPipeline(); });
+		const auto cullPipeline = graph.add("createCullPipeline", { shaders, cache }, [this] { createCullPipeline(); });
+		const auto shadingRatePipeline = graph.add("createShadingRatePipeline", { shaders, cache, adaptiveShading }, [this] { createShadingRatePipeline(); });
+		graph.add("closeShaderArchive", { graphicsPipeline, cullPipeline, shadingRatePipeline }, [this] { shaderArchive.close(); });
+		graph.add("createFramebuffers", { imageViews, renderPass, frameGraph, shadingRateTargets }, [this] { createFramebuffers(); });
+		graph.add("createCommandPools", { logical }, [this] {
+			createCommandPools();
+			allocateCommandBuffers();
+		});
+		graph.add("createFrameSyncObjects", { logical }, [this] { createFrameSyncObjects(); });
+		graph.add("createSwapChainImageSyncObjects", { swapchain }, [this] { createSwapChainImageSyncObjects(); });
+
+		// the descriptor pool isn't thread safe, so the sets are allocated one step after the other
+		const auto scene = graph.add("createScene", { uploads }, [this] { createScene(); }, Affinity::MainThread);
+		const auto descriptorPool = graph.add("createDescriptorPool", { logical }, [this] { createDescriptorPool(); });
+		graph.add("createComputeFrames", { allocator, cullPipeline, descriptorPool }, [this] { createComputeFrames(); });
+		const auto virtualTexture = graph.add("createVirtualTexture", { allocator }, [this] { createVirtualTexture(); }, Affinity::MainThread);
+		graph.add("addSceneDescriptors", { bindless, virtualTexture, scene }, [this] { addSceneDescriptors(); });
+		graph.add("createGpuProfiler", { logical }, [this] { createGpuProfiler(); });
+		graph.add("startPipelineHotReload", { graphicsPipeline, cullPipeline }, [this] { startPipelineHotReload(); });
+
+		graph.run(jobSystem);
+		std::cout << "startup took " << std::fixed << std::setprecision(1) << graph.getTotalMilliseconds() << " ms\n" << std::defaultfloat;
 	}
 
 	void loadGlobalFunctions()
@@ -232,10 +635,13 @@ private:
 
 	std::vector<const char*> getRequiredExtensions()
 	{
-		uint32_t glfwExtensionCount = 0;
-		const char** const glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-		std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		std::vector<const char*> extensions;
+		if (!isOffscreen()) // the surface extensions
+		{
+			uint32_t glfwExtensionCount = 0;
+			const char** const glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
 
 		if (enableValidationLayers)
 		{
@@ -324,6 +730,10 @@ private:
 
 	void createSurface()
 	{
+		if (isOffscreen())
+		{
+			return;
+		}
 		if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS)
 		{
 			throw std::runtime_error("cannot create window surface");
@@ -345,24 +755,77 @@ private:
 	{
 		VkDebugUtilsMessengerCreateInfoEXT createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-		createInfo.messageSeverity =
-			VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT
-			| VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
-			| VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-		createInfo.messageType =
-			VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
-			| VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
-			| VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+		const ValidationLogFilter filter = getValidationLogFilter();
+		createInfo.messageSeverity = filter.severities;
+		createInfo.messageType = filter.types;
 		createInfo.pfnUserCallback = &HelloTriangleApp::debugCallback;
 		createInfo.pUserData = static_cast<void*>(this);
 
 		return createInfo;
 	}
 
+	// the given severity and every more severe one, errors are always kept
+	ValidationLogFilter getValidationLogFilter() const
+	{
+		const ValidationOptions& validation = options.validation;
+
+		ValidationLogFilter filter;
+		filter.severities = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+		if (validation.minimumSeverity <= ValidationSeverity::Warning)
+		{
+			filter.severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+		}
+		if (validation.minimumSeverity <= ValidationSeverity::Info)
+		{
+			filter.severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT;
+		}
+		if (validation.minimumSeverity <= ValidationSeverity::Verbose)
+		{
+			filter.severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+		}
+
+		filter.types = 0;
+		if (validation.general)
+		{
+			filter.types |= VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT;
+		}
+		if (validation.validation)
+		{
+			filter.types |= VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT;
+		}
+		if (validation.performance)
+		{
+			filter.types |= VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+		}
+		return filter;
+	}
+
 	void pickPhysicalDevice()
 	{
 		auto physicalDevices = findPhysicalDevices();
-		physicalDevice = pickPhysicalDeviceWithHighestScore(physicalDevices);
+		if (options.device.gpu.empty())
+		{
+			auto best = findPhysicalDeviceWithHighestScore(physicalDevices);
+			if (!best)
+			{
+				throw std::runtime_error("no suitable gpu found");
+			}
+			physicalDevice = *best;
+		}
+		else
+		{
+			physicalDevice = pickRequestedPhysicalDevice(physicalDevices, options.device.gpu);
+		}
+		std::cout << "rendering on " << getPhysicalDeviceName(physicalDevice) << '\n';
+
+		if (options.device.groupMode != DeviceGroupMode::Off)
+		{
+			deviceGroup.select(options.device.groupMode, DeviceGroup::findLinkedDevices(instance, physicalDevice));
+			if (!deviceGroup.isActive())
+			{
+				std::cerr << "the gpu isn't linked with other gpus, --device-group is ignored\n";
+			}
+		}
 	}
 
 	std::vector<VkPhysicalDevice> findPhysicalDevices()
@@ -381,62 +844,178 @@ private:
 		return physicalDevices;
 	}
 
-	static constexpr int DEVICE_NON_SUITABLE_SCORE = 0;
-	VkPhysicalDevice pickPhysicalDeviceWithHighestScore(const std::vector<VkPhysicalDevice>& physicalDevices)
+	// The device type dominates the score, as the "device local" heap of an integrated gpu is often just system memory.
+	// Between devices of a type more device local memory wins, then dedicated compute and transfer families,
+	// which let culling and uploads run without competing with rendering, then the optional features the renderer uses.
+	static constexpr int64_t DEVICE_NON_SUITABLE_SCORE = 0;
+	static constexpr int64_t DEVICE_TYPE_SCORE = 1000000;
+	static constexpr int64_t DEVICE_LOCAL_GIGABYTE_SCORE = 100;
+	static constexpr VkDeviceSize MAX_SCORED_DEVICE_LOCAL_MEMORY = 64ull * 1024 * 1024 * 1024;
+	static constexpr int64_t DEDICATED_QUEUE_FAMILY_SCORE = 500;
+	static constexpr int64_t OPTIONAL_FEATURE_SCORE = 250;
+
+	std::optional<VkPhysicalDevice> findPhysicalDeviceWithHighestScore(const std::vector<VkPhysicalDevice>& physicalDevices)
+	{
+		int64_t highestScore = DEVICE_NON_SUITABLE_SCORE;
+		size_t bestDeviceIndex = 0;
+		for (size_t i = 0; i < physicalDevices.size(); ++i)
+		{
+			const int64_t score = calculatePhysicalDeviceScore(physicalDevices[i]);
+			if (score > highestScore)
+			{
+				highestScore = score;
+				bestDeviceIndex = i;
+			}
+		}
+
+		if (highestScore == DEVICE_NON_SUITABLE_SCORE)
+		{
+			return std::nullopt;
+		}
+		return physicalDevices[bestDeviceIndex];
+	}
+
+	// selection is an index into physicalDevices or a case insensitive part of a device name, the best scoring match wins
+	VkPhysicalDevice pickRequestedPhysicalDevice(const std::vector<VkPhysicalDevice>& physicalDevices, const std::string& selection)
 	{
-		int highest_score = DEVICE_NON_SUITABLE_SCORE;
-		int best_device_idx = 0;
-		for (int i = 0; i < physicalDevices.size(); ++i)
+		auto toLower = [](std::string text) {
+			std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			return text;
+		};
+
+		std::vector<VkPhysicalDevice> matches;
+		if (std::all_of(selection.begin(), selection.end(), [](unsigned char c) { return std::isdigit(c); }))
+		{
+			const unsigned long index = std::stoul(selection);
+			if (index >= physicalDevices.size())
+			{
+				throw std::runtime_error("there is no gpu " + selection + ", found " + std::to_string(physicalDevices.size()));
+			}
+			matches.push_back(physicalDevices[index]);
+		}
+		else
 		{
-			int score = calculatePhysicalDeviceScore(physicalDevices[i]);
-			if (score > highest_score)
+			for (VkPhysicalDevice candidate : physicalDevices)
 			{
-				highest_score = score;
-				best_device_idx = i;
+				if (toLower(getPhysicalDeviceName(candidate)).find(toLower(selection)) != std::string::npos)
+				{
+					matches.push_back(candidate);
+				}
 			}
 		}
 
-		if (highest_score == DEVICE_NON_SUITABLE_SCORE)
+		if (matches.empty())
 		{
-			throw std::runtime_error("no suitable gpu found");
+			throw std::runtime_error("no gpu name contains '" + selection + "'");
 		}
+		auto best = findPhysicalDeviceWithHighestScore(matches);
+		if (!best)
+		{
+			throw std::runtime_error("the requested gpu '" + selection + "' is not suitable");
+		}
+		return *best;
+	}
 
-		return physicalDevices[best_device_idx];
+	std::string getPhysicalDeviceName(VkPhysicalDevice device)
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(device, &properties);
+		return properties.deviceName;
 	}
 
-	int calculatePhysicalDeviceScore(VkPhysicalDevice device)
+	int64_t calculatePhysicalDeviceScore(VkPhysicalDevice device)
 	{
-		VkPhysicalDeviceProperties device_properties;
-		vkGetPhysicalDeviceProperties(device, &device_properties);
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(device, &properties);
 
-		VkPhysicalDeviceFeatures device_features;
-		vkGetPhysicalDeviceFeatures(device, &device_features);
+		VkPhysicalDeviceFeatures features;
+		vkGetPhysicalDeviceFeatures(device, &features);
 
-		auto score = DEVICE_NON_SUITABLE_SCORE;
-		
-		if (!isDeviceSuitable(device, device_properties, device_features))
+		if (!isDeviceSuitable(device, properties, features))
 		{
-			return score;
+			std::cout << "gpu " << properties.deviceName << ": not suitable\n";
+			return DEVICE_NON_SUITABLE_SCORE;
 		}
-		else
+
+		int64_t score = DEVICE_NON_SUITABLE_SCORE + 1;
+		score += getDeviceTypeRank(properties.deviceType) * DEVICE_TYPE_SCORE;
+
+		const VkDeviceSize deviceLocalMemory = std::min(getDeviceLocalMemorySize(device), MAX_SCORED_DEVICE_LOCAL_MEMORY);
+		score += static_cast<int64_t>(deviceLocalMemory / (1024 * 1024)) * DEVICE_LOCAL_GIGABYTE_SCORE / 1024;
+
+		const auto queueFamilies = getQueueFamilyProperties(device);
+		if (hasDedicatedQueueFamily(queueFamilies, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT))
+		{
+			score += DEDICATED_QUEUE_FAMILY_SCORE;
+		}
+		if (hasDedicatedQueueFamily(queueFamilies, VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+		{
+			score += DEDICATED_QUEUE_FAMILY_SCORE;
+		}
+
+		if (features.multiDrawIndirect)
+		{
+			score += OPTIONAL_FEATURE_SCORE;
+		}
+		if (features.sparseBinding && features.sparseResidencyImage2D)
+		{
+			score += OPTIONAL_FEATURE_SCORE;
+		}
+		if (checkExtensionSupport({ VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME }, getSupportedDeviceExtensions(device)))
+		{
+			score += OPTIONAL_FEATURE_SCORE;
+		}
+
+		std::cout << "gpu " << properties.deviceName << ": " << deviceLocalMemory / (1024 * 1024) << " MiB device local, score " << score << '\n';
+		return score;
+	}
+
+	static int64_t getDeviceTypeRank(VkPhysicalDeviceType type)
+	{
+		switch (type)
 		{
-			++score;
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+			return 3;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+			return 2;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+			return 1;
+		default: // a cpu or something unknown
+			return 0;
 		}
+	}
+
+	// the largest heap counts, the others are usually small windows into the same memory
+	static VkDeviceSize getDeviceLocalMemorySize(VkPhysicalDevice device)
+	{
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
 
-		if (device_properties.deviceType & VkPhysicalDeviceType::VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+		VkDeviceSize size = 0;
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
 		{
-			score += 1000;
+			if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+			{
+				size = std::max(size, memoryProperties.memoryHeaps[i].size);
+			}
 		}
+		return size;
+	}
 
-		return score; 
+	static bool hasDedicatedQueueFamily(const std::vector<VkQueueFamilyProperties>& queueFamilies, VkQueueFlags capability, VkQueueFlags excluded)
+	{
+		return std::any_of(queueFamilies.begin(), queueFamilies.end(), [&](const VkQueueFamilyProperties& family) {
+			return (family.queueFlags & capability) && !(family.queueFlags & excluded);
+		});
 	}
 
+	// Offscreen rendering needs neither presentation nor a swapchain.
 	bool isDeviceSuitable(VkPhysicalDevice device, const VkPhysicalDeviceProperties& properties, const VkPhysicalDeviceFeatures& features)
 	{
-		bool extensionsSupported = checkExtensionSupport(deviceExtensions, getSupportedDeviceExtensions(device));
+		bool extensionsSupported = checkExtensionSupport(getRequiredDeviceExtensions(), getSupportedDeviceExtensions(device));
 
-		bool swapChainAdequate = false;
-		if (extensionsSupported)
+		bool swapChainAdequate = isOffscreen();
+		if (extensionsSupported && !isOffscreen())
 		{
 			SwapChainSupportDetails details = querySwapChainSupport(device);
 			swapChainAdequate = !(details.formats.empty() || details.presentModes.empty());
@@ -444,9 +1023,23 @@ private:
 
 		auto queueFamilies = findQueueFamilies(device);
 		return queueFamilies.graphicsFamily.has_value()
-			&& queueFamilies.presentFamily.has_value()
+			&& (queueFamilies.presentFamily.has_value() || isOffscreen())
 			&& extensionsSupported
-			&& swapChainAdequate;
+			&& swapChainAdequate
+			&& BindlessDescriptors::isSupported(device)
+			&& features.drawIndirectFirstInstance // every object the culling pass draws starts at its own instance
+			&& features.fragmentStoresAndAtomics; // the fragment shader writes the virtual texture feedback
+	}
+
+	std::vector<const char*> getRequiredDeviceExtensions() const
+	{
+		std::vector<const char*> extensions = deviceExtensions;
+		if (isOffscreen())
+		{
+			extensions.erase(std::remove_if(extensions.begin(), extensions.end(),
+				[](const char* extension) { return std::strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0; }), extensions.end());
+		}
+		return extensions;
 	}
 
 	std::vector<VkExtensionProperties> getSupportedDeviceExtensions(VkPhysicalDevice device)
@@ -503,36 +1096,59 @@ private:
 		return presentModes;
 	}
 
-	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device)
+	static std::vector<VkQueueFamilyProperties> getQueueFamilyProperties(VkPhysicalDevice device)
 	{
 		uint32_t queueFamilyCount = 0;
 		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
 
 		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
 		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
-		
-		return {
+		return queueFamilies;
+	}
+
+	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device)
+	{
+		const auto queueFamilies = getQueueFamilyProperties(device);
+		QueueFamilyIndices indices{
 			findQueueFamilyWithCapability(queueFamilies, VkQueueFlagBits::VK_QUEUE_GRAPHICS_BIT),
-			findQueueFamilyWithCapability(queueFamilies, VkQueueFlagBits::VK_QUEUE_COMPUTE_BIT),
-			findQueueFamilyWithCapability(queueFamilies, VkQueueFlagBits::VK_QUEUE_TRANSFER_BIT),
-			findQueueFamilyWithCapability(queueFamilies, VkQueueFlagBits::VK_QUEUE_SPARSE_BINDING_BIT),
-			findPresentationQueueFamily(device, queueFamilies)
+			findQueueFamilyWithCapability(queueFamilies, VkQueueFlagBits::VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT),
+			findQueueFamilyWithCapability(queueFamilies, VkQueueFlagBits::VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT),
+			findQueueFamilyWithCapability(queueFamilies, VkQueueFlagBits::VK_QUEUE_SPARSE_BINDING_BIT, VK_QUEUE_GRAPHICS_BIT),
+			isOffscreen() ? std::nullopt : findPresentationQueueFamily(device, queueFamilies)
 		};
+
+		// graphics and compute families don't have to report the transfer bit, transfers are implied
+		if (!indices.transferFamily)
+		{
+			indices.transferFamily = indices.graphicsFamily;
+		}
+		if (!indices.computeFamily)
+		{
+			indices.computeFamily = indices.graphicsFamily;
+		}
+		return indices;
 	}
 
-	std::optional<uint32_t> findQueueFamilyWithCapability(const std::vector<VkQueueFamilyProperties>& queueFamilies, VkQueueFlagBits capability)
+	// Prefers the family with the fewest of the avoided capabilities, so work that could share the graphics family
+	// gets a dedicated one where there is one. Ties go to the first family.
+	std::optional<uint32_t> findQueueFamilyWithCapability(const std::vector<VkQueueFamilyProperties>& queueFamilies, VkQueueFlagBits capability,
+		VkQueueFlags avoided = 0)
 	{
 		std::optional<uint32_t> index;
+		int fewestAvoided = INT_MAX;
 
-		for (int i = 0; i < queueFamilies.size(); ++i)
+		for (uint32_t i = 0; i < queueFamilies.size(); ++i)
 		{
-			if (queueFamilies[i].queueFlags & capability)
+			if (!(queueFamilies[i].queueFlags & capability))
+			{
+				continue;
+			}
+
+			const int avoidedCount = std::popcount(queueFamilies[i].queueFlags & avoided);
+			if (avoidedCount < fewestAvoided)
 			{
 				index = i;
-				if ((queueFamilies[i].queueFlags ^ capability) == 0)
-				{
-					return index;
-				}
+				fewestAvoided = avoidedCount;
 			}
 		}
 
@@ -554,6 +1170,12 @@ private:
 		return std::nullopt;
 	}
 
+	void cachePhysicalDeviceProperties()
+	{
+		vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+		vkGetPhysicalDeviceFeatures(physicalDevice, &physicalDeviceFeatures);
+	}
+
 	void cacheQueueFamilyIndices()
 	{
 		queueFamilyIndices = findQueueFamilies(physicalDevice);
@@ -563,17 +1185,106 @@ private:
 	{
 		VkDeviceCreateInfo deviceCreateInfo{};
 		deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		deviceCreateInfo.pNext = deviceGroup.getDeviceCreateInfo();
 
 		float queuePriority = 1;
 		auto queueCreateInfos = createQueueCreateInfos(&queuePriority);
 		deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 		deviceCreateInfo.queueCreateInfoCount = queueCreateInfos.size();
 
-		VkPhysicalDeviceFeatures wantedFeatures{};
-		deviceCreateInfo.pEnabledFeatures = &wantedFeatures;
+		enabledFeatures = {};
+		enabledFeatures.multiDrawIndirect = physicalDeviceFeatures.multiDrawIndirect;
+		enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+		enabledFeatures.fragmentStoresAndAtomics = VK_TRUE;
+		if (queueFamilyIndices.sparseBindingFamily && !deviceGroup.isActive()) // a sparse bind would only bind the memory of one gpu
+		{
+			enabledFeatures.sparseBinding = physicalDeviceFeatures.sparseBinding;
+			enabledFeatures.sparseResidencyImage2D = physicalDeviceFeatures.sparseResidencyImage2D;
+		}
+		deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
+
+		enabledDeviceExtensions = getRequiredDeviceExtensions();
+		const auto supportedExtensions = getSupportedDeviceExtensions(physicalDevice);
+		for (const char* extension : optionalDeviceExtensions)
+		{
+			if (checkExtensionSupport({ extension }, supportedExtensions))
+			{
+				enabledDeviceExtensions.push_back(extension);
+			}
+		}
+
+		// present wait needs present ids, the frame pacer only uses them together
+		VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+		presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+		VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+		presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		presentIdFeatures.pNext = &presentWaitFeatures;
+		const bool presentWaitEnabled = !isOffscreen() && isPresentWaitSupported(supportedExtensions);
+		if (presentWaitEnabled)
+		{
+			enabledDeviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			enabledDeviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+			presentIdFeatures.presentId = VK_TRUE;
+			presentWaitFeatures.presentWait = VK_TRUE;
+			presentWaitFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+			deviceCreateInfo.pNext = &presentIdFeatures;
+		}
+
+		VkPhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures = BindlessDescriptors::getRequiredFeatures();
+		descriptorIndexingFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+		deviceCreateInfo.pNext = &descriptorIndexingFeatures;
+
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures = TimelineSemaphore::getRequiredFeatures();
+		timelineSyncEnabled = options.device.sync != SyncBackend::Fences && isTimelineSyncSupported(supportedExtensions);
+		if (options.device.sync == SyncBackend::Timeline && !timelineSyncEnabled)
+		{
+			throw std::runtime_error("the gpu doesn't support timeline semaphores");
+		}
+		if (timelineSyncEnabled)
+		{
+			enabledDeviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+			timelineSemaphoreFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+			deviceCreateInfo.pNext = &timelineSemaphoreFeatures;
+		}
+
+		VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+		meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+		meshShadingEnabled = options.render.geometry != GeometryPath::Vertex && isMeshShadingSupported(supportedExtensions);
+		if (options.render.geometry == GeometryPath::Mesh && !meshShadingEnabled)
+		{
+			throw std::runtime_error("the gpu doesn't support mesh shaders");
+		}
+		if (meshShadingEnabled)
+		{
+			// mesh shaders are SPIR-V 1.4, which Vulkan 1.1 only accepts with these extensions
+			enabledDeviceExtensions.push_back(VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME);
+			enabledDeviceExtensions.push_back(VK_KHR_SPIRV_1_4_EXTENSION_NAME);
+			enabledDeviceExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+			meshShaderFeatures.taskShader = VK_TRUE;
+			meshShaderFeatures.meshShader = VK_TRUE;
+			meshShaderFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+			deviceCreateInfo.pNext = &meshShaderFeatures;
+			maxTaskWorkGroupCount = getMaxTaskWorkGroupCount();
+		}
+
+		VkPhysicalDeviceFragmentShadingRateFeaturesKHR shadingRateFeatures{};
+		chooseShadingRate(supportedExtensions);
+		if (shadingRateEnabled)
+		{
+			// a shading rate attachment can only be given to a subpass through VkSubpassDescription2
+			enabledDeviceExtensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+			enabledDeviceExtensions.push_back(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+			shadingRateFeatures = FragmentShadingRateSupport::getRequiredFeatures(adaptiveShadingEnabled);
+			shadingRateFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+			deviceCreateInfo.pNext = &shadingRateFeatures;
+		}
+		if (adaptiveShadingEnabled)
+		{
+			enabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE; // r8ui, the format of the attachment
+		}
 
-		deviceCreateInfo.enabledExtensionCount = deviceExtensions.size();
-		deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+		deviceCreateInfo.enabledExtensionCount = enabledDeviceExtensions.size();
+		deviceCreateInfo.ppEnabledExtensionNames = enabledDeviceExtensions.data();
 
 		if (enableValidationLayers)
 		{
@@ -589,70 +1300,325 @@ private:
 		{
 			throw std::runtime_error("failed to create logical device");
 		}
-	}
-
-	std::vector<VkDeviceQueueCreateInfo> createQueueCreateInfos(const float* const queuePriority)
-	{
-		std::unordered_set<uint32_t> uniqueQueueFamilyIndices{
-			queueFamilyIndices.graphicsFamily.value(),
-			queueFamilyIndices.presentFamily.value()
-		};
-
-		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-		queueCreateInfos.reserve(uniqueQueueFamilyIndices.size());
 
-		for (const auto& queueFamilyIndex : uniqueQueueFamilyIndices)
+		// counts above one draw need multiDrawIndirect, just like vkCmdDrawIndexedIndirect with several draws
+		drawIndirectCountEnabled = enabledFeatures.multiDrawIndirect && std::any_of(enabledDeviceExtensions.begin(), enabledDeviceExtensions.end(),
+			[](const char* extension) { return std::strcmp(extension, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0; });
+		memoryBudgetEnabled = std::any_of(enabledDeviceExtensions.begin(), enabledDeviceExtensions.end(),
+			[](const char* extension) { return std::strcmp(extension, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0; });
+		if (!memoryBudgetEnabled)
 		{
-			VkDeviceQueueCreateInfo queueCreateInfo{};
+			std::cerr << "VK_EXT_memory_budget is not supported, heap budgets are estimated from the heap sizes\n";
+		}
 
-			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-			queueCreateInfo.pQueuePriorities = queuePriority;
-			queueCreateInfo.queueCount = 1;
-			queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
+		framePacer.create(device, options.present.latencyProfile, presentWaitEnabled);
+		if (!presentWaitEnabled && !isOffscreen())
+		{
+			std::cerr << "present wait is not supported, input to present latency is not measured\n";
+		}
+	}
 
-			queueCreateInfos.push_back(queueCreateInfo);
+	bool isPresentWaitSupported(const std::vector<VkExtensionProperties>& supportedExtensions)
+	{
+		if (!checkExtensionSupport({ VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME }, supportedExtensions))
+		{
+			return false;
 		}
 
-		return queueCreateInfos;
+		VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+		presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+		VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+		presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		presentIdFeatures.pNext = &presentWaitFeatures;
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &presentIdFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+		return presentIdFeatures.presentId && presentWaitFeatures.presentWait;
 	}
 
-	void retrieveQueueHandles()
+	// The scene only needs task and mesh shaders, none of the optional mesh shading features.
+	bool isMeshShadingSupported(const std::vector<VkExtensionProperties>& supportedExtensions)
 	{
-		vkGetDeviceQueue(device, queueFamilyIndices.graphicsFamily.value(), 0, &graphicsQueue);
-		vkGetDeviceQueue(device, queueFamilyIndices.presentFamily.value(), 0, &presentQueue);
+		if (!checkExtensionSupport({ VK_EXT_MESH_SHADER_EXTENSION_NAME, VK_KHR_SPIRV_1_4_EXTENSION_NAME, VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME }, supportedExtensions))
+		{
+			return false;
+		}
+
+		VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+		meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &meshShaderFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+		return meshShaderFeatures.taskShader && meshShaderFeatures.meshShader;
 	}
 
-	void loadDeviceFunctions()
+	// The task workgroups of a draw are only counted along x, see drawMeshletTasks.
+	uint32_t getMaxTaskWorkGroupCount()
 	{
-		volkLoadDevice(device);
+		VkPhysicalDeviceMeshShaderPropertiesEXT meshShaderProperties{};
+		meshShaderProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &meshShaderProperties;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+		return std::min(meshShaderProperties.maxTaskWorkGroupCount[0], meshShaderProperties.maxTaskWorkGroupTotalCount);
 	}
 
-	void createSwapChain()
+	// Draws are shaded at the fragment size of --shading-rate, adaptive shading coarsens it where the previous frame was flat.
+	// Both fall back to what the gpu can do, down to shading every pixel without the extension.
+	void chooseShadingRate(const std::vector<VkExtensionProperties>& supportedExtensions)
 	{
-		auto capabilities = querySwapChainCapabilities(physicalDevice);
-		VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(querySwapChainFormats(physicalDevice));
-		VkPresentModeKHR presentMode = chooseSwapPresentMode(querySwapChainPresentModes(physicalDevice));
-		VkExtent2D extent = chooseSwapExtent(capabilities);
+		const bool fixedRate = options.render.shadingRateWidth != 1 || options.render.shadingRateHeight != 1;
+		if (!fixedRate && !options.render.adaptiveShading)
+		{
+			return;
+		}
+		if (checkExtensionSupport({ VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME, VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME }, supportedExtensions))
+		{
+			shadingRateSupport = FragmentShadingRateSupport::query(physicalDevice);
+		}
+		if (!shadingRateSupport.pipeline)
+		{
+			std::cerr << "variable rate shading is not supported, every pixel is shaded\n";
+			return;
+		}
 
-		VkSwapchainCreateInfoKHR createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-		createInfo.surface = surface;
+		adaptiveShadingEnabled = options.render.adaptiveShading && isAdaptiveShadingSupported();
+		if (options.render.adaptiveShading && !adaptiveShadingEnabled)
+		{
+			std::cerr << "shading rate attachments are not supported, adaptive shading is off\n";
+		}
+		shadingRateEnabled = fixedRate || adaptiveShadingEnabled;
+	}
 
-		uint32_t imageCount = capabilities.minImageCount + 1;	
-		if (capabilities.maxImageCount != 0) // there is an upper limit
+	// The pass that writes the attachment samples the finished frame, so the frame images have to be sampleable.
+	// With a device group the previous frame would have been rendered by another gpu.
+	bool isAdaptiveShadingSupported()
+	{
+		if (!shadingRateSupport.attachment || deviceGroup.isActive() || !physicalDeviceFeatures.shaderStorageImageExtendedFormats)
 		{
-			if (imageCount > capabilities.maxImageCount)
-			{ 
-				imageCount = capabilities.maxImageCount;
+			return false;
+		}
+
+		const VkFormatFeatureFlags rateFeatures = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+		VkFormatProperties rateProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, AdaptiveShadingRate::FORMAT, &rateProperties);
+		if ((rateProperties.optimalTilingFeatures & rateFeatures) != rateFeatures)
+		{
+			return false;
+		}
+
+		VkFormat frameFormat = OFFSCREEN_FORMAT;
+		if (!isOffscreen())
+		{
+			const SwapChainSupportDetails details = querySwapChainSupport(physicalDevice);
+			if (!(details.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_SAMPLED_BIT))
+			{
+				return false;
 			}
+			frameFormat = chooseSwapSurfaceFormat(details.formats).format;
+		}
+		VkFormatProperties frameProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, frameFormat, &frameProperties);
+		return frameProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+	}
+
+	// A device group would need a value for every gpu of every semaphore, it keeps fences and binary semaphores.
+	bool isTimelineSyncSupported(const std::vector<VkExtensionProperties>& supportedExtensions)
+	{
+		return !deviceGroup.isActive()
+			&& checkExtensionSupport({ VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME }, supportedExtensions)
+			&& TimelineSemaphore::isSupported(physicalDevice);
+	}
+
+	std::vector<VkDeviceQueueCreateInfo> createQueueCreateInfos(const float* const queuePriority)
+	{
+		std::unordered_set<uint32_t> uniqueQueueFamilyIndices{
+			queueFamilyIndices.graphicsFamily.value(),
+			queueFamilyIndices.transferFamily.value(),
+			queueFamilyIndices.computeFamily.value()
+		};
+		if (queueFamilyIndices.presentFamily)
+		{
+			uniqueQueueFamilyIndices.insert(queueFamilyIndices.presentFamily.value());
+		}
+		if (queueFamilyIndices.sparseBindingFamily)
+		{
+			uniqueQueueFamilyIndices.insert(queueFamilyIndices.sparseBindingFamily.value());
+		}
+
+		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+		queueCreateInfos.reserve(uniqueQueueFamilyIndices.size());
+
+		for (const auto& queueFamilyIndex : uniqueQueueFamilyIndices)
+		{
+			VkDeviceQueueCreateInfo queueCreateInfo{};
+
+			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+			queueCreateInfo.pQueuePriorities = queuePriority;
+			queueCreateInfo.queueCount = 1;
+			queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+			queueCreateInfos.push_back(queueCreateInfo);
+		}
+
+		return queueCreateInfos;
+	}
+
+	void retrieveQueueHandles()
+	{
+		vkGetDeviceQueue(device, queueFamilyIndices.graphicsFamily.value(), 0, &graphicsQueue);
+		if (queueFamilyIndices.presentFamily)
+		{
+			vkGetDeviceQueue(device, queueFamilyIndices.presentFamily.value(), 0, &presentQueue);
+		}
+		vkGetDeviceQueue(device, queueFamilyIndices.transferFamily.value(), 0, &transferQueue);
+		vkGetDeviceQueue(device, queueFamilyIndices.computeFamily.value(), 0, &computeQueue);
+		if (queueFamilyIndices.sparseBindingFamily)
+		{
+			vkGetDeviceQueue(device, queueFamilyIndices.sparseBindingFamily.value(), 0, &sparseQueue);
+		}
+	}
+
+	void loadDeviceFunctions()
+	{
+		volkLoadDevice(device);
+	}
+
+	void configureDeviceGroupPresentation()
+	{
+		deviceGroup.configurePresentation(device, surface);
+		if (deviceGroup.getRenderingDeviceCount() > framesInFlight)
+		{
+			std::cerr << "only " << framesInFlight << " of the " << deviceGroup.getRenderingDeviceCount()
+				<< " gpus render, one per frame in flight\n";
+		}
+	}
+
+	// one per queue the frames submit to
+	void createTimelines()
+	{
+		frameValues.assign(framesInFlight, 0);
+		if (timelineSyncEnabled)
+		{
+			graphicsTimeline.create(device);
+			computeTimeline.create(device);
+			transferTimeline.create(device);
+		}
+	}
+
+	void createMemoryAllocator()
+	{
+		memoryAllocator.create(physicalDevice, device, physicalDeviceProperties.limits, deviceGroup.getDeviceCount(), memoryBudgetEnabled);
+	}
+
+	void createUploadEngine()
+	{
+		const uint32_t graphicsFamily = queueFamilyIndices.graphicsFamily.value();
+		if (deviceGroup.isActive())
+		{
+			uploadEngine.create(device, memoryAllocator, graphicsQueue, graphicsFamily, graphicsFamily, physicalDeviceProperties.limits, nullptr, deviceGroup.getAllDevicesMask());
+		}
+		else
+		{
+			uploadEngine.create(device, memoryAllocator, transferQueue, queueFamilyIndices.transferFamily.value(), graphicsFamily, physicalDeviceProperties.limits,
+				timelineSyncEnabled ? &transferTimeline : nullptr);
+		}
+	}
+
+	void createPipelineCache()
+	{
+		std::optional<std::string> cacheData = tryReadFile(PIPELINE_CACHE_PATH);
+		if (cacheData && !isPipelineCacheCompatible(*cacheData))
+		{
+			std::cerr << "discarding pipeline cache created by a different device or driver\n";
+			cacheData.reset();
+		}
+
+		VkPipelineCacheCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		if (cacheData)
+		{
+			createInfo.initialDataSize = cacheData->size();
+			createInfo.pInitialData = cacheData->data();
+		}
+
+		if (vkCreatePipelineCache(device, &createInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline cache");
+		}
+	}
+
+	bool isPipelineCacheCompatible(const std::string& cacheData)
+	{
+		// drivers should reject foreign data on their own, but not all of them do so gracefully
+		VkPipelineCacheHeaderVersionOne header;
+		if (cacheData.size() < sizeof(header))
+		{
+			return false;
+		}
+		std::memcpy(&header, cacheData.data(), sizeof(header));
+
+		return header.headerSize >= sizeof(header)
+			&& header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+			&& header.vendorID == physicalDeviceProperties.vendorID
+			&& header.deviceID == physicalDeviceProperties.deviceID
+			&& std::memcmp(header.pipelineCacheUUID, physicalDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+
+	void savePipelineCache()
+	{
+		size_t dataSize = 0;
+		if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS)
+		{
+			std::cerr << "failed to query pipeline cache size\n";
+			return;
+		}
+
+		std::vector<char> data(dataSize);
+		if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+		{
+			std::cerr << "failed to retrieve pipeline cache data\n";
+			return;
 		}
 
-		createInfo.minImageCount = imageCount;
+		try
+		{
+			writeFileAtomically(PIPELINE_CACHE_PATH, data.data(), dataSize);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "failed to save pipeline cache: " << e.what() << '\n';
+		}
+	}
+
+	void createSwapChain()
+	{
+		auto capabilities = querySwapChainCapabilities(physicalDevice);
+		VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(querySwapChainFormats(physicalDevice));
+		VkPresentModeKHR presentMode = chooseSwapPresentMode(querySwapChainPresentModes(physicalDevice));
+		VkExtent2D extent = chooseSwapExtent(capabilities);
+
+		VkSwapchainCreateInfoKHR createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+		createInfo.surface = surface;
+
+		createInfo.minImageCount = getSwapChainImageCount(capabilities);
 		createInfo.imageFormat = surfaceFormat.format;
 		createInfo.imageColorSpace = surfaceFormat.colorSpace;
 		createInfo.imageExtent = extent;
 		createInfo.imageArrayLayers = 1;
 		createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		if (adaptiveShadingEnabled)
+		{
+			createInfo.imageUsage |= VK_IMAGE_USAGE_SAMPLED_BIT; // read by the shading rate pass
+		}
+		if (dynamicResolutionEnabled)
+		{
+			createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT; // written by the upscale pass
+		}
 
 		uint32_t indices[] = { queueFamilyIndices.graphicsFamily.value(), queueFamilyIndices.presentFamily.value() };
 		if (queueFamilyIndices.graphicsFamily != queueFamilyIndices.presentFamily)
@@ -671,7 +1637,13 @@ private:
 		createInfo.presentMode = presentMode;
 		createInfo.clipped = VK_TRUE;
 
-		createInfo.oldSwapchain = VK_NULL_HANDLE;
+		createInfo.oldSwapchain = swapChain; // lets the driver reuse resources of the swapchain being replaced
+
+		const VkDeviceGroupSwapchainCreateInfoKHR deviceGroupCreateInfo = deviceGroup.getSwapchainCreateInfo();
+		if (deviceGroup.isActive())
+		{
+			createInfo.pNext = &deviceGroupCreateInfo;
+		}
 
 		if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
 		{
@@ -682,6 +1654,62 @@ private:
 		swapChainExtent = extent;
 	}
 
+	// Device images take the place of the swapchain images, every frame in flight has its own and reads it back when done.
+	void createOffscreenTargets()
+	{
+		swapChainImageFormat = OFFSCREEN_FORMAT;
+		swapChainExtent = { options.offscreen.width, options.offscreen.height };
+		if (swapChainExtent.width > physicalDeviceProperties.limits.maxImageDimension2D || swapChainExtent.height > physicalDeviceProperties.limits.maxImageDimension2D)
+		{
+			throw std::runtime_error("the offscreen size exceeds what the gpu supports");
+		}
+
+		VkImageCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		createInfo.imageType = VK_IMAGE_TYPE_2D;
+		createInfo.format = swapChainImageFormat;
+		createInfo.extent = { swapChainExtent.width, swapChainExtent.height, 1 };
+		createInfo.mipLevels = 1;
+		createInfo.arrayLayers = 1;
+		createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		createInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		if (adaptiveShadingEnabled)
+		{
+			createInfo.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+		}
+		if (dynamicResolutionEnabled)
+		{
+			createInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		}
+		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		for (size_t i = 0; i < framesInFlight; ++i)
+		{
+			offscreenTargets.push_back(memoryAllocator.createImage(createInfo, MemoryUsage::GpuOnly));
+			swapChainImages.push_back(offscreenTargets.back().image);
+		}
+
+		offscreenReadback.create(memoryAllocator, swapChainExtent, swapChainImageFormat, OFFSCREEN_BYTES_PER_PIXEL, framesInFlight);
+		if (!options.offscreen.outputDirectory.empty())
+		{
+			offscreenFileWriter.start(options.offscreen.outputDirectory);
+			offscreenReadback.setSink([this](const ReadbackFrame& frame) { offscreenFileWriter.write(frame); });
+		}
+	}
+
+	void destroyOffscreenTargets()
+	{
+		offscreenReadback.destroy();
+		for (AllocatedImage& target : offscreenTargets)
+		{
+			memoryAllocator.destroyImage(target);
+		}
+		offscreenTargets.clear();
+		swapChainImages.clear();
+	}
+
 	void retrieveSwapChainImageHandles()
 	{
 		uint32_t imageCount = 0;
@@ -707,12 +1735,20 @@ private:
 
 	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
 	{
-		for (const auto& presentMode : availablePresentModes)
+		auto isAvailable = [&](VkPresentModeKHR presentMode) {
+			return std::find(availablePresentModes.begin(), availablePresentModes.end(), presentMode) != availablePresentModes.end();
+		};
+
+		if (options.present.latencyProfile == LatencyProfile::Throughput)
 		{
-			if (presentMode == VkPresentModeKHR::VK_PRESENT_MODE_MAILBOX_KHR)
+			if (isAvailable(VK_PRESENT_MODE_MAILBOX_KHR))
 			{
 				return VK_PRESENT_MODE_MAILBOX_KHR; // triple buffering
 			}
+			if (isAvailable(VK_PRESENT_MODE_IMMEDIATE_KHR))
+			{
+				return VK_PRESENT_MODE_IMMEDIATE_KHR; // tears
+			}
 		}
 
 		return VK_PRESENT_MODE_FIFO_KHR; // guaranteed - double buffering
@@ -722,9 +1758,12 @@ private:
 	{
 		if (capabilities.currentExtent.width == UINT32_MAX) // the resolution of the surface is not set
 		{
+			int width, height;
+			getFramebufferSize(width, height);
+
 			return {
-				std::clamp(WIDTH, capabilities.minImageExtent.width, capabilities.maxImageExtent.width),
-				std::clamp(HEIGHT, capabilities.minImageExtent.height, capabilities.maxImageExtent.height)
+				std::clamp(static_cast<uint32_t>(width), capabilities.minImageExtent.width, capabilities.maxImageExtent.width),
+				std::clamp(static_cast<uint32_t>(height), capabilities.minImageExtent.height, capabilities.maxImageExtent.height)
 			};
 		}
 		else // the resolution of the surface is already set
@@ -768,31 +1807,226 @@ private:
 		return result;
 	}
 
+	// the highest sample count up to the requested one that color attachments support
+	void chooseMsaaSamples()
+	{
+		const VkSampleCountFlags supported = physicalDeviceProperties.limits.framebufferColorSampleCounts;
+		uint32_t samples = options.render.msaaSamples;
+		while (samples > 1 && !(supported & samples))
+		{
+			samples /= 2;
+		}
+		msaaSamples = static_cast<VkSampleCountFlagBits>(samples);
+		if (samples != options.render.msaaSamples)
+		{
+			std::cerr << options.render.msaaSamples << "x msaa is not supported, using " << samples << "x\n";
+		}
+	}
+
+	uint32_t getSwapChainImageCount(const VkSurfaceCapabilitiesKHR& capabilities) const
+	{
+		// the low latency profile keeps as few images queued for the display as possible
+		uint32_t imageCount = capabilities.minImageCount;
+		if (options.present.latencyProfile != LatencyProfile::LowLatency)
+		{
+			++imageCount;
+		}
+		if (capabilities.maxImageCount != 0) // there is an upper limit
+		{
+			if (imageCount > capabilities.maxImageCount)
+			{ 
+				imageCount = capabilities.maxImageCount;
+			}
+		}
+		return imageCount;
+	}
+
+	// Frames beyond the number of swapchain images would only wait to acquire one. The count is fixed at startup,
+	// every per-frame resource is sized by it. Offscreen, every frame in flight has a target of its own.
+	void chooseFramesInFlight()
+	{
+		framesInFlight = options.present.framesInFlight;
+		if (isOffscreen())
+		{
+			return;
+		}
+
+		const uint32_t imageCount = getSwapChainImageCount(querySwapChainCapabilities(physicalDevice));
+		if (framesInFlight > imageCount)
+		{
+			std::cerr << "frames in flight lowered from " << framesInFlight << " to the " << imageCount << " swapchain images\n";
+			framesInFlight = imageCount;
+		}
+	}
+
+	// Upscaling blits the scene color image into the swapchain image, which both formats have to support.
+	void chooseDynamicResolution()
+	{
+		if (!options.render.dynamicResolution)
+		{
+			return;
+		}
+
+		dynamicResolutionEnabled = isDynamicResolutionSupported();
+		if (!dynamicResolutionEnabled)
+		{
+			std::cerr << "the swapchain images can't be blitted to, dynamic resolution is off\n";
+			return;
+		}
+		dynamicResolution.configure(options.render.frameBudgetMilliseconds, options.render.minRenderScalePercent / 100.0f);
+	}
+
+	bool isDynamicResolutionSupported()
+	{
+		VkFormat format = OFFSCREEN_FORMAT;
+		if (!isOffscreen())
+		{
+			const SwapChainSupportDetails details = querySwapChainSupport(physicalDevice);
+			if (!(details.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+			{
+				return false;
+			}
+			format = chooseSwapSurfaceFormat(details.formats).format;
+		}
+
+		const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+		return (properties.optimalTilingFeatures & required) == required;
+	}
+
+	// The passes of a frame and the resources they use, the graph places the barriers between them.
+	// With multisampling the samples live in a transient image that is resolved at the end of the subpass and never stored.
+	// Tile based gpus keep it in tile memory, so the graph gives it lazily allocated memory which never gets any backing.
+	// Offscreen, the frame ends with a copy into the readback ring instead of the present.
+	// With dynamic resolution the main pass renders into the top left of a scene color image, an upscale pass stretches
+	// that part over the swapchain image.
+	// With adaptive shading the frame ends by measuring itself: the shading rate pass writes the attachment the main
+	// pass of the next frame reads, which the graphics queue runs after this one.
+	void buildRenderGraph()
+	{
+		if (isOffscreen())
+		{
+			// the previous frame that used the target was waited for on the CPU
+			swapChainImageResource = renderGraph.importImage("offscreen target", VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+		}
+		else
+		{
+			// the acquire semaphore is waited for at the color attachment output stage, see submitCommandBuffer
+			swapChainImageResource = renderGraph.importImage("swapchain image", VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, RenderGraphAccess::Present);
+		}
+		const auto feedback = renderGraph.importBuffer("virtual texture feedback", RenderGraphAccess::HostRead);
+
+		sceneColorResource.reset();
+		if (dynamicResolutionEnabled)
+		{
+			sceneColorResource = renderGraph.createTransientImage("scene color", { swapChainImageFormat, swapChainExtent });
+		}
+		const RenderGraph::ResourceId sceneImage = sceneColorResource.value_or(swapChainImageResource);
+
+		std::vector<RenderGraph::ResourceUse> mainPassUses = {
+			{ sceneImage, RenderGraphAccess::ColorAttachment },
+			{ feedback, RenderGraphAccess::FragmentStorageWrite }
+		};
+		msaaColorResource.reset();
+		if (msaaSamples != VK_SAMPLE_COUNT_1_BIT)
+		{
+			msaaColorResource = renderGraph.createTransientImage("msaa color", { swapChainImageFormat, swapChainExtent, msaaSamples });
+			mainPassUses.push_back({ *msaaColorResource, RenderGraphAccess::ColorAttachment });
+		}
+		shadingRateResource.reset();
+		if (adaptiveShadingEnabled)
+		{
+			shadingRateResource = renderGraph.importImage("shading rate", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_GENERAL,
+				std::nullopt, VK_ACCESS_SHADER_WRITE_BIT);
+			mainPassUses.push_back({ *shadingRateResource, RenderGraphAccess::ShadingRateAttachment });
+		}
+		renderGraph.addPass("main", mainPassUses, [this](VkCommandBuffer commandBuffer) { recordMainPass(commandBuffer); });
+
+		if (adaptiveShadingEnabled)
+		{
+			renderGraph.addPass("shading rate", { { sceneImage, RenderGraphAccess::ComputeSampled }, { *shadingRateResource, RenderGraphAccess::ComputeStorageWrite } },
+				[this](VkCommandBuffer commandBuffer) { recordShadingRatePass(commandBuffer); });
+		}
+		if (dynamicResolutionEnabled)
+		{
+			renderGraph.addPass("upscale", { { *sceneColorResource, RenderGraphAccess::TransferRead }, { swapChainImageResource, RenderGraphAccess::TransferWrite } },
+				[this](VkCommandBuffer commandBuffer) { recordUpscalePass(commandBuffer); });
+		}
+
+		if (isOffscreen())
+		{
+			const auto readback = renderGraph.importBuffer("readback ring", RenderGraphAccess::HostRead);
+			renderGraph.addPass("readback", { { swapChainImageResource, RenderGraphAccess::TransferRead }, { readback, RenderGraphAccess::TransferWrite } },
+				[this](VkCommandBuffer commandBuffer) { offscreenReadback.recordCopy(commandBuffer, swapChainImages[recordingImageIndex], currentFrame); }, true);
+		}
+
+		renderGraph.compile(device, memoryAllocator);
+	}
+
+	void printRenderGraphStats()
+	{
+		const RenderGraph::Stats& stats = renderGraph.getStats();
+		std::cout << "render graph: " << stats.passCount << " passes (" << stats.culledPassCount << " culled), "
+			<< stats.barrierCount << " barriers, " << stats.transientBytes / 1024 << " KiB of aliased transient memory instead of "
+			<< stats.unaliasedTransientBytes / 1024 << " KiB\n";
+	}
+
+	// Without multisampling the swapchain image is the only attachment. With it, attachment 0 is the multisampled image,
+	// which is cleared and discarded after being resolved into the swapchain image, attachment 1.
+	// The render graph transitions the attachments and synchronizes them, so the render pass leaves their layouts alone.
+	// Adaptive shading adds the shading rate attachment after those.
 	void createRenderPass()
 	{
+		const bool multisampled = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
 		VkAttachmentDescription colorAttachment{};
 		colorAttachment.format = swapChainImageFormat;
-		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		colorAttachment.samples = msaaSamples;
 		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentDescription resolveAttachment{};
+		resolveAttachment.format = swapChainImageFormat;
+		resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; // every pixel is resolved
+		resolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		resolveAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		resolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		resolveAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		resolveAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		const VkAttachmentDescription attachments[] = { colorAttachment, resolveAttachment };
 		
 		VkAttachmentReference colorAttachmentRef{};
 		colorAttachmentRef.attachment = 0;
 		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference resolveAttachmentRef{};
+		resolveAttachmentRef.attachment = 1;
+		resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 		
 		VkSubpassDescription subpass{};
 		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 		subpass.colorAttachmentCount = 1;
 		subpass.pColorAttachments = &colorAttachmentRef;
+		subpass.pResolveAttachments = multisampled ? &resolveAttachmentRef : nullptr;
+
+		if (adaptiveShadingEnabled)
+		{
+			createShadingRateRenderPass(attachments, multisampled ? 2 : 1, subpass);
+			return;
+		}
 
 		VkRenderPassCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		createInfo.attachmentCount = 1;
-		createInfo.pAttachments = &colorAttachment;
+		createInfo.attachmentCount = multisampled ? 2 : 1;
+		createInfo.pAttachments = attachments;
 		createInfo.subpassCount = 1;
 		createInfo.pSubpasses = &subpass;
 
@@ -802,44 +2036,156 @@ private:
 		}
 	}
 
-	void createGraphicsPipeline()
+	// The same render pass through VK_KHR_create_renderpass2, the only way to give the subpass a shading rate attachment.
+	// The rasterizer only reads it, so it keeps its contents and its layout.
+	void createShadingRateRenderPass(const VkAttachmentDescription* attachments, uint32_t attachmentCount, const VkSubpassDescription& subpass)
 	{
-		VkShaderModule vertexShader = createShaderModule(readFile(VERTEX_SHADER_PATH));
-		VkShaderModule fragmentShader = createShaderModule(readFile(FRAGMENT_SHADER_PATH));
+		std::vector<VkAttachmentDescription2> attachments2;
+		for (uint32_t i = 0; i < attachmentCount; ++i)
+		{
+			VkAttachmentDescription2 attachment{};
+			attachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+			attachment.format = attachments[i].format;
+			attachment.samples = attachments[i].samples;
+			attachment.loadOp = attachments[i].loadOp;
+			attachment.storeOp = attachments[i].storeOp;
+			attachment.stencilLoadOp = attachments[i].stencilLoadOp;
+			attachment.stencilStoreOp = attachments[i].stencilStoreOp;
+			attachment.initialLayout = attachments[i].initialLayout;
+			attachment.finalLayout = attachments[i].finalLayout;
+			attachments2.push_back(attachment);
+		}
 
-		VkPipelineShaderStageCreateInfo shaderStages[] = {
-			createPipelineShaderStageCreateInfo(vertexShader, VK_SHADER_STAGE_VERTEX_BIT),
-			createPipelineShaderStageCreateInfo(fragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT)
+		VkAttachmentDescription2 shadingRateAttachment{};
+		shadingRateAttachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+		shadingRateAttachment.format = AdaptiveShadingRate::FORMAT;
+		shadingRateAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		shadingRateAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		shadingRateAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		shadingRateAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		shadingRateAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		shadingRateAttachment.initialLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+		shadingRateAttachment.finalLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+		attachments2.push_back(shadingRateAttachment);
+
+		auto toReference2 = [](const VkAttachmentReference& reference) {
+			VkAttachmentReference2 reference2{};
+			reference2.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+			reference2.attachment = reference.attachment;
+			reference2.layout = reference.layout;
+			reference2.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			return reference2;
 		};
+		const VkAttachmentReference2 colorAttachmentRef = toReference2(*subpass.pColorAttachments);
+		const VkAttachmentReference2 resolveAttachmentRef = subpass.pResolveAttachments ? toReference2(*subpass.pResolveAttachments) : VkAttachmentReference2{};
+
+		VkAttachmentReference2 shadingRateAttachmentRef{};
+		shadingRateAttachmentRef.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+		shadingRateAttachmentRef.attachment = attachmentCount;
+		shadingRateAttachmentRef.layout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+
+		VkFragmentShadingRateAttachmentInfoKHR shadingRateInfo{};
+		shadingRateInfo.sType = VK_STRUCTURE_TYPE_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR;
+		shadingRateInfo.pFragmentShadingRateAttachment = &shadingRateAttachmentRef;
+		shadingRateInfo.shadingRateAttachmentTexelSize = adaptiveShadingRate.getTexelSize();
+
+		VkSubpassDescription2 subpass2{};
+		subpass2.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2;
+		subpass2.pNext = &shadingRateInfo;
+		subpass2.pipelineBindPoint = subpass.pipelineBindPoint;
+		subpass2.colorAttachmentCount = 1;
+		subpass2.pColorAttachments = &colorAttachmentRef;
+		subpass2.pResolveAttachments = subpass.pResolveAttachments ? &resolveAttachmentRef : nullptr;
+
+		VkRenderPassCreateInfo2 createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
+		createInfo.attachmentCount = static_cast<uint32_t>(attachments2.size());
+		createInfo.pAttachments = attachments2.data();
+		createInfo.subpassCount = 1;
+		createInfo.pSubpasses = &subpass2;
+
+		if (vkCreateRenderPass2KHR(device, &createInfo, nullptr, &renderPass) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create render pass");
+		}
+	}
+
+	void createGraphicsPipeline()
+	{
+		createPipelineLayout();
+		graphicsPipeline = buildGraphicsPipeline(shaderArchive);
+	}
+
+	// Also called by the hot reloader's thread, so it must only use objects that are never changed after startup.
+	// Mesh shading replaces vertex input and the vertex shader with a task and a mesh shader, the rest is the same.
+	VkPipeline buildGraphicsPipeline(const ShaderArchive& archive)
+	{
+		const std::vector<std::pair<const char*, VkShaderStageFlagBits>> stageShaders = meshShadingEnabled
+			? std::vector<std::pair<const char*, VkShaderStageFlagBits>>{
+				{ TASK_SHADER_NAME, VK_SHADER_STAGE_TASK_BIT_EXT },
+				{ MESH_SHADER_NAME, VK_SHADER_STAGE_MESH_BIT_EXT },
+				{ FRAGMENT_SHADER_NAME, VK_SHADER_STAGE_FRAGMENT_BIT } }
+			: std::vector<std::pair<const char*, VkShaderStageFlagBits>>{
+				{ VERTEX_SHADER_NAME, VK_SHADER_STAGE_VERTEX_BIT },
+				{ FRAGMENT_SHADER_NAME, VK_SHADER_STAGE_FRAGMENT_BIT } };
+
+		std::vector<VkShaderModule> shaders;
+		auto destroyShaders = [&] {
+			for (VkShaderModule shader : shaders)
+			{
+				vkDestroyShaderModule(device, shader, nullptr);
+			}
+		};
+		std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+		try
+		{
+			for (const auto& [name, stage] : stageShaders)
+			{
+				shaders.push_back(createShaderModule(archive.get(name)));
+				shaderStages.push_back(createPipelineShaderStageCreateInfo(shaders.back(), stage));
+			}
+		}
+		catch (...)
+		{
+			destroyShaders();
+			throw;
+		}
 
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexAttributeDescriptionCount = 0;
-		vertexInputInfo.vertexBindingDescriptionCount = 0;
+		const auto vertexBindings = getMeshBindingDescriptions();
+		const auto vertexAttributes = getMeshAttributeDescriptions();
+		vertexInputInfo.vertexBindingDescriptionCount = vertexBindings.size();
+		vertexInputInfo.pVertexBindingDescriptions = vertexBindings.data();
+		vertexInputInfo.vertexAttributeDescriptionCount = vertexAttributes.size();
+		vertexInputInfo.pVertexAttributeDescriptions = vertexAttributes.data();
 
 		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
 		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		inputAssembly.primitiveRestartEnable = false;
 
-		VkViewport viewport{};
-		viewport.x = 0;
-		viewport.y = 0;
-		viewport.width = swapChainExtent.width;
-		viewport.height = swapChainExtent.height;
-		viewport.minDepth = 0.0;
-		viewport.maxDepth = 1.0;
-
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = swapChainExtent;
-
+		// viewport and scissor are set when recording, so the pipeline survives swapchain recreation
 		VkPipelineViewportStateCreateInfo viewportState{};
 		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
+		viewportState.pViewports = nullptr;
 		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
+		viewportState.pScissors = nullptr;
+
+		std::vector<VkDynamicState> dynamicStates = {
+			VK_DYNAMIC_STATE_VIEWPORT,
+			VK_DYNAMIC_STATE_SCISSOR
+		};
+		if (shadingRateEnabled)
+		{
+			dynamicStates.push_back(VK_DYNAMIC_STATE_FRAGMENT_SHADING_RATE_KHR); // per draw, see setFragmentShadingRate
+		}
+
+		VkPipelineDynamicStateCreateInfo dynamicState{};
+		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+		dynamicState.pDynamicStates = dynamicStates.data();
 
 		VkPipelineRasterizationStateCreateInfo rasterizer{};
 		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -854,7 +2200,7 @@ private:
 		VkPipelineMultisampleStateCreateInfo multisampling{};
 		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 		multisampling.sampleShadingEnable = VK_FALSE;
-		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		multisampling.rasterizationSamples = msaaSamples;
 
 		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
 		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -866,44 +2212,50 @@ private:
 		colorBlending.attachmentCount = 1;
 		colorBlending.pAttachments = &colorBlendAttachment;
 
-		createPipelineLayout();
-
 		VkGraphicsPipelineCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		createInfo.stageCount = 2;
-		createInfo.pStages = shaderStages;
-		createInfo.pVertexInputState = &vertexInputInfo;
-		createInfo.pInputAssemblyState = &inputAssembly;
+		createInfo.stageCount = shaderStages.size();
+		createInfo.pStages = shaderStages.data();
+		createInfo.pVertexInputState = meshShadingEnabled ? nullptr : &vertexInputInfo;
+		createInfo.pInputAssemblyState = meshShadingEnabled ? nullptr : &inputAssembly;
 		createInfo.pViewportState = &viewportState;
 		createInfo.pRasterizationState = &rasterizer;
 		createInfo.pMultisampleState = &multisampling;
 		createInfo.pDepthStencilState = nullptr;
 		createInfo.pColorBlendState = &colorBlending;
-		createInfo.pDynamicState = nullptr;
+		createInfo.pDynamicState = &dynamicState;
 		createInfo.layout = pipelineLayout;
 		createInfo.renderPass = renderPass;
 		createInfo.subpass = 0;
 		createInfo.basePipelineHandle = VK_NULL_HANDLE;
 		createInfo.basePipelineIndex = -1;
 
-		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &createInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
+		VkPipeline pipeline;
+		if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &createInfo, nullptr, &pipeline) != VK_SUCCESS)
 		{
-			vkDestroyShaderModule(device, vertexShader, nullptr);
-			vkDestroyShaderModule(device, fragmentShader, nullptr);
+			destroyShaders();
 
 			throw std::runtime_error("failed to create graphics pipeline");
 		}
 
-		vkDestroyShaderModule(device, vertexShader, nullptr);
-		vkDestroyShaderModule(device, fragmentShader, nullptr);
+		destroyShaders();
+		return pipeline;
 	}
 
+	// set 0 is the bindless set, set 1 the per frame constants
 	void createPipelineLayout()
 	{
+		const VkDescriptorSetLayout setLayouts[] = { bindlessDescriptors.getSetLayout(), uniformRing.getSetLayout() };
+		const VkPushConstantRange pushConstantRange = meshShadingEnabled
+			? makePushConstantRange<MeshletPushConstants>(MESHLET_PUSH_CONSTANT_STAGES)
+			: makePushConstantRange<ScenePushConstants>(VK_SHADER_STAGE_FRAGMENT_BIT);
+
 		VkPipelineLayoutCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		createInfo.setLayoutCount = 0;
-		createInfo.pushConstantRangeCount = 0;
+		createInfo.setLayoutCount = ARRAY_SIZE(setLayouts);
+		createInfo.pSetLayouts = setLayouts;
+		createInfo.pushConstantRangeCount = 1;
+		createInfo.pPushConstantRanges = &pushConstantRange;
 		
 		if (vkCreatePipelineLayout(device, &createInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
 		{
@@ -911,23 +2263,175 @@ private:
 		}
 	}
 
-	VkPipelineShaderStageCreateInfo createPipelineShaderStageCreateInfo(VkShaderModule shader, VkShaderStageFlagBits stageBit)
+	// the task and mesh shaders read the mesh, the meshlets and the instances through the bindless set
+	void createBindlessDescriptors()
+	{
+		const VkShaderStageFlags meshStages = meshShadingEnabled ? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT : 0;
+		bindlessDescriptors.create(physicalDevice, device, VK_SHADER_STAGE_FRAGMENT_BIT | meshStages, framesInFlight);
+	}
+
+	void createUniformRing()
+	{
+		const VkShaderStageFlags stages = meshShadingEnabled ? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT : VK_SHADER_STAGE_VERTEX_BIT;
+		uniformRing.create(device, memoryAllocator, physicalDeviceProperties.limits, stages,
+			UNIFORM_BLOCK_SIZE, UNIFORM_BYTES_PER_FRAME, framesInFlight);
+	}
+
+	void createCullPipeline()
+	{
+		VkDescriptorSetLayoutBinding bindings[3]{};
+		for (uint32_t i = 0; i < ARRAY_SIZE(bindings); ++i)
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo{};
+		setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		setLayoutCreateInfo.bindingCount = ARRAY_SIZE(bindings);
+		setLayoutCreateInfo.pBindings = bindings;
+
+		if (vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &cullSetLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor set layout");
+		}
+
+		const VkPushConstantRange pushConstantRange = makePushConstantRange<CullPushConstants>(VK_SHADER_STAGE_COMPUTE_BIT);
+
+		VkPipelineLayoutCreateInfo layoutCreateInfo{};
+		layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutCreateInfo.setLayoutCount = 1;
+		layoutCreateInfo.pSetLayouts = &cullSetLayout;
+		layoutCreateInfo.pushConstantRangeCount = 1;
+		layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(device, &layoutCreateInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline layout");
+		}
+
+		cullPipeline = buildCullPipeline(shaderArchive);
+	}
+
+	// Compacting only works when the draw count is read on the GPU, so the pass is specialized on it instead of branching
+	VkPipeline buildCullPipeline(const ShaderArchive& archive)
+	{
+		const CullSpecialization specialization{ COMPUTE_WORKGROUP_SIZE, drawIndirectCountEnabled };
+		const VkSpecializationInfo specializationInfo = specialization.getInfo();
+		return createComputePipeline(archive, CULL_OBJECTS_SHADER_NAME, cullPipelineLayout, &specializationInfo);
+	}
+
+	void createAdaptiveShadingRate()
+	{
+		if (adaptiveShadingEnabled)
+		{
+			adaptiveShadingRate.create(device, memoryAllocator, shadingRateSupport.chooseTexelSize(AdaptiveShadingRate::PREFERRED_TEXEL_SIZE));
+		}
+	}
+
+	// with the swapchain, the attachment covers the frame and every image the scene is rendered into gets a set
+	void createShadingRateTargets()
+	{
+		if (adaptiveShadingEnabled)
+		{
+			adaptiveShadingRate.createTargets(uploadEngine, swapChainExtent, getSceneImageViews());
+		}
+	}
+
+	// what the main pass renders into, the swapchain images unless the scene color image is upscaled into them
+	std::vector<VkImageView> getSceneImageViews() const
+	{
+		if (sceneColorResource)
+		{
+			return { renderGraph.getImageView(*sceneColorResource) };
+		}
+		return swapChainImageViews;
+	}
+
+	size_t getSceneImageIndex() const
+	{
+		return sceneColorResource ? 0 : recordingImageIndex;
+	}
+
+	void createShadingRatePipeline()
+	{
+		if (!adaptiveShadingEnabled)
+		{
+			return;
+		}
+
+		const VkDescriptorSetLayout setLayout = adaptiveShadingRate.getSetLayout();
+		const VkPushConstantRange pushConstantRange = makePushConstantRange<ShadingRatePushConstants>(VK_SHADER_STAGE_COMPUTE_BIT);
+
+		VkPipelineLayoutCreateInfo layoutCreateInfo{};
+		layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutCreateInfo.setLayoutCount = 1;
+		layoutCreateInfo.pSetLayouts = &setLayout;
+		layoutCreateInfo.pushConstantRangeCount = 1;
+		layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(device, &layoutCreateInfo, nullptr, &shadingRatePipelineLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline layout");
+		}
+
+		shadingRatePipeline = createComputePipeline(shaderArchive, SHADING_RATE_SHADER_NAME, shadingRatePipelineLayout);
+	}
+
+	VkPipeline createComputePipeline(const ShaderArchive& archive, const char* shaderName, VkPipelineLayout layout,
+		const VkSpecializationInfo* specialization = nullptr)
+	{
+		VkShaderModule shader = createShaderModule(archive.get(shaderName));
+
+		VkComputePipelineCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		createInfo.stage = createPipelineShaderStageCreateInfo(shader, VK_SHADER_STAGE_COMPUTE_BIT, specialization);
+		createInfo.layout = layout;
+		createInfo.basePipelineHandle = VK_NULL_HANDLE;
+		createInfo.basePipelineIndex = -1;
+
+		VkPipeline pipeline;
+		if (vkCreateComputePipelines(device, pipelineCache, 1, &createInfo, nullptr, &pipeline) != VK_SUCCESS)
+		{
+			vkDestroyShaderModule(device, shader, nullptr);
+
+			throw std::runtime_error(std::string("failed to create compute pipeline from ") + shaderName);
+		}
+
+		vkDestroyShaderModule(device, shader, nullptr);
+		return pipeline;
+	}
+
+	// The specialization info is only referenced, it has to stay alive until the pipeline is created.
+	VkPipelineShaderStageCreateInfo createPipelineShaderStageCreateInfo(VkShaderModule shader, VkShaderStageFlagBits stageBit,
+		const VkSpecializationInfo* specialization = nullptr)
 	{
 		VkPipelineShaderStageCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		createInfo.module = shader;
 		createInfo.stage = stageBit;
 		createInfo.pName = "main";
+		createInfo.pSpecializationInfo = specialization;
 
 		return createInfo;
 	}
 
-	VkShaderModule createShaderModule(const std::string& code)
+	// The code is used in place, the archive keeps it 4 byte aligned as pCode requires.
+	VkShaderModule createShaderModule(const ShaderArchive::ShaderCode& shaderCode)
 	{
+		// drivers aren't required to validate SPIR-V, so at least make sure this is SPIR-V
+		constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+		if (shaderCode.size < sizeof(SPIRV_MAGIC) || shaderCode.code[0] != SPIRV_MAGIC)
+		{
+			throw std::runtime_error("shader code is not valid SPIR-V");
+		}
+
 		VkShaderModuleCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-		createInfo.codeSize = code.size();
+		createInfo.pCode = shaderCode.code;
+		createInfo.codeSize = shaderCode.size;
 
 		VkShaderModule shader;
 		if (vkCreateShaderModule(device, &createInfo, nullptr, &shader) != VK_SUCCESS)
@@ -942,11 +2446,23 @@ private:
 		framebuffers.resize(swapChainImageViews.size(), VK_NULL_HANDLE);
 		for (int i = 0; i < framebuffers.size(); ++i)
 		{
+			// in the order of the render pass' attachments
+			std::vector<VkImageView> attachments;
+			if (msaaColorResource)
+			{
+				attachments.push_back(renderGraph.getImageView(*msaaColorResource));
+			}
+			attachments.push_back(sceneColorResource ? renderGraph.getImageView(*sceneColorResource) : swapChainImageViews[i]);
+			if (adaptiveShadingEnabled)
+			{
+				attachments.push_back(adaptiveShadingRate.getView());
+			}
+
 			VkFramebufferCreateInfo createInfo{};
 			createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 			createInfo.renderPass = renderPass;
-			createInfo.attachmentCount = 1;
-			createInfo.pAttachments = &swapChainImageViews[i];
+			createInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+			createInfo.pAttachments = attachments.data();
 			createInfo.width = swapChainExtent.width;
 			createInfo.height = swapChainExtent.height;
 			createInfo.layers = 1;
@@ -958,77 +2474,342 @@ private:
 		}
 	}
 
-	void createCommandPool()
+	void createCommandPools()
+	{
+		frameCommandBuffers.resize(framesInFlight);
+		for (auto& frame : frameCommandBuffers)
+		{
+			frame.primaryPool = createTransientCommandPool();
+			frame.workerPools.resize(jobSystem.getWorkerCount());
+			for (auto& workerPool : frame.workerPools)
+			{
+				workerPool.pool = createTransientCommandPool();
+			}
+		}
+	}
+
+	// the pools are reset as a whole every frame, which is much cheaper than resetting buffers one by one
+	VkCommandPool createTransientCommandPool()
+	{
+		return createTransientCommandPool(queueFamilyIndices.graphicsFamily.value());
+	}
+
+	VkCommandPool createTransientCommandPool(uint32_t queueFamilyIndex)
 	{
 		VkCommandPoolCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		createInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-		createInfo.flags = 0;
+		createInfo.queueFamilyIndex = queueFamilyIndex;
+		createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 		
-		if (vkCreateCommandPool(device, &createInfo, nullptr, &commandPool) != VK_SUCCESS)
+		VkCommandPool pool;
+		if (vkCreateCommandPool(device, &createInfo, nullptr, &pool) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create command pool");
 		}
+		return pool;
 	}
 
-	void createCommandBuffers()
+	void allocateCommandBuffers()
 	{
-		allocateCommandBuffers();
-		recordCommandBuffers();
+		for (auto& frame : frameCommandBuffers)
+		{
+			frame.primary = allocateCommandBuffer(frame.primaryPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+		}
 	}
 
-	void allocateCommandBuffers()
+	VkCommandBuffer allocateCommandBuffer(VkCommandPool pool, VkCommandBufferLevel level)
 	{
-		commandBuffers.resize(framebuffers.size());
-
 		VkCommandBufferAllocateInfo allocationInfo{};
 		allocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocationInfo.commandPool = commandPool;
-		allocationInfo.commandBufferCount = commandBuffers.size();
-		allocationInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocationInfo.commandPool = pool;
+		allocationInfo.commandBufferCount = 1;
+		allocationInfo.level = level;
 
-		if (vkAllocateCommandBuffers(device, &allocationInfo, commandBuffers.data()) != VK_SUCCESS)
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(device, &allocationInfo, &commandBuffer) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to allocate command buffers");
 		}
+		return commandBuffer;
+	}
+
+	// Must only be called once the frame's fence has signaled.
+	void resetFrameCommandPools(FrameCommandBuffers& frame)
+	{
+		vkResetCommandPool(device, frame.primaryPool, 0);
+		for (auto& workerPool : frame.workerPools)
+		{
+			vkResetCommandPool(device, workerPool.pool, 0);
+			workerPool.usedSecondaryCount = 0;
+		}
+	}
+
+	void recordFrame(uint32_t imageIndex)
+	{
+		FrameCommandBuffers& frame = frameCommandBuffers[currentFrame];
+		resetFrameCommandPools(frame);
+
+		recordingImageIndex = imageIndex;
+		recordingSceneParts = recordScenePartsInParallel(frame, imageIndex);
+		renderGraph.setImportedImage(swapChainImageResource, swapChainImages[imageIndex], swapChainImageViews[imageIndex]);
+		if (shadingRateResource)
+		{
+			renderGraph.setImportedImage(*shadingRateResource, adaptiveShadingRate.getImage(), adaptiveShadingRate.getView());
+		}
+
+		beginRecordingCommandBuffer(frame.primary);
+		uploadEngine.recordAcquireBarriers(frame.primary, currentFrame);
+		virtualTexture.recordUploads(frame.primary);
+		if (deviceGroup.isActive())
+		{
+			// every gpu keeps its copy of the resources up to date, the frame itself only runs on its own gpus
+			vkCmdSetDeviceMask(frame.primary, deviceGroup.getFrameDeviceMask(currentFrame));
+		}
+		gpuProfiler.beginFrame(frame.primary, currentFrame);
+		renderGraph.execute(frame.primary);
+		endRecordingCommandBuffer(frame.primary);
+	}
+
+	void recordMainPass(VkCommandBuffer commandBuffer)
+	{
+		GpuProfiler::ScopedZone zone(gpuProfiler, commandBuffer, "main pass");
+		beginCommandBufferRenderPass(commandBuffer, framebuffers[recordingImageIndex], VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		if (!recordingSceneParts.empty())
+		{
+			vkCmdExecuteCommands(commandBuffer, recordingSceneParts.size(), recordingSceneParts.data());
+		}
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	void recordShadingRatePass(VkCommandBuffer commandBuffer)
+	{
+		GpuProfiler::ScopedZone zone(gpuProfiler, commandBuffer, "shading rate");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, shadingRatePipeline);
+		const VkDescriptorSet set = adaptiveShadingRate.getSet(getSceneImageIndex());
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, shadingRatePipelineLayout, 0, 1, &set, 0, nullptr);
+
+		const VkExtent2D texelSize = adaptiveShadingRate.getTexelSize();
+		const ShadingRatePushConstants pushConstants{ { texelSize.width, texelSize.height }, HALF_RATE_CONTRAST, QUARTER_RATE_CONTRAST };
+		vkCmdPushConstants(commandBuffer, shadingRatePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+		const VkExtent2D extent = adaptiveShadingRate.getExtent();
+		vkCmdDispatch(commandBuffer, (extent.width + SHADING_RATE_WORKGROUP_SIZE - 1) / SHADING_RATE_WORKGROUP_SIZE,
+			(extent.height + SHADING_RATE_WORKGROUP_SIZE - 1) / SHADING_RATE_WORKGROUP_SIZE, 1);
+	}
+
+	// Linear filtering is all the upscaling there is, a temporal upscaler would need motion vectors the scene doesn't have.
+	void recordUpscalePass(VkCommandBuffer commandBuffer)
+	{
+		GpuProfiler::ScopedZone zone(gpuProfiler, commandBuffer, "upscale");
+		VkImageBlit region{};
+		region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.srcOffsets[1] = { static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height), 1 };
+		region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.dstOffsets[1] = { static_cast<int32_t>(swapChainExtent.width), static_cast<int32_t>(swapChainExtent.height), 1 };
+		vkCmdBlitImage(commandBuffer, renderGraph.getImage(*sceneColorResource), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			swapChainImages[recordingImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+	}
+
+	// Splits the scene into one part per worker, records every part into its own secondary command buffer
+	// and returns the non-empty ones in scene order.
+	std::vector<VkCommandBuffer> recordScenePartsInParallel(FrameCommandBuffers& frame, uint32_t imageIndex)
+	{
+		const size_t partCount = getScenePartCount();
+		std::vector<VkCommandBuffer> sceneParts(partCount, VK_NULL_HANDLE);
+
+		jobSystem.parallelFor(partCount, [&](size_t part, size_t workerIndex) {
+			sceneParts[part] = recordScenePart(frame.workerPools[workerIndex], framebuffers[imageIndex], part, partCount);
+		});
+
+		sceneParts.erase(std::remove(sceneParts.begin(), sceneParts.end(), VK_NULL_HANDLE), sceneParts.end());
+		return sceneParts;
+	}
+
+	// A draw count written by the GPU can't be split between parts, so the whole scene is a single draw then.
+	size_t getScenePartCount() const
+	{
+		return drawIndirectCountEnabled && !meshShadingEnabled ? 1 : jobSystem.getWorkerCount();
+	}
+
+	// What the parts split, the tasks of the task shader with mesh shading, the culled objects otherwise.
+	size_t getSceneDrawCount() const
+	{
+		return meshShadingEnabled ? getMeshletTaskCount(sceneInstances.size()) : sceneObjects.size();
+	}
+
+	size_t getMeshletTaskCount(size_t instanceCount) const
+	{
+		return instanceCount * sceneMeshlets.getMeshletCount();
+	}
+
+	// Runs on a worker thread - may only touch the given worker's pool.
+	VkCommandBuffer recordScenePart(WorkerCommandPool& workerPool, VkFramebuffer framebuffer, size_t part, size_t partCount)
+	{
+		const size_t drawCount = getSceneDrawCount();
+		const size_t firstDraw = drawCount * part / partCount;
+		const size_t lastDraw = drawCount * (part + 1) / partCount;
+		if (firstDraw == lastDraw)
+		{
+			return VK_NULL_HANDLE;
+		}
+
+		VkCommandBuffer commandBuffer = acquireSecondaryCommandBuffer(workerPool);
+		beginRecordingSecondaryCommandBuffer(commandBuffer, framebuffer);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		const VkDescriptorSet bindlessSet = bindlessDescriptors.getSet();
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &bindlessSet, 0, nullptr);
+		const VkDescriptorSet uniformSet = uniformRing.getSet();
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &uniformSet, 1, &viewConstantsOffset);
+		setViewportAndScissor(commandBuffer); // dynamic state isn't inherited from the primary
+		setFragmentShadingRate(commandBuffer);
+		if (meshShadingEnabled)
+		{
+			drawMeshletTasks(commandBuffer, firstDraw, lastDraw);
+			endRecordingCommandBuffer(commandBuffer);
+			return commandBuffer;
+		}
+
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ScenePushConstants), &scenePushConstants[currentFrame]);
+		sceneMesh.bind(commandBuffer);
+		const VkDeviceSize instanceOffset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, MeshInstance::BINDING, 1, &instanceBuffer.buffer, &instanceOffset);
+
+		// the draw commands and the count are written by the culling pass on the compute queue
+		const ComputeFrame& computeFrame = computeFrames[currentFrame];
+		const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+		if (drawIndirectCountEnabled)
+		{
+			vkCmdDrawIndexedIndirectCountKHR(commandBuffer, computeFrame.drawCommands.buffer, 0, computeFrame.drawCount.buffer, 0, sceneObjects.size(), stride);
+		}
+		else if (enabledFeatures.multiDrawIndirect)
+		{
+			// culled objects are left in place with no instances, the rest draws all of an object's instances at once
+			vkCmdDrawIndexedIndirect(commandBuffer, computeFrame.drawCommands.buffer, firstDraw * stride, lastDraw - firstDraw, stride);
+		}
+		else
+		{
+			for (size_t i = firstDraw; i < lastDraw; ++i)
+			{
+				vkCmdDrawIndexedIndirect(commandBuffer, computeFrame.drawCommands.buffer, i * stride, 1, stride);
+			}
+		}
+
+		endRecordingCommandBuffer(commandBuffer);
+		return commandBuffer;
+	}
+
+	// Every task shader workgroup culls TASK_WORKGROUP_SIZE tasks and launches a mesh shader workgroup per visible one.
+	// The workgroup count of a draw is limited, so a large range of tasks takes several draws.
+	void drawMeshletTasks(VkCommandBuffer commandBuffer, size_t firstTask, size_t lastTask)
+	{
+		MeshletPushConstants pushConstants = meshletPushConstants;
+		pushConstants.scene = scenePushConstants[currentFrame];
+
+		const size_t maxTasksPerDraw = size_t(maxTaskWorkGroupCount) * TASK_WORKGROUP_SIZE;
+		for (size_t first = firstTask; first < lastTask; first += maxTasksPerDraw)
+		{
+			pushConstants.firstTask = static_cast<uint32_t>(first);
+			pushConstants.taskCount = static_cast<uint32_t>(std::min(lastTask - first, maxTasksPerDraw));
+			vkCmdPushConstants(commandBuffer, pipelineLayout, MESHLET_PUSH_CONSTANT_STAGES, 0, sizeof(pushConstants), &pushConstants);
+			vkCmdDrawMeshTasksEXT(commandBuffer, (pushConstants.taskCount + TASK_WORKGROUP_SIZE - 1) / TASK_WORKGROUP_SIZE, 1, 1);
+		}
 	}
 
-	void recordCommandBuffers()
+	VkCommandBuffer acquireSecondaryCommandBuffer(WorkerCommandPool& workerPool)
 	{
-		for (int i = 0; i < commandBuffers.size(); ++i)
+		if (workerPool.usedSecondaryCount == workerPool.secondaries.size())
 		{
-			beginRecordingCommandBuffer(i);
-			recordCommandBuffer(i);
-			endRecordingCommandBuffer(i);
+			workerPool.secondaries.push_back(allocateCommandBuffer(workerPool.pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY));
 		}
+		return workerPool.secondaries[workerPool.usedSecondaryCount++];
 	}
 
-	void beginRecordingCommandBuffer(int i)
+	void beginRecordingCommandBuffer(VkCommandBuffer commandBuffer)
 	{
 		VkCommandBufferBeginInfo beginInfo{};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 		beginInfo.pInheritanceInfo = nullptr;
-		beginInfo.flags = 0;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-		if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS)
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to start recording command buffer");
 		}
 	}
 
-	void recordCommandBuffer(int i)
+	void beginRecordingSecondaryCommandBuffer(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer)
+	{
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = framebuffer;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to start recording secondary command buffer");
+		}
+	}
+
+	void setViewportAndScissor(VkCommandBuffer commandBuffer)
+	{
+		VkViewport viewport{};
+		viewport.x = 0;
+		viewport.y = 0;
+		viewport.width = renderExtent.width;
+		viewport.height = renderExtent.height;
+		viewport.minDepth = 0.0;
+		viewport.maxDepth = 1.0;
+
+		VkRect2D scissor{};
+		scissor.offset = { 0, 0 };
+		scissor.extent = renderExtent;
+
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		// every gpu clears the whole image, which stays black outside of its band, for the bands to add up on present
+		if (deviceGroup.getMode() == DeviceGroupMode::SplitFrame)
+		{
+			for (uint32_t deviceIndex = 0; deviceIndex < deviceGroup.getDeviceCount(); ++deviceIndex)
+			{
+				vkCmdSetDeviceMask(commandBuffer, 1u << deviceIndex);
+				const VkRect2D band = deviceGroup.getSplitFrameScissor(deviceIndex, swapChainExtent);
+				vkCmdSetScissor(commandBuffer, 0, 1, &band);
+			}
+			vkCmdSetDeviceMask(commandBuffer, deviceGroup.getAllDevicesMask());
+		}
+	}
+
+	// There is no rate per primitive, so the first combiner keeps the draw's. With adaptive shading the second one takes
+	// the coarser of it and the attachment's if the gpu can, else the attachment's.
+	void setFragmentShadingRate(VkCommandBuffer commandBuffer)
 	{
-		beginCommandBufferRenderPass(i);
-		vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-		vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);
-		vkCmdEndRenderPass(commandBuffers[i]);
+		if (!shadingRateEnabled)
+		{
+			return;
+		}
+
+		const VkExtent2D fragmentSize{ options.render.shadingRateWidth, options.render.shadingRateHeight };
+		const VkFragmentShadingRateCombinerOpKHR combinerOps[2] = {
+			VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR,
+			!adaptiveShadingEnabled ? VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR
+				: shadingRateSupport.nonTrivialCombinerOps ? VK_FRAGMENT_SHADING_RATE_COMBINER_OP_MAX_KHR : VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR
+		};
+		vkCmdSetFragmentShadingRateKHR(commandBuffer, &fragmentSize, combinerOps);
 	}
 
-	void beginCommandBufferRenderPass(int i)
+	void beginCommandBufferRenderPass(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, VkSubpassContents contents)
 	{
 		VkRect2D renderArea{};
 		renderArea.offset = { 0, 0 };
-		renderArea.extent = swapChainExtent;
+		renderArea.extent = renderExtent; // only what the upscale pass reads is cleared
 
 		VkClearValue clearColor{};
 		clearColor.color = { 0, 0, 0, 1 };
@@ -1036,77 +2817,1463 @@ private:
 		VkRenderPassBeginInfo renderPassInfo{};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 		renderPassInfo.renderPass = renderPass;
-		renderPassInfo.framebuffer = framebuffers[i];
+		renderPassInfo.framebuffer = framebuffer;
 
 		renderPassInfo.renderArea = renderArea;
 		renderPassInfo.clearValueCount = 1;
 		renderPassInfo.pClearValues = &clearColor;
 
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		// without it the render pass would run on every gpu of the command buffer's initial device mask
+		VkDeviceGroupRenderPassBeginInfo deviceGroupBeginInfo{};
+		deviceGroupBeginInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_RENDER_PASS_BEGIN_INFO;
+		deviceGroupBeginInfo.deviceMask = deviceGroup.getFrameDeviceMask(currentFrame);
+		if (deviceGroup.isActive())
+		{
+			renderPassInfo.pNext = &deviceGroupBeginInfo;
+		}
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
 	}
 
-	void endRecordingCommandBuffer(int i)
+	void endRecordingCommandBuffer(VkCommandBuffer commandBuffer)
 	{
-		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to stop recording command buffer");
 		}
 	}
 
-	void createSemaphores()
+	void createFrameSyncObjects()
 	{
-		VkSemaphoreCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-		createInfo.flags = 0;
+		VkSemaphoreCreateInfo semaphoreCreateInfo{};
+		semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreCreateInfo.flags = 0;
+
+		VkFenceCreateInfo fenceCreateInfo{};
+		fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; // so that the first wait on each frame doesn't block forever
+
+		imageAvailableSemaphores.resize(framesInFlight, VK_NULL_HANDLE);
+		for (auto& semaphore : imageAvailableSemaphores)
+		{
+			if (vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create imageAvailable semaphore");
+			}
+		}
 
-		if (vkCreateSemaphore(device, &createInfo, nullptr, &imageAvailbleSemaphore) != VK_SUCCESS)
+		if (!timelineSyncEnabled) // the graphics timeline tells when a frame has finished otherwise
 		{
-			throw std::runtime_error("failed to create imageAvailble semaphore");
+			inFlightFences.resize(framesInFlight, VK_NULL_HANDLE);
+			for (auto& fence : inFlightFences)
+			{
+				if (vkCreateFence(device, &fenceCreateInfo, nullptr, &fence) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to create inFlight fence");
+				}
+			}
 		}
-		if (vkCreateSemaphore(device, &createInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS)
+
+		if (deviceGroup.getMode() == DeviceGroupMode::SplitFrame)
 		{
-			throw std::runtime_error("failed to create renderFinished semaphore");
+			fenceCreateInfo.flags = 0;
+			acquireFences.resize(framesInFlight, VK_NULL_HANDLE);
+			for (auto& fence : acquireFences)
+			{
+				if (vkCreateFence(device, &fenceCreateInfo, nullptr, &fence) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to create acquire fence");
+				}
+			}
 		}
 	}
 
-	void mainLoop()
+	void createSwapChainImageSyncObjects()
 	{
-		while (!glfwWindowShouldClose(window))
+		VkSemaphoreCreateInfo semaphoreCreateInfo{};
+		semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreCreateInfo.flags = 0;
+
+		// the presentation engine may still be waiting on renderFinished after the frame's fence signals,
+		// so these can only be reused once the same swapchain image is acquired again
+		renderFinishedSemaphores.resize(swapChainImages.size() * deviceGroup.getDeviceCount(), VK_NULL_HANDLE);
+		for (auto& semaphore : renderFinishedSemaphores)
 		{
-			glfwPollEvents();
-			drawFrame();
+			if (vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create renderFinished semaphore");
+			}
 		}
+
+		imageFrameValues.assign(swapChainImages.size(), 0);
 	}
 
-	void drawFrame()
+	// each gpu a frame renders on signals its own semaphore, as a semaphore can only be signaled by one of them
+	VkSemaphore getRenderFinishedSemaphore(uint32_t imageIndex, uint32_t deviceIndex) const
 	{
-		uint32_t imageIndex;
-		vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailbleSemaphore, VK_NULL_HANDLE, &imageIndex);
+		return renderFinishedSemaphores[imageIndex * deviceGroup.getDeviceCount() + deviceIndex];
 	}
 
-	void cleanup()
+	void createComputeFrames()
 	{
-		vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
-		vkDestroySemaphore(device, imageAvailbleSemaphore, nullptr);
+		const uint32_t computeFamily = queueFamilyIndices.computeFamily.value();
 
-		vkDestroyCommandPool(device, commandPool, nullptr);
+		VkSemaphoreCreateInfo semaphoreCreateInfo{};
+		semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		for (const auto& framebuffer : framebuffers)
+		const uint32_t maxObjectCount = getObjectCount(getMaxInstanceCount());
+		const VkDeviceSize objectsSize = maxObjectCount * sizeof(SceneObject);
+		const VkDeviceSize drawCommandsSize = maxObjectCount * sizeof(VkDrawIndexedIndirectCommand);
+
+		computeFrames.resize(framesInFlight);
+		for (auto& frame : computeFrames)
 		{
-			vkDestroyFramebuffer(device, framebuffer, nullptr);
+			frame.pool = createTransientCommandPool(computeFamily);
+			frame.commandBuffer = allocateCommandBuffer(frame.pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+			frame.finished.resize(timelineSyncEnabled ? 0 : deviceGroup.getDeviceCount(), VK_NULL_HANDLE);
+			for (auto& semaphore : frame.finished)
+			{
+				if (vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to create computeFinished semaphore");
+				}
+			}
+
+			frame.objects = createComputeSharedBuffer(objectsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::CpuToGpu);
+			frame.drawCommands = createComputeSharedBuffer(drawCommandsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryUsage::GpuOnly);
+			frame.drawCount = createComputeSharedBuffer(sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly);
+			frame.descriptorSet = allocateDescriptorSet(cullSetLayout);
+			writeStorageBufferDescriptors(frame.descriptorSet, { frame.objects.buffer, frame.drawCommands.buffer, frame.drawCount.buffer });
+		}
+	}
+
+	// The per-frame culling buffers are used by both families every frame, concurrent sharing spares the ownership transfers.
+	AllocatedBuffer createComputeSharedBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage)
+	{
+		const uint32_t sharingFamilies[] = { queueFamilyIndices.computeFamily.value(), queueFamilyIndices.graphicsFamily.value() };
+
+		VkBufferCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		createInfo.size = size;
+		createInfo.usage = usage;
+		if (sharingFamilies[0] != sharingFamilies[1])
+		{
+			createInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			createInfo.queueFamilyIndexCount = ARRAY_SIZE(sharingFamilies);
+			createInfo.pQueueFamilyIndices = sharingFamilies;
+		}
+		else
+		{
+			createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		}
+		return memoryAllocator.createBuffer(createInfo, memoryUsage);
+	}
+
+	void createScene()
+	{
+		// the triangle the vertex shader used to generate
+		const std::vector<Vertex> vertices = {
+			{ {  0.0f, -0.5f }, { 1, 0, 0 } },
+			{ {  0.5f,  0.5f }, { 0, 1, 0 } },
+			{ { -0.5f,  0.5f }, { 0, 0, 1 } }
+		};
+		const std::vector<uint32_t> indices = { 0, 1, 2 };
+		if (meshShadingEnabled)
+		{
+			sceneMeshlets.create(memoryAllocator, uploadEngine, vertices, buildMeshlets(vertices, indices), getInstanceReadStages());
+			if (getMeshletTaskCount(getMaxInstanceCount()) > UINT32_MAX)
+			{
+				throw std::runtime_error("too many meshlets in the scene, the task shader numbers them with 32 bits");
+			}
+		}
+		else
+		{
+			sceneMesh.create(memoryAllocator, uploadEngine, vertices, indices);
+		}
+
+		const VkBufferUsageFlags instanceUsage = meshShadingEnabled ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+		instanceBuffer = memoryAllocator.createBuffer(getMaxInstanceCount() * sizeof(MeshInstance),
+			instanceUsage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly);
+
+		const auto& sweep = options.benchmark.instanceCounts;
+		buildScene(options.benchmark.enabled && !sweep.empty() ? sweep.front() : options.scene.instanceCount);
+	}
+
+	// the instances are vertex attributes, or read by the task and mesh shaders with mesh shading
+	VkPipelineStageFlags getInstanceReadStages() const
+	{
+		return meshShadingEnabled ? VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT : VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+	}
+
+	uint32_t getMaxInstanceCount() const
+	{
+		uint32_t maxCount = options.scene.instanceCount;
+		for (uint32_t count : options.benchmark.instanceCounts)
+		{
+			maxCount = std::max(maxCount, count);
+		}
+		return maxCount;
+	}
+
+	uint32_t getObjectCount(uint32_t instanceCount) const
+	{
+		return (instanceCount + options.scene.instancesPerObject - 1) / options.scene.instancesPerObject;
+	}
+
+	// One instance is the centred triangle, more are laid out in a grid twice the size of the view in each direction,
+	// so about three quarters of them are culled. Runs of consecutive instances become the culled objects.
+	// The instance buffer must not be in use by the GPU.
+	void buildScene(uint32_t instanceCount)
+	{
+		sceneInstances.resize(instanceCount);
+		if (instanceCount == 1)
+		{
+			sceneInstances[0] = { { 0, 0 }, 1 };
+		}
+		else
+		{
+			const uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(double(instanceCount))));
+			const uint32_t rows = (instanceCount + columns - 1) / columns;
+			const float spacing = 4.0f / columns;
+			for (uint32_t i = 0; i < instanceCount; ++i)
+			{
+				const float x = -2 + spacing * (i % columns + 0.5f);
+				const float y = -2 + 4.0f / rows * (i / columns + 0.5f);
+				sceneInstances[i] = { { x, y }, spacing };
+			}
+		}
+
+		sceneObjects.resize(getObjectCount(instanceCount));
+		for (uint32_t i = 0; i < sceneObjects.size(); ++i)
+		{
+			const uint32_t first = i * options.scene.instancesPerObject;
+			const uint32_t last = std::min(first + options.scene.instancesPerObject, instanceCount);
+
+			float min[2] = { INFINITY, INFINITY };
+			float max[2] = { -INFINITY, -INFINITY };
+			float instanceRadius = 0;
+			for (uint32_t instance = first; instance < last; ++instance)
+			{
+				for (int axis = 0; axis < 2; ++axis)
+				{
+					min[axis] = std::min(min[axis], sceneInstances[instance].position[axis]);
+					max[axis] = std::max(max[axis], sceneInstances[instance].position[axis]);
+				}
+				instanceRadius = std::max(instanceRadius, MESH_INSTANCE_RADIUS * sceneInstances[instance].scale);
+			}
+
+			SceneObject& object = sceneObjects[i];
+			object.center[0] = (min[0] + max[0]) / 2;
+			object.center[1] = (min[1] + max[1]) / 2;
+			object.radius = std::hypot(max[0] - min[0], max[1] - min[1]) / 2 + instanceRadius;
+			object.firstInstance = first;
+			object.instanceCount = last - first;
+			object.padding = 0;
+		}
+
+		uploadEngine.uploadBuffer(instanceBuffer.buffer, 0, sceneInstances.data(), sceneInstances.size() * sizeof(MeshInstance),
+			getInstanceReadStages(), meshShadingEnabled ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	}
+
+	void createDescriptorPool()
+	{
+		// the culling set of every frame in flight, the scene uses the bindless set
+		VkDescriptorPoolSize poolSizes[] = {
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * framesInFlight }
+		};
+
+		VkDescriptorPoolCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		createInfo.maxSets = framesInFlight;
+		createInfo.poolSizeCount = ARRAY_SIZE(poolSizes);
+		createInfo.pPoolSizes = poolSizes;
+
+		if (vkCreateDescriptorPool(device, &createInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor pool");
+		}
+	}
+
+	VkDescriptorSet allocateDescriptorSet(VkDescriptorSetLayout layout)
+	{
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = descriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &layout;
+
+		VkDescriptorSet descriptorSet;
+		if (vkAllocateDescriptorSets(device, &allocateInfo, &descriptorSet) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate descriptor set");
+		}
+		return descriptorSet;
+	}
+
+	// binds each buffer as a whole to the binding of the same index
+	void writeStorageBufferDescriptors(VkDescriptorSet descriptorSet, const std::vector<VkBuffer>& buffers)
+	{
+		std::vector<VkDescriptorBufferInfo> bufferInfos(buffers.size());
+		std::vector<VkWriteDescriptorSet> writes(buffers.size());
+		for (uint32_t i = 0; i < buffers.size(); ++i)
+		{
+			bufferInfos[i].buffer = buffers[i];
+			bufferInfos[i].offset = 0;
+			bufferInfos[i].range = VK_WHOLE_SIZE;
+
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = descriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		vkUpdateDescriptorSets(device, writes.size(), writes.data(), 0, nullptr);
+	}
+
+	void destroyComputeFrames()
+	{
+		for (auto& frame : computeFrames)
+		{
+			vkDestroyCommandPool(device, frame.pool, nullptr);
+			for (const auto semaphore : frame.finished)
+			{
+				vkDestroySemaphore(device, semaphore, nullptr);
+			}
+			memoryAllocator.destroyBuffer(frame.objects);
+			memoryAllocator.destroyBuffer(frame.drawCommands);
+			memoryAllocator.destroyBuffer(frame.drawCount);
+		}
+		computeFrames.clear();
+	}
+
+	void createVirtualTexture()
+	{
+		const uint32_t size = options.streaming.virtualTextureSize;
+		if (size > physicalDeviceProperties.limits.maxImageDimension2D)
+		{
+			throw std::runtime_error("the virtual texture size exceeds maxImageDimension2D");
+		}
+
+		const bool sparse = sparseQueue != VK_NULL_HANDLE && VirtualTexture::isSupported(physicalDevice, enabledFeatures);
+		if (!sparse)
+		{
+			std::cerr << "sparse residency is unavailable, the virtual texture is replaced by a small resident one\n";
+		}
+
+		const VkDeviceSize budget = VkDeviceSize(options.streaming.textureBudgetMegabytes) * 1024 * 1024;
+		virtualTexture.create(device, memoryAllocator, sparse, sparseQueue, size, budget, &HelloTriangleApp::generateVirtualTextureTexels, framesInFlight);
+	}
+
+	// A checkerboard tinted by mip level, so it's easy to see which levels are resident.
+	static void generateVirtualTextureTexels(uint32_t mipLevel, VkOffset2D offset, VkExtent2D extent, void* texels)
+	{
+		static const uint8_t tints[][3] = {
+			{ 255, 255, 255 }, { 255, 128, 128 }, { 128, 255, 128 }, { 128, 128, 255 },
+			{ 255, 255, 128 }, { 255, 128, 255 }, { 128, 255, 255 }, { 192, 192, 192 }
+		};
+		const uint8_t* tint = tints[mipLevel % ARRAY_SIZE(tints)];
+		constexpr uint32_t SQUARE_SIZE = 256; // in texels of mip level 0
+
+		uint8_t* texel = static_cast<uint8_t*>(texels);
+		for (uint32_t y = 0; y < extent.height; ++y)
+		{
+			for (uint32_t x = 0; x < extent.width; ++x)
+			{
+				const uint64_t levelZeroX = uint64_t(offset.x + x) << mipLevel;
+				const uint64_t levelZeroY = uint64_t(offset.y + y) << mipLevel;
+				const bool dark = ((levelZeroX / SQUARE_SIZE) + (levelZeroY / SQUARE_SIZE)) % 2;
+				for (int channel = 0; channel < 3; ++channel)
+				{
+					*texel++ = dark ? tint[channel] / 2 : tint[channel];
+				}
+				*texel++ = 255;
+			}
+		}
+	}
+
+	// the virtual texture and the residency map and feedback buffer of every frame in flight
+	void addSceneDescriptors()
+	{
+		const uint32_t virtualTextureSlot = bindlessDescriptors.addSampledImage(virtualTexture.getView(), virtualTexture.getSampler(), VK_IMAGE_LAYOUT_GENERAL);
+
+		scenePushConstants.resize(framesInFlight);
+		for (size_t i = 0; i < framesInFlight; ++i)
+		{
+			scenePushConstants[i].virtualTexture = virtualTextureSlot;
+			scenePushConstants[i].residency = bindlessDescriptors.addStorageBuffer(virtualTexture.getResidencyBuffer(i));
+			scenePushConstants[i].feedback = bindlessDescriptors.addStorageBuffer(virtualTexture.getFeedbackBuffer(i));
+		}
+
+		if (meshShadingEnabled)
+		{
+			meshletPushConstants.vertices = bindlessDescriptors.addStorageBuffer(sceneMeshlets.getVertexBuffer());
+			meshletPushConstants.meshlets = bindlessDescriptors.addStorageBuffer(sceneMeshlets.getMeshletBuffer());
+			meshletPushConstants.meshletVertices = bindlessDescriptors.addStorageBuffer(sceneMeshlets.getMeshletVertexBuffer());
+			meshletPushConstants.meshletTriangles = bindlessDescriptors.addStorageBuffer(sceneMeshlets.getMeshletTriangleBuffer());
+			meshletPushConstants.instances = bindlessDescriptors.addStorageBuffer(instanceBuffer.buffer);
+			meshletPushConstants.meshletCount = sceneMeshlets.getMeshletCount();
+		}
+	}
+
+	// Benchmarks should measure the shaders they started with, so they don't watch the files.
+	void startPipelineHotReload()
+	{
+		if (options.benchmark.enabled)
+		{
+			return;
+		}
+
+		// every rebuild maps the archive on its own and unmaps it right away, so the archive can be replaced again
+		graphicsPipelineReloader.start(device, "graphics", { SHADER_ARCHIVE_PATH }, [this] {
+			ShaderArchive archive;
+			archive.open(SHADER_ARCHIVE_PATH);
+			return buildGraphicsPipeline(archive);
+		});
+		cullPipelineReloader.start(device, "culling", { SHADER_ARCHIVE_PATH }, [this] {
+			ShaderArchive archive;
+			archive.open(SHADER_ARCHIVE_PATH);
+			return buildCullPipeline(archive);
+		});
+	}
+
+	void createGpuProfiler()
+	{
+		gpuProfiler.create(device, physicalDeviceProperties.limits.timestampPeriod, queryTimestampValidBits(), framesInFlight);
+		if (!gpuProfiler.isSupported())
+		{
+			std::cerr << "the graphics queue doesn't support timestamps, gpu timings are unavailable\n";
+		}
+	}
+
+	uint32_t queryTimestampValidBits()
+	{
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+		return queueFamilies[queueFamilyIndices.graphicsFamily.value()].timestampValidBits;
+	}
+
+	void mainLoop()
+	{
+		if (isOffscreen())
+		{
+			offscreenLoop();
+			return;
+		}
+		// the low latency profile samples input right before the frame starts, a simulated state would be a frame old
+		if (options.present.latencyProfile != LatencyProfile::LowLatency)
+		{
+			simulationLoop();
+			return;
+		}
+
+		while (!glfwWindowShouldClose(window))
+		{
+			pollInput();
+			drawFrame();
+			reportGpuTimings();
+		}
+
+		vkDeviceWaitIdle(device);
+	}
+
+	// The main thread polls input and simulates the next frame while the render thread records and submits the
+	// current one. It stays one state ahead: a state is only simulated once the render thread took the previous one.
+	void simulationLoop()
+	{
+		FrameState state; // the main thread's, frameState belongs to the render thread from here on
+		simulate(state);
+		renderingOnRenderThread = true;
+		renderThread = std::thread(&HelloTriangleApp::renderThreadLoop, this);
+
+		while (!glfwWindowShouldClose(window) && !renderThreadFinished.load(std::memory_order_acquire))
+		{
+			if (state.framebufferWidth == 0 || state.framebufferHeight == 0)
+			{
+				glfwWaitEvents(); // minimized, nothing changes until the window does
+			}
+			else
+			{
+				glfwPollEvents();
+			}
+			if (windowTitles.acquire())
+			{
+				glfwSetWindowTitle(window, windowTitles.read().c_str());
+			}
+
+			simulate(state);
+			frameStates.beginWrite() = state;
+			frameStates.waitForAcquire(frameStates.publish());
+		}
+
+		FrameState& last = frameStates.beginWrite();
+		last.quit = true;
+		frameStates.publish();
+		renderThread.join();
+		renderingOnRenderThread = false;
+
+		vkDeviceWaitIdle(device);
+		if (renderThreadError)
+		{
+			std::rethrow_exception(renderThreadError);
+		}
+	}
+
+	void renderThreadLoop()
+	{
+		try
+		{
+			while (!frameState.quit) // a swapchain recreation may have taken the last state
+			{
+				waitForFrameStart();
+				if (takeFrameState())
+				{
+					drawFrame();
+					reportGpuTimings();
+				}
+			}
+		}
+		catch (...)
+		{
+			renderThreadError = std::current_exception();
+			frameStates.abandon();
+		}
+		renderThreadFinished.store(true, std::memory_order_release);
+		glfwPostEmptyEvent(); // the main thread may be waiting for events
+	}
+
+	// Render thread: waits for a state the previous frame didn't render, returns false once the main thread quits.
+	bool takeFrameState()
+	{
+		frameStates.waitForPublish(frameStates.getReadSequence());
+		frameStates.acquire();
+		frameState = frameStates.read();
+		framePacer.markInputSampled(frameState.inputSampled);
+		return !frameState.quit;
+	}
+
+	// Everything a frame renders that depends on input. There is nothing to animate yet, so this only samples it.
+	void simulate(FrameState& state)
+	{
+		state.inputSampled = Clock::now();
+		state.viewZoom = viewZoom;
+		if (window != nullptr)
+		{
+			glfwGetFramebufferSize(window, &state.framebufferWidth, &state.framebufferHeight);
+		}
+		else
+		{
+			state.framebufferWidth = static_cast<int>(options.offscreen.width);
+			state.framebufferHeight = static_cast<int>(options.offscreen.height);
+		}
+		state.quit = false;
+	}
+
+	// glfw only answers on the main thread, the render thread uses the size the latest state was simulated with
+	void getFramebufferSize(int& width, int& height) const
+	{
+		if (renderingOnRenderThread)
+		{
+			width = frameState.framebufferWidth;
+			height = frameState.framebufferHeight;
+		}
+		else
+		{
+			glfwGetFramebufferSize(window, &width, &height);
+		}
+	}
+
+	// Renders the configured number of frames, each one is read back while later ones render.
+	void offscreenLoop()
+	{
+		const auto start = Clock::now();
+		for (uint32_t i = 0; i < options.offscreen.frameCount; ++i)
+		{
+			pollInput();
+			drawFrame();
+		}
+		collectRemainingReadbacks();
+		offscreenFileWriter.stop();
+
+		const double seconds = millisecondsBetween(start, Clock::now()) / 1000;
+		std::cout << "read back " << offscreenReadback.getCollectedFrameCount() << " frames in " << std::fixed << std::setprecision(2)
+			<< seconds << " s (" << offscreenReadback.getCollectedFrameCount() / seconds << " fps)\n" << std::defaultfloat;
+
+		vkDeviceWaitIdle(device);
+	}
+
+	// the frames still in flight, oldest first
+	void collectRemainingReadbacks()
+	{
+		for (size_t i = 0; i < framesInFlight; ++i)
+		{
+			const size_t frame = (currentFrame + i) % framesInFlight;
+			waitForFrame(frameValues[frame]);
+			offscreenReadback.collect(frame);
+		}
+	}
+
+	// Renders frames until the configured frame count or duration has been measured, then writes the report.
+	void benchmarkLoop()
+	{
+		const BenchmarkOptions& settings = options.benchmark;
+		if (settings.instanceCounts.empty())
+		{
+			BenchmarkRecorder recorder;
+			runBenchmark(recorder);
+			writeBenchmarkReport(recorder, settings.outputPath);
+			return;
+		}
+
+		// the first scene is built by createScene()
+		for (size_t i = 0; i < settings.instanceCounts.size(); ++i)
+		{
+			const uint32_t instanceCount = settings.instanceCounts[i];
+			if (i > 0)
+			{
+				vkDeviceWaitIdle(device); // the instance buffer is rewritten
+				buildScene(instanceCount);
+			}
+
+			BenchmarkRecorder recorder;
+			const bool completed = runBenchmark(recorder);
+			std::filesystem::path outputPath = settings.outputPath;
+			outputPath.replace_filename(outputPath.stem().string() + "_instances" + std::to_string(instanceCount) + outputPath.extension().string());
+			writeBenchmarkReport(recorder, outputPath.string());
+			if (!completed)
+			{
+				break;
+			}
+		}
+	}
+
+	// Renders the warm-up and measured frames of one run. Returns false if the window was closed before it finished.
+	bool runBenchmark(BenchmarkRecorder& recorder)
+	{
+		const BenchmarkOptions& settings = options.benchmark;
+		bool completed = false;
+
+		uint32_t renderedFrames = 0;
+		uint32_t measuredFrames = 0;
+		uint64_t lastGpuResult = gpuProfiler.getCompletedFrameCount();
+		Clock::time_point measurementStart;
+
+		while (!shouldClose())
+		{
+			const auto frameStart = Clock::now();
+			pollInput();
+			drawFrame();
+			const auto frameEnd = Clock::now();
+
+			const std::vector<double> latencies = framePacer.takeLatencies();
+			if (!frameTimings.presented)
+			{
+				continue;
+			}
+			if (renderedFrames++ < settings.warmupFrames)
+			{
+				continue;
+			}
+			if (measuredFrames++ == 0)
+			{
+				measurementStart = frameStart;
+			}
+
+			recorder.record("cpu_frame_ms", millisecondsBetween(frameStart, frameEnd));
+			recorder.record("acquire_wait_ms", frameTimings.acquireWaitMilliseconds);
+			recorder.record("submit_ms", frameTimings.submitMilliseconds);
+			recorder.record("present_ms", frameTimings.presentMilliseconds);
+			for (double latency : latencies)
+			{
+				recorder.record("input_to_present_ms", latency);
+			}
+			recordHeapUsage(recorder);
+
+			if (gpuProfiler.getCompletedFrameCount() != lastGpuResult)
+			{
+				lastGpuResult = gpuProfiler.getCompletedFrameCount();
+				for (const auto& zone : gpuProfiler.getLatestResults())
+				{
+					recorder.record("gpu_" + zone.name + "_ms", zone.milliseconds);
+				}
+			}
+
+			const bool finished = settings.durationSeconds
+				? millisecondsBetween(measurementStart, frameEnd) >= *settings.durationSeconds * 1000
+				: measuredFrames >= settings.frameCount;
+			if (finished)
+			{
+				recorder.setCounter("measured_frames", measuredFrames);
+				recorder.setCounter("measured_seconds", millisecondsBetween(measurementStart, frameEnd) / 1000);
+				completed = true;
+				break;
+			}
+		}
+
+		vkDeviceWaitIdle(device);
+
+		if (measuredFrames == 0)
+		{
+			throw std::runtime_error("benchmark ended before any frame was measured");
+		}
+		return completed;
+	}
+
+	// usage and budget of every heap as of this frame, in megabytes
+	void recordHeapUsage(BenchmarkRecorder& recorder)
+	{
+		const std::vector<HeapBudget> heapBudgets = memoryAllocator.getHeapBudgets();
+		for (size_t i = 0; i < heapBudgets.size(); ++i)
+		{
+			const std::string heap = "heap" + std::to_string(i);
+			recorder.record(heap + "_usage_mb", static_cast<double>(heapBudgets[i].usage) / (1024 * 1024));
+			recorder.record(heap + "_budget_mb", static_cast<double>(heapBudgets[i].budget) / (1024 * 1024));
+		}
+	}
+
+	void writeBenchmarkReport(BenchmarkRecorder& recorder, const std::string& outputPath)
+	{
+		recorder.setInfo("device", physicalDeviceProperties.deviceName);
+		recorder.setInfo("driver_version", std::to_string(physicalDeviceProperties.driverVersion));
+		recorder.setInfo("swapchain_extent", std::to_string(swapChainExtent.width) + "x" + std::to_string(swapChainExtent.height));
+		recorder.setInfo("frames_in_flight", std::to_string(framesInFlight));
+		recorder.setInfo("recording_threads", std::to_string(jobSystem.getWorkerCount()));
+		recorder.setInfo("warmup_frames", std::to_string(options.benchmark.warmupFrames));
+		recorder.setInfo("msaa_samples", std::to_string(msaaSamples));
+		recorder.setInfo("index_type", meshShadingEnabled ? "meshlets" : sceneMesh.getIndexType() == VK_INDEX_TYPE_UINT16 ? "uint16" : "uint32");
+		recorder.setInfo("device_group", deviceGroup.getMode() == DeviceGroupMode::AlternateFrame ? "afr"
+			: deviceGroup.getMode() == DeviceGroupMode::SplitFrame ? "sfr" : "off");
+		recorder.setInfo("latency_profile", options.present.latencyProfile == LatencyProfile::Vsync ? "vsync"
+			: options.present.latencyProfile == LatencyProfile::LowLatency ? "low_latency" : "throughput");
+		recorder.setInfo("present_wait", framePacer.isMeasuring() ? "yes" : "no");
+		recorder.setInfo("offscreen", isOffscreen() ? "yes" : "no");
+		recorder.setInfo("sync", timelineSyncEnabled ? "timeline" : "fences");
+		recorder.setInfo("geometry", meshShadingEnabled ? "mesh" : "vertex");
+		std::ostringstream frameBudget;
+		frameBudget << options.render.frameBudgetMilliseconds << " ms budget";
+		recorder.setInfo("dynamic_resolution", dynamicResolutionEnabled ? frameBudget.str() : "off");
+		recorder.setInfo("shading_rate", !shadingRateEnabled ? "off" : std::to_string(options.render.shadingRateWidth) + "x"
+			+ std::to_string(options.render.shadingRateHeight) + (adaptiveShadingEnabled ? " adaptive" : ""));
+		recorder.setInfo("memory_budget", memoryBudgetEnabled ? "ext" : "estimated");
+		recorder.setInfo("indirect_draws", meshShadingEnabled ? "none" : drawIndirectCountEnabled ? "count" : enabledFeatures.multiDrawIndirect ? "multi_draw" : "single_draw");
+
+		const MemoryStats memoryStats = memoryAllocator.getStats();
+		recorder.setCounter("memory_blocks", memoryStats.total.blockCount);
+		recorder.setCounter("memory_dedicated_allocations", memoryStats.total.dedicatedAllocationCount);
+		recorder.setCounter("memory_reserved_bytes", static_cast<double>(memoryStats.total.reservedBytes));
+		recorder.setCounter("memory_used_bytes", static_cast<double>(memoryStats.total.usedBytes));
+		recorder.setCounter("virtual_texture_resident_tiles", virtualTexture.getResidentTileCount());
+		recorder.setCounter("virtual_texture_page_budget", virtualTexture.getPageBudget());
+		recorder.setCounter("virtual_texture_page_limit", virtualTexture.getPageLimit());
+		recorder.setCounter("memory_over_budget_allocations", memoryStats.overBudgetAllocationCount);
+		recorder.setCounter("scene_instances", sceneInstances.size());
+		recorder.setCounter("scene_objects", sceneObjects.size());
+		recorder.setCounter("bindless_sampled_images", bindlessDescriptors.getUsedSampledImageCount());
+		recorder.setCounter("bindless_storage_buffers", bindlessDescriptors.getUsedStorageBufferCount());
+		recorder.setCounter("startup_ms", startupGraph.getTotalMilliseconds());
+		recorder.setCounter("gpus", deviceGroup.getRenderingDeviceCount());
+
+		const ValidationLogSink::Counters validationCounters = validationLog.getCounters();
+		recorder.setCounter("validation_errors", static_cast<double>(validationCounters.errors));
+		recorder.setCounter("validation_warnings", static_cast<double>(validationCounters.warnings));
+		recorder.setCounter("validation_performance_warnings", static_cast<double>(validationCounters.performanceWarnings));
+		recorder.setCounter("validation_suppressed", static_cast<double>(validationCounters.suppressed));
+		recorder.setCounter("validation_dropped", static_cast<double>(validationCounters.dropped));
+
+		const std::string report = recorder.toJson();
+		writeFileAtomically(outputPath.c_str(), report.data(), report.size());
+		std::cout << "benchmark report written to " << outputPath << '\n';
+	}
+
+	// Polls input and simulates the frame on the thread that renders it, see simulationLoop for the threaded version.
+	void pollInput()
+	{
+		waitForFrameStart();
+		if (window != nullptr)
+		{
+			glfwPollEvents();
+		}
+		simulate(frameState);
+		framePacer.markInputSampled(frameState.inputSampled);
+	}
+
+	// The low latency profile starts the frame as late as it can, so the input polled after this is as fresh as possible.
+	// Without present wait it can only make sure the previous frame is done, which keeps a single frame in flight.
+	void waitForFrameStart()
+	{
+		framePacer.waitForFrameStart(swapChain);
+		if (options.present.latencyProfile == LatencyProfile::LowLatency && !framePacer.isMeasuring())
+		{
+			waitForFrame(currentFrameValue);
+		}
+	}
+
+	void drawFrame()
+	{
+		frameTimings = {};
+
+		const auto acquireStart = Clock::now();
+		waitForFrame(frameValues[currentFrame]);
+		frameRetirement.collect(getCompletedFrameValue());
+		if (isOffscreen())
+		{
+			offscreenReadback.collect(currentFrame); // the frame that used this slot framesInFlight frames ago
+		}
+
+		std::optional<uint32_t> imageIndex = acquireNextImage();
+		if (!imageIndex)
+		{
+			recreateSwapChain();
+			return;
+		}
+		// numbered only once it is sure to be submitted, the graphics timeline can't skip a value
+		currentFrameValue = timelineSyncEnabled ? graphicsTimeline.advance() : currentFrameValue + 1;
+		frameValues[currentFrame] = currentFrameValue;
+		waitForImageToRetire(*imageIndex);
+		frameTimings.acquireWaitMilliseconds = millisecondsBetween(acquireStart, Clock::now());
+
+		// the compute work finishes before the frame's graphics work, so both pipelines retire with the frame
+		graphicsPipelineReloader.swapAtFrameBoundary(graphicsPipeline, frameRetirement, currentFrameValue - 1);
+		cullPipelineReloader.swapAtFrameBoundary(cullPipeline, frameRetirement, currentFrameValue - 1);
+		uploadEngine.beginFrame(currentFrame);
+		bindlessDescriptors.beginFrame(currentFrame);
+		memoryAllocator.updateBudget(); // before streaming, which adapts to it
+		virtualTexture.beginFrame(currentFrame);
+		writeFrameConstants();
+		submitComputeWork();
+
+		updateRenderExtent();
+		recordFrame(*imageIndex);
+
+		const auto submitStart = Clock::now();
+		if (!timelineSyncEnabled)
+		{
+			vkResetFences(device, 1, &inFlightFences[currentFrame]);
+		}
+		submitCommandBuffer(*imageIndex);
+		framePacer.recordFrameCost(framePacer.getMillisecondsSinceInputSampled() + getLatestGpuFrameMilliseconds());
+
+		const auto presentStart = Clock::now();
+		const bool presentedOptimally = isOffscreen() ? queueReadback() : presentImage(*imageIndex);
+		const auto presentEnd = Clock::now();
+
+		frameTimings.presented = true;
+		if (!firstFramePresented)
+		{
+			firstFramePresented = true;
+			writeStartupReport(millisecondsBetween(runStart, presentEnd));
+		}
+		frameTimings.submitMilliseconds = millisecondsBetween(submitStart, presentStart);
+		frameTimings.presentMilliseconds = millisecondsBetween(presentStart, presentEnd);
+
+		if (framebufferResized.exchange(false) || !presentedOptimally)
+		{
+			recreateSwapChain();
+		}
+
+		currentFrame = (currentFrame + 1) % framesInFlight;
+	}
+
+	// time to first frame includes creating the window, which the startup graph doesn't time
+	void writeStartupReport(double timeToFirstFrameMilliseconds)
+	{
+		std::cout << "first frame presented after " << std::fixed << std::setprecision(1) << timeToFirstFrameMilliseconds << " ms\n" << std::defaultfloat;
+		if (options.startup.reportPath.empty())
+		{
+			return;
+		}
+
+		std::ofstream file(options.startup.reportPath);
+		file << startupGraph.toJson(timeToFirstFrameMilliseconds);
+		if (!file)
+		{
+			throw std::runtime_error("failed to write startup report " + options.startup.reportPath);
+		}
+	}
+
+	// the zones of a frame don't nest, so together they are its gpu time
+	// the scale only changes when the profiler has read back another frame, and stays at 1 without timestamps
+	void updateRenderExtent()
+	{
+		if (dynamicResolutionEnabled && gpuProfiler.getCompletedFrameCount() != lastResolutionUpdate)
+		{
+			lastResolutionUpdate = gpuProfiler.getCompletedFrameCount();
+			dynamicResolution.update(getLatestGpuFrameMilliseconds());
+		}
+		renderExtent = dynamicResolutionEnabled ? dynamicResolution.getRenderExtent(swapChainExtent) : swapChainExtent;
+	}
+
+	double getLatestGpuFrameMilliseconds() const
+	{
+		double milliseconds = 0;
+		for (const auto& zone : gpuProfiler.getLatestResults())
+		{
+			milliseconds += zone.milliseconds;
+		}
+		return milliseconds;
+	}
+
+	// shows the latest per-zone gpu times and the average input to present latency in the window title, at most once per report interval
+	void reportGpuTimings()
+	{
+		for (double latency : framePacer.takeLatencies())
+		{
+			reportedLatencySum += latency;
+			++reportedLatencyCount;
+		}
+
+		const auto now = Clock::now();
+		if (now - lastGpuTimingReport < GPU_TIMING_REPORT_INTERVAL)
+		{
+			return;
+		}
+		lastGpuTimingReport = now;
+
+		std::ostringstream title;
+		title << TITLE << std::fixed << std::setprecision(3);
+		for (const auto& zone : gpuProfiler.getLatestResults())
+		{
+			title << " | " << zone.name << ": " << zone.milliseconds << " ms";
+		}
+		if (dynamicResolutionEnabled)
+		{
+			title << " | render scale: " << std::setprecision(0) << dynamicResolution.getScale() * 100 << "%" << std::setprecision(3);
+		}
+		if (reportedLatencyCount > 0)
+		{
+			title << " | input to present: " << reportedLatencySum / reportedLatencyCount << " ms";
+			reportedLatencySum = 0;
+			reportedLatencyCount = 0;
+		}
+
+		if (renderingOnRenderThread)
+		{
+			windowTitles.beginWrite() = title.str();
+			windowTitles.publish();
+		}
+		else
+		{
+			glfwSetWindowTitle(window, title.str().c_str());
+		}
+	}
+
+	// Returns nothing if the swapchain no longer matches the surface and has to be recreated.
+	// Only one gpu can wait for a semaphore, so when splitting frames the CPU waits for the image before any gpu renders into it.
+	std::optional<uint32_t> acquireNextImage()
+	{
+		if (isOffscreen())
+		{
+			return static_cast<uint32_t>(currentFrame); // every frame in flight has its own target
+		}
+
+		uint32_t imageIndex;
+		VkResult result;
+		if (deviceGroup.isActive())
+		{
+			const bool splitFrame = deviceGroup.getMode() == DeviceGroupMode::SplitFrame;
+
+			VkAcquireNextImageInfoKHR acquireInfo{};
+			acquireInfo.sType = VK_STRUCTURE_TYPE_ACQUIRE_NEXT_IMAGE_INFO_KHR;
+			acquireInfo.swapchain = swapChain;
+			acquireInfo.timeout = UINT64_MAX;
+			acquireInfo.semaphore = splitFrame ? VK_NULL_HANDLE : imageAvailableSemaphores[currentFrame];
+			acquireInfo.fence = splitFrame ? acquireFences[currentFrame] : VK_NULL_HANDLE;
+			acquireInfo.deviceMask = deviceGroup.getFrameDeviceMask(currentFrame);
+			result = vkAcquireNextImage2KHR(device, &acquireInfo, &imageIndex);
+
+			if (splitFrame && (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR))
+			{
+				vkWaitForFences(device, 1, &acquireFences[currentFrame], VK_TRUE, UINT64_MAX);
+				vkResetFences(device, 1, &acquireFences[currentFrame]);
+			}
+		}
+		else
+		{
+			result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		}
+
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			return std::nullopt;
+		}
+		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) // a suboptimal image can still be presented
+		{
+			throw std::runtime_error("failed to acquire swapchain image");
+		}
+		return imageIndex;
+	}
+
+	void waitForImageToRetire(uint32_t imageIndex)
+	{
+		// the swapchain may hand out images out of order, so an older frame can still be rendering to this one
+		waitForFrame(imageFrameValues[imageIndex]);
+		imageFrameValues[imageIndex] = currentFrameValue;
+	}
+
+	// Blocks until the frame numbered frameValue has finished on the GPU, every frame before it has finished then too.
+	void waitForFrame(uint64_t frameValue)
+	{
+		if (frameValue <= completedFrameValue)
+		{
+			return;
+		}
+
+		if (timelineSyncEnabled)
+		{
+			graphicsTimeline.wait(frameValue);
+		}
+		else
+		{
+			// a frame in flight is only reused once its fence has signaled, so a frame none of them remembers has finished
+			const auto frame = std::find(frameValues.begin(), frameValues.end(), frameValue);
+			if (frame != frameValues.end())
+			{
+				vkWaitForFences(device, 1, &inFlightFences[frame - frameValues.begin()], VK_TRUE, UINT64_MAX);
+			}
+		}
+		completedFrameValue = frameValue;
+	}
+
+	// Doesn't block. Fences are only checked when they're waited for, timelines can be queried.
+	uint64_t getCompletedFrameValue()
+	{
+		if (timelineSyncEnabled)
+		{
+			completedFrameValue = std::max(completedFrameValue, graphicsTimeline.getCompletedValue());
+		}
+		return completedFrameValue;
+	}
+
+	// Runs on the compute queue, overlapping with the previous frame's graphics work and this frame's recording.
+	void submitComputeWork()
+	{
+		ComputeFrame& frame = computeFrames[currentFrame];
+
+		vkResetCommandPool(device, frame.pool, 0);
+		beginRecordingCommandBuffer(frame.commandBuffer);
+		// the task shader culls every meshlet itself, the empty submit keeps the frame's waits the same
+		if (!meshShadingEnabled)
+		{
+			recordObjectCulling(frame);
+		}
+		endRecordingCommandBuffer(frame.commandBuffer);
+
+		// every gpu of the frame culls into its own copy of the draw commands
+		const uint32_t deviceMask = deviceGroup.getFrameDeviceMask(currentFrame);
+		const std::vector<uint32_t> deviceIndices = deviceGroup.getDeviceIndices(deviceMask);
+		std::vector<VkSemaphore> signalSemaphores;
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+		timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		if (timelineSyncEnabled)
+		{
+			frame.finishedValue = computeTimeline.advance();
+			signalSemaphores.push_back(computeTimeline.get());
+			timelineSubmitInfo.signalSemaphoreValueCount = 1;
+			timelineSubmitInfo.pSignalSemaphoreValues = &frame.finishedValue;
+		}
+		else
+		{
+			for (uint32_t deviceIndex : deviceIndices)
+			{
+				signalSemaphores.push_back(frame.finished[deviceIndex]);
+			}
+		}
+
+		VkDeviceGroupSubmitInfo deviceGroupSubmitInfo{};
+		deviceGroupSubmitInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO;
+		deviceGroupSubmitInfo.commandBufferCount = 1;
+		deviceGroupSubmitInfo.pCommandBufferDeviceMasks = &deviceMask;
+		deviceGroupSubmitInfo.signalSemaphoreCount = deviceIndices.size();
+		deviceGroupSubmitInfo.pSignalSemaphoreDeviceIndices = deviceIndices.data();
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = deviceGroup.isActive() ? static_cast<const void*>(&deviceGroupSubmitInfo) : timelineSyncEnabled ? &timelineSubmitInfo : nullptr;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &frame.commandBuffer;
+		submitInfo.signalSemaphoreCount = signalSemaphores.size();
+		submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+		// the frame's fence or graphics timeline value covers this submit too, graphics can't finish before the compute work it waits for
+		if (vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit compute command buffer");
+		}
+	}
+
+	void recordObjectCulling(ComputeFrame& frame)
+	{
+		std::memcpy(frame.objects.allocation.mapped, sceneObjects.data(), sceneObjects.size() * sizeof(SceneObject));
+		memoryAllocator.flush(frame.objects.allocation);
+
+		CullPushConstants pushConstants{};
+		getViewFrustumPlanes(getViewConstants(), pushConstants.frustumPlanes);
+		pushConstants.objectCount = sceneObjects.size();
+		pushConstants.indexCount = sceneMesh.getIndexCount();
+
+		if (drawIndirectCountEnabled)
+		{
+			vkCmdFillBuffer(frame.commandBuffer, frame.drawCount.buffer, 0, sizeof(uint32_t), 0);
+
+			VkBufferMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.buffer = frame.drawCount.buffer;
+			barrier.offset = 0;
+			barrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(frame.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		}
+
+		vkCmdBindPipeline(frame.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+		vkCmdBindDescriptorSets(frame.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+		vkCmdPushConstants(frame.commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+		vkCmdDispatch(frame.commandBuffer, (pushConstants.objectCount + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE, 1, 1);
+	}
+
+	// There's no camera yet, so the objects are in clip space and the planes bound x and y to [-1, 1] and z to [0, 1].
+	// Each plane is an inward facing normal and a distance, a point p is inside if dot(normal, p) + distance >= 0.
+	// Written once per frame, everything recorded for the frame binds it at viewConstantsOffset.
+	void writeFrameConstants()
+	{
+		uniformRing.beginFrame(currentFrame);
+		viewConstantsOffset = uniformRing.push(getViewConstants());
+		uniformRing.flush();
+	}
+
+	// The scene keeps its aspect ratio and is zoomed around the origin.
+	ViewConstants getViewConstants() const
+	{
+		const float width = static_cast<float>(swapChainExtent.width);
+		const float height = static_cast<float>(swapChainExtent.height);
+
+		ViewConstants view{};
+		view.scale[0] = frameState.viewZoom * std::min(1.0f, height / width);
+		view.scale[1] = frameState.viewZoom * std::min(1.0f, width / height);
+		return view;
+	}
+
+	// The clip space planes moved into the scene's space, normalized so that the culling pass can compare against radii.
+	static void getViewFrustumPlanes(const ViewConstants& view, float planes[6][4])
+	{
+		const float viewPlanes[6][4] = {
+			{ 1, 0, 0, (1 + view.offset[0]) / view.scale[0] }, { -1, 0, 0, (1 - view.offset[0]) / view.scale[0] },
+			{ 0, 1, 0, (1 + view.offset[1]) / view.scale[1] }, { 0, -1, 0, (1 - view.offset[1]) / view.scale[1] },
+			{ 0, 0, 1, 0 }, { 0, 0, -1, 1 }
+		};
+		std::memcpy(planes, viewPlanes, sizeof(viewPlanes));
+	}
+
+	void submitCommandBuffer(uint32_t imageIndex)
+	{
+		const std::vector<uint32_t> deviceIndices = deviceGroup.getDeviceIndices(deviceGroup.getFrameDeviceMask(currentFrame));
+
+		// the frame also waits for the uploads it is the first to use
+		std::vector<VkSemaphore> waitSemaphores = uploadEngine.getWaitSemaphores();
+		std::vector<VkPipelineStageFlags> waitStages = uploadEngine.getWaitStages();
+		std::vector<uint64_t> waitValues = uploadEngine.getWaitValues();
+		if (VkSemaphore tilesBound = virtualTexture.getWaitSemaphore())
+		{
+			waitSemaphores.push_back(tilesBound);
+			waitStages.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT);
+			waitValues.push_back(0); // binary semaphores ignore their value
+		}
+		// on a device group the frame's first gpu waits for those, the uploads end in a barrier for the others
+		std::vector<uint32_t> waitDeviceIndices(waitSemaphores.size(), deviceIndices.front());
+
+		if (timelineSyncEnabled)
+		{
+			waitSemaphores.push_back(computeTimeline.get());
+			waitStages.push_back(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+			waitDeviceIndices.push_back(deviceIndices.front());
+			waitValues.push_back(computeFrames[currentFrame].finishedValue);
+		}
+		else
+		{
+			for (uint32_t deviceIndex : deviceIndices)
+			{
+				waitSemaphores.push_back(computeFrames[currentFrame].finished[deviceIndex]);
+				waitStages.push_back(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+				waitDeviceIndices.push_back(deviceIndex);
+			}
+		}
+		// split frames wait for the acquire on the CPU, offscreen targets aren't acquired
+		if (deviceGroup.getMode() != DeviceGroupMode::SplitFrame && !isOffscreen())
+		{
+			waitSemaphores.push_back(imageAvailableSemaphores[currentFrame]);
+			waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+			waitDeviceIndices.push_back(deviceIndices.front());
+			waitValues.push_back(0);
+		}
+
+		std::vector<VkSemaphore> signalSemaphores;
+		if (!isOffscreen()) // nothing waits for an offscreen frame on the GPU
+		{
+			for (uint32_t deviceIndex : deviceIndices)
+			{
+				signalSemaphores.push_back(getRenderFinishedSemaphore(imageIndex, deviceIndex));
+			}
+		}
+		std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+		if (timelineSyncEnabled)
+		{
+			signalSemaphores.push_back(graphicsTimeline.get());
+			signalValues.push_back(currentFrameValue);
+		}
+
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+		timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineSubmitInfo.waitSemaphoreValueCount = waitValues.size();
+		timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+		timelineSubmitInfo.signalSemaphoreValueCount = signalValues.size();
+		timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+
+		// the command buffer starts on every gpu, see recordFrame
+		const uint32_t commandBufferDeviceMask = deviceGroup.getAllDevicesMask();
+		VkDeviceGroupSubmitInfo deviceGroupSubmitInfo{};
+		deviceGroupSubmitInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO;
+		deviceGroupSubmitInfo.waitSemaphoreCount = waitDeviceIndices.size();
+		deviceGroupSubmitInfo.pWaitSemaphoreDeviceIndices = waitDeviceIndices.data();
+		deviceGroupSubmitInfo.commandBufferCount = 1;
+		deviceGroupSubmitInfo.pCommandBufferDeviceMasks = &commandBufferDeviceMask;
+		deviceGroupSubmitInfo.signalSemaphoreCount = deviceIndices.size();
+		deviceGroupSubmitInfo.pSignalSemaphoreDeviceIndices = deviceIndices.data();
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = deviceGroup.isActive() ? static_cast<const void*>(&deviceGroupSubmitInfo) : timelineSyncEnabled ? &timelineSubmitInfo : nullptr;
+		submitInfo.waitSemaphoreCount = waitSemaphores.size();
+		submitInfo.pWaitSemaphores = waitSemaphores.data();
+		submitInfo.pWaitDstStageMask = waitStages.data();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &frameCommandBuffers[currentFrame].primary;
+		submitInfo.signalSemaphoreCount = signalSemaphores.size();
+		submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+		const VkFence fence = timelineSyncEnabled ? VK_NULL_HANDLE : inFlightFences[currentFrame];
+		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit draw command buffer");
+		}
+	}
+
+	// The offscreen counterpart of presentImage, the copy into the ring was already submitted with the frame.
+	bool queueReadback()
+	{
+		offscreenReadback.markSubmitted(currentFrame, offscreenFrameNumber++);
+		return true;
+	}
+
+	// returns false if the swapchain should be recreated before the next frame
+	bool presentImage(uint32_t imageIndex)
+	{
+		const uint32_t deviceMask = deviceGroup.getFrameDeviceMask(currentFrame);
+		std::vector<VkSemaphore> waitSemaphores;
+		for (uint32_t deviceIndex : deviceGroup.getDeviceIndices(deviceMask))
+		{
+			waitSemaphores.push_back(getRenderFinishedSemaphore(imageIndex, deviceIndex));
+		}
+
+		VkDeviceGroupPresentInfoKHR deviceGroupPresentInfo{};
+		deviceGroupPresentInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_INFO_KHR;
+		deviceGroupPresentInfo.swapchainCount = 1;
+		deviceGroupPresentInfo.pDeviceMasks = &deviceMask;
+
+		VkPresentInfoKHR presentInfo{};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		if (deviceGroup.isActive())
+		{
+			deviceGroupPresentInfo.mode = deviceGroup.getFramePresentMode(currentFrame);
+			presentInfo.pNext = &deviceGroupPresentInfo;
+		}
+
+		const uint64_t presentId = framePacer.beginPresent();
+		VkPresentIdKHR presentIdInfo{};
+		presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		presentIdInfo.swapchainCount = 1;
+		presentIdInfo.pPresentIds = &presentId;
+		if (presentId != 0)
+		{
+			presentIdInfo.pNext = presentInfo.pNext;
+			presentInfo.pNext = &presentIdInfo;
+		}
+		presentInfo.waitSemaphoreCount = waitSemaphores.size();
+		presentInfo.pWaitSemaphores = waitSemaphores.data();
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = &swapChain;
+		presentInfo.pImageIndices = &imageIndex;
+		presentInfo.pResults = nullptr;
+
+		VkResult result = vkQueuePresentKHR(presentQueue, &presentInfo);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		{
+			return false;
+		}
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to present swapchain image");
+		}
+		return true;
+	}
+
+	// Only the objects that depend on the swapchain images or extent are rebuilt.
+	// The render pass and pipeline stay, as the format doesn't change and the viewport is dynamic.
+	void recreateSwapChain()
+	{
+		if (!waitUntilFramebufferIsVisible()) // closed while minimized, the old swapchain will do until cleanup
+		{
+			return;
+		}
+		vkDeviceWaitIdle(device);
+
+		destroySwapChainResources();
+
+		VkSwapchainKHR oldSwapChain = swapChain;
+		createSwapChain();
+		vkDestroySwapchainKHR(device, oldSwapChain, nullptr);
+		framePacer.onSwapchainRecreated();
+
+		retrieveSwapChainImageHandles();
+		createSwapChainImageViews();
+		buildRenderGraph();
+		createShadingRateTargets();
+		createFramebuffers();
+		createSwapChainImageSyncObjects();
+	}
+
+	// returns false if the window was closed meanwhile
+	bool waitUntilFramebufferIsVisible()
+	{
+		if (renderingOnRenderThread) // the main thread keeps simulating while minimized
+		{
+			while (frameState.framebufferWidth == 0 || frameState.framebufferHeight == 0)
+			{
+				if (!takeFrameState())
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		int width = 0, height = 0;
+		glfwGetFramebufferSize(window, &width, &height);
+		while ((width == 0 || height == 0) && !glfwWindowShouldClose(window)) // minimized
+		{
+			glfwWaitEvents();
+			glfwGetFramebufferSize(window, &width, &height);
+		}
+		return !glfwWindowShouldClose(window);
+	}
+
+	void destroySwapChainResources()
+	{
+		for (const auto& framebuffer : framebuffers)
+		{
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+		}
+		framebuffers.clear();
+
+		for (const auto imageView : swapChainImageViews)
+		{
+			vkDestroyImageView(device, imageView, nullptr);
+		}
+		swapChainImageViews.clear();
+		adaptiveShadingRate.destroyTargets();
+		renderGraph.destroy();
+
+		for (const auto semaphore : renderFinishedSemaphores)
+		{
+			vkDestroySemaphore(device, semaphore, nullptr);
+		}
+		renderFinishedSemaphores.clear();
+		imageFrameValues.clear();
+	}
+
+	void destroyCommandPools()
+	{
+		for (const auto& frame : frameCommandBuffers)
+		{
+			vkDestroyCommandPool(device, frame.primaryPool, nullptr);
+			for (const auto& workerPool : frame.workerPools)
+			{
+				vkDestroyCommandPool(device, workerPool.pool, nullptr);
+			}
+		}
+		frameCommandBuffers.clear();
+	}
+
+	void cleanup()
+	{
+		for (const auto semaphore : imageAvailableSemaphores)
+		{
+			vkDestroySemaphore(device, semaphore, nullptr);
 		}
+		for (const auto fence : inFlightFences)
+		{
+			vkDestroyFence(device, fence, nullptr);
+		}
+		for (const auto fence : acquireFences)
+		{
+			vkDestroyFence(device, fence, nullptr);
+		}
+
+		graphicsPipelineReloader.stop();
+		cullPipelineReloader.stop();
+		frameRetirement.flush();
+		gpuProfiler.destroy();
+		destroyComputeFrames();
+		if (meshShadingEnabled)
+		{
+			sceneMeshlets.destroy();
+		}
+		else
+		{
+			sceneMesh.destroy();
+		}
+		memoryAllocator.destroyBuffer(instanceBuffer);
+		virtualTexture.destroy();
+		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+		destroySwapChainResources();
+		destroyCommandPools();
 		
 		vkDestroyPipeline(device, graphicsPipeline, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-		vkDestroyRenderPass(device, renderPass, nullptr);
-		
-		for (const auto imageView : swapChainImageViews)
+		bindlessDescriptors.destroy();
+		uniformRing.destroy();
+		vkDestroyPipeline(device, cullPipeline, nullptr);
+		vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+		if (adaptiveShadingEnabled)
 		{
-			vkDestroyImageView(device, imageView, nullptr);
+			vkDestroyPipeline(device, shadingRatePipeline, nullptr);
+			vkDestroyPipelineLayout(device, shadingRatePipelineLayout, nullptr);
+			adaptiveShadingRate.destroy();
 		}
+
+		savePipelineCache();
+		vkDestroyPipelineCache(device, pipelineCache, nullptr);
+		vkDestroyRenderPass(device, renderPass, nullptr);
 		
 		vkDestroySwapchainKHR(device, swapChain, nullptr);
+		destroyOffscreenTargets();
 
+		uploadEngine.destroy();
+		memoryAllocator.destroy();
+		if (timelineSyncEnabled)
+		{
+			graphicsTimeline.destroy();
+			computeTimeline.destroy();
+			transferTimeline.destroy();
+		}
 		vkDestroyDevice(device, nullptr);
 		
 		if (enableValidationLayers)
@@ -1117,23 +4284,47 @@ private:
 		vkDestroySurfaceKHR(instance, surface, nullptr);
 
 		vkDestroyInstance(instance, nullptr);
+		validationLog.stop();
+
+		if (window != nullptr)
+		{
+			glfwDestroyWindow(window);
+			glfwTerminate();
+		}
 
-		glfwDestroyWindow(window);
-		glfwTerminate();
+		jobSystem.stop();
 	}
 };
 
-int main()
+int main(int argc, char** argv)
 {
+	AppOptions options;
+	try
+	{
+		options = parseAppOptions(argc, argv);
+	}
+	catch (const std::exception & e)
+	{
+		std::cerr << e.what() << '\n';
+		return EXIT_FAILURE;
+	}
+
+	bool failed = false;
 	try
 	{
-		std::unique_ptr<VulkanApplication> app = std::make_unique<HelloTriangleApp>();
+		std::unique_ptr<VulkanApplication> app = std::make_unique<HelloTriangleApp>(options);
 		app->run();
 	}
 	catch (const std::exception & e)
 	{
 		std::cerr << e.what() << '\n';
+		failed = true;
+	}
+
+	if (!options.benchmark.enabled && !options.offscreen.enabled) // automated and headless runs must not wait for input
+	{
+		std::cin.get();
 	}
 
-	std::cin.get();
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,770 @@
+#pragma once
+
+#include <volk.h>
+
+#include <stdexcept>
+#include <algorithm>
+#include <optional>
+#include <memory>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <map>
+#include <cstdint>
+
+inline VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return alignment <= 1 ? value : (value + alignment - 1) / alignment * alignment;
+}
+
+// Whether the resource bound to an allocation is linear (buffers, linear images) or optimally tiled.
+// The two kinds must be bufferImageGranularity apart when they share a VkDeviceMemory.
+enum class ResourceKind
+{
+	Linear,
+	Optimal
+};
+
+enum class MemoryUsage
+{
+	GpuOnly, // device local, not necessarily mappable
+	CpuToGpu, // mapped, written by the CPU every frame (uniforms, staging)
+	GpuToCpu, // mapped, read back by the CPU, cached where possible
+	GpuLazilyAllocated // transient attachments, only backed by memory if the GPU needs to spill them, device local otherwise
+};
+
+struct MemoryAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* mapped = nullptr; // points at offset, null unless the memory is host visible
+	uint32_t memoryTypeIndex = 0;
+	void* block = nullptr; // owning block, null for dedicated allocations
+};
+
+struct AllocatedBuffer
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	MemoryAllocation allocation;
+};
+
+struct AllocatedImage
+{
+	VkImage image = VK_NULL_HANDLE;
+	MemoryAllocation allocation;
+};
+
+struct MemoryUsageStats
+{
+	uint32_t blockCount = 0;
+	uint32_t allocationCount = 0;
+	uint32_t dedicatedAllocationCount = 0;
+	VkDeviceSize reservedBytes = 0; // obtained from the driver
+	VkDeviceSize usedBytes = 0; // handed out to resources
+
+	void add(const MemoryUsageStats& other)
+	{
+		blockCount += other.blockCount;
+		allocationCount += other.allocationCount;
+		dedicatedAllocationCount += other.dedicatedAllocationCount;
+		reservedBytes += other.reservedBytes;
+		usedBytes += other.usedBytes;
+	}
+};
+
+struct MemoryStats
+{
+	std::vector<MemoryUsageStats> memoryTypes; // indexed by memory type index
+	std::vector<MemoryUsageStats> memoryHeaps; // indexed by heap index
+	MemoryUsageStats total;
+	uint32_t overBudgetAllocationCount = 0; // driver allocations that pushed their heap over its budget
+};
+
+struct HeapBudget
+{
+	VkDeviceSize budget = 0; // how much of the heap the process can use before the driver starts paging or failing allocations
+	VkDeviceSize usage = 0; // how much the process uses, including memory that didn't come from the allocator
+};
+
+// Hands out offsets of a circular range in order, and gets them back in the same order.
+// Positions only ever grow, the offset of a position is position % capacity.
+class RingAllocator
+{
+private:
+	VkDeviceSize capacity = 0;
+	VkDeviceSize head = 0; // position of the next allocation
+	VkDeviceSize tail = 0; // position of the oldest allocation still in use
+
+public:
+	void reset(VkDeviceSize capacity)
+	{
+		this->capacity = capacity;
+		head = 0;
+		tail = 0;
+	}
+
+	// returns the offset of the allocation, or nothing if the ring is too full
+	std::optional<VkDeviceSize> allocate(VkDeviceSize size, VkDeviceSize alignment)
+	{
+		VkDeviceSize position = head;
+		VkDeviceSize offset = alignUp(position % capacity, alignment);
+		if (offset + size > capacity) // doesn't fit before the end, skip to the beginning
+		{
+			position += capacity - position % capacity;
+			offset = 0;
+		}
+		position += offset - position % capacity;
+
+		if (size > capacity || position + size - tail > capacity)
+		{
+			return std::nullopt;
+		}
+
+		head = position + size;
+		return offset;
+	}
+
+	// Remember this and pass it to releaseUpTo once everything allocated so far may be reused.
+	VkDeviceSize getMarker() const
+	{
+		return head;
+	}
+
+	void releaseUpTo(VkDeviceSize marker)
+	{
+		tail = std::max(tail, marker);
+	}
+
+	VkDeviceSize getUsedBytes() const
+	{
+		return head - tail;
+	}
+};
+
+// Allocates large VkDeviceMemory blocks per memory type and sub-allocates resources from them,
+// so the number of driver allocations stays far below maxMemoryAllocationCount.
+// Blocks use a first-fit free list that coalesces neighbouring free ranges.
+// Allocations larger than half a block get their own VkDeviceMemory.
+// The budget of every heap is sampled once per frame (VK_EXT_memory_budget) and extrapolated with the allocator's own
+// allocations in between. Empty blocks are given back to the driver when a heap runs over its budget.
+// All methods are thread safe.
+class MemoryAllocator
+{
+public:
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+private:
+	struct Block
+	{
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		void* mapped;
+		uint32_t memoryTypeIndex;
+		ResourceKind kind;
+		std::map<VkDeviceSize, VkDeviceSize> freeRanges; // offset -> size
+		uint32_t allocationCount = 0;
+	};
+
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	VkDeviceSize bufferImageGranularity = 1;
+	VkDeviceSize nonCoherentAtomSize = 1;
+	uint32_t maxMemoryAllocationCount = 0;
+	VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE;
+	uint32_t physicalDeviceCount = 1;
+
+	mutable std::mutex mutex;
+	std::vector<std::unique_ptr<Block>> blocks;
+	std::vector<MemoryUsageStats> typeStats;
+	uint32_t driverAllocationCount = 0;
+
+	bool memoryBudget = false;
+	std::vector<HeapBudget> heapBudgets; // as of the last sample
+	std::vector<VkDeviceSize> sampledReservedBytes; // what the allocator had reserved of every heap at the last sample
+	uint32_t overBudgetAllocationCount = 0;
+
+public:
+	// physicalDeviceCount is the size of the device group the device was created from,
+	// memoryBudget whether VK_EXT_memory_budget is enabled on it
+	void create(VkPhysicalDevice physicalDevice, VkDevice device, const VkPhysicalDeviceLimits& limits, uint32_t physicalDeviceCount = 1,
+		bool memoryBudget = false, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE)
+	{
+		this->physicalDevice = physicalDevice;
+		this->device = device;
+		this->physicalDeviceCount = physicalDeviceCount;
+		this->memoryBudget = memoryBudget;
+		bufferImageGranularity = limits.bufferImageGranularity;
+		nonCoherentAtomSize = limits.nonCoherentAtomSize;
+		maxMemoryAllocationCount = limits.maxMemoryAllocationCount;
+		preferredBlockSize = blockSize;
+
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+		typeStats.assign(memoryProperties.memoryTypeCount, {});
+		updateBudget();
+	}
+
+	void destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const auto& block : blocks)
+		{
+			vkFreeMemory(device, block->memory, nullptr);
+		}
+		blocks.clear();
+		typeStats.assign(memoryProperties.memoryTypeCount, {});
+		driverAllocationCount = 0;
+		overBudgetAllocationCount = 0;
+	}
+
+	const VkPhysicalDeviceMemoryProperties& getMemoryProperties() const
+	{
+		return memoryProperties;
+	}
+
+	MemoryAllocation allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, ResourceKind kind)
+	{
+		const uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, usage);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		const VkDeviceSize blockSize = getBlockSize(memoryTypeIndex);
+		// lazily allocated memory is committed per allocation, a shared block would be committed for all of its attachments
+		const bool lazilyAllocated = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+		if (requirements.size > blockSize / 2 || lazilyAllocated)
+		{
+			if (!lazilyAllocated) // only committed if the gpu spills, which the budget will show
+			{
+				reserveBudget(memoryTypeIndex, requirements.size);
+			}
+			return allocateDedicated(requirements.size, memoryTypeIndex);
+		}
+
+		const ResourceKind blockKind = bufferImageGranularity > 1 ? kind : ResourceKind::Linear; // only segregate when it matters
+		for (const auto& block : blocks)
+		{
+			if (block->memoryTypeIndex == memoryTypeIndex && block->kind == blockKind)
+			{
+				if (auto allocation = allocateFromBlock(*block, requirements))
+				{
+					return *allocation;
+				}
+			}
+		}
+
+		reserveBudget(memoryTypeIndex, blockSize);
+		Block& block = createBlock(memoryTypeIndex, blockKind, blockSize);
+		if (auto allocation = allocateFromBlock(block, requirements))
+		{
+			return *allocation;
+		}
+		throw std::runtime_error("failed to sub-allocate from a new memory block");
+	}
+
+	void free(MemoryAllocation& allocation)
+	{
+		if (allocation.memory == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		MemoryUsageStats& stats = typeStats[allocation.memoryTypeIndex];
+		--stats.allocationCount;
+		stats.usedBytes -= allocation.size;
+
+		if (allocation.block == nullptr)
+		{
+			--stats.dedicatedAllocationCount;
+			stats.reservedBytes -= allocation.size;
+			--driverAllocationCount;
+			vkFreeMemory(device, allocation.memory, nullptr);
+		}
+		else
+		{
+			Block& block = *static_cast<Block*>(allocation.block);
+			releaseRange(block, allocation.offset, allocation.size);
+			--block.allocationCount;
+		}
+
+		allocation = {};
+	}
+
+	AllocatedBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage)
+	{
+		VkBufferCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		createInfo.size = size;
+		createInfo.usage = usage;
+		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		return createBuffer(createInfo, memoryUsage);
+	}
+
+	AllocatedBuffer createBuffer(const VkBufferCreateInfo& createInfo, MemoryUsage memoryUsage)
+	{
+		AllocatedBuffer result;
+		if (vkCreateBuffer(device, &createInfo, nullptr, &result.buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create buffer");
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetBufferMemoryRequirements(device, result.buffer, &requirements);
+
+		try
+		{
+			result.allocation = allocate(requirements, memoryUsage, ResourceKind::Linear);
+		}
+		catch (...)
+		{
+			vkDestroyBuffer(device, result.buffer, nullptr);
+			throw;
+		}
+
+		if (vkBindBufferMemory(device, result.buffer, result.allocation.memory, result.allocation.offset) != VK_SUCCESS)
+		{
+			destroyBuffer(result);
+			throw std::runtime_error("failed to bind buffer memory");
+		}
+		return result;
+	}
+
+	void destroyBuffer(AllocatedBuffer& buffer)
+	{
+		vkDestroyBuffer(device, buffer.buffer, nullptr);
+		free(buffer.allocation);
+		buffer = {};
+	}
+
+	AllocatedImage createImage(const VkImageCreateInfo& createInfo, MemoryUsage memoryUsage)
+	{
+		AllocatedImage result;
+		if (vkCreateImage(device, &createInfo, nullptr, &result.image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create image");
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(device, result.image, &requirements);
+
+		const ResourceKind kind = createInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear;
+		try
+		{
+			result.allocation = allocate(requirements, memoryUsage, kind);
+		}
+		catch (...)
+		{
+			vkDestroyImage(device, result.image, nullptr);
+			throw;
+		}
+
+		if (vkBindImageMemory(device, result.image, result.allocation.memory, result.allocation.offset) != VK_SUCCESS)
+		{
+			destroyImage(result);
+			throw std::runtime_error("failed to bind image memory");
+		}
+		return result;
+	}
+
+	void destroyImage(AllocatedImage& image)
+	{
+		vkDestroyImage(device, image.image, nullptr);
+		free(image.allocation);
+		image = {};
+	}
+
+	// Makes CPU writes visible to the GPU. Only needed for memory types without HOST_COHERENT.
+	void flush(const MemoryAllocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE)
+	{
+		if (isHostCoherent(allocation.memoryTypeIndex))
+		{
+			return;
+		}
+
+		const VkMappedMemoryRange range = makeMappedRange(allocation, offset, size);
+		vkFlushMappedMemoryRanges(device, 1, &range);
+	}
+
+	// Makes GPU writes visible to the CPU. Only needed for memory types without HOST_COHERENT.
+	void invalidate(const MemoryAllocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE)
+	{
+		if (isHostCoherent(allocation.memoryTypeIndex))
+		{
+			return;
+		}
+
+		const VkMappedMemoryRange range = makeMappedRange(allocation, offset, size);
+		vkInvalidateMappedMemoryRanges(device, 1, &range);
+	}
+
+	MemoryStats getStats() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		MemoryStats stats;
+		stats.memoryTypes = typeStats;
+		stats.memoryHeaps.assign(memoryProperties.memoryHeapCount, {});
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+		{
+			stats.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].add(typeStats[i]);
+			stats.total.add(typeStats[i]);
+		}
+		stats.overBudgetAllocationCount = overBudgetAllocationCount;
+		return stats;
+	}
+
+	// Samples the budget and usage of every heap, call once per frame. Without VK_EXT_memory_budget the budget is
+	// taken to be 80% of the heap and the usage is what the allocator has reserved, memory from elsewhere isn't seen.
+	void updateBudget()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		heapBudgets.assign(memoryProperties.memoryHeapCount, {});
+		sampledReservedBytes.assign(memoryProperties.memoryHeapCount, 0);
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+		{
+			sampledReservedBytes[i] = getHeapReservedBytes(i);
+		}
+
+		if (memoryBudget)
+		{
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+			budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+			VkPhysicalDeviceMemoryProperties2 properties{};
+			properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+			properties.pNext = &budgetProperties;
+			vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+			for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+			{
+				heapBudgets[i] = { budgetProperties.heapBudget[i], budgetProperties.heapUsage[i] };
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+			{
+				heapBudgets[i] = { memoryProperties.memoryHeaps[i].size / 10 * 8, sampledReservedBytes[i] };
+			}
+		}
+
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+		{
+			if (heapBudgets[i].usage > heapBudgets[i].budget)
+			{
+				releaseEmptyBlocks(i);
+			}
+		}
+	}
+
+	// indexed by heap index
+	std::vector<HeapBudget> getHeapBudgets() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<HeapBudget> budgets;
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+		{
+			budgets.push_back(getHeapBudget(i));
+		}
+		return budgets;
+	}
+
+	// How much more memory of this type can be allocated without going over the budget of its heap, including
+	// what is still free in the allocator's blocks of the type. Negative when the heap is already over budget.
+	int64_t getAvailableBytes(uint32_t memoryTypeIndex) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const HeapBudget budget = getHeapBudget(memoryProperties.memoryTypes[memoryTypeIndex].heapIndex);
+		const MemoryUsageStats& stats = typeStats[memoryTypeIndex];
+		return static_cast<int64_t>(budget.budget) - static_cast<int64_t>(budget.usage) + static_cast<int64_t>(stats.reservedBytes - stats.usedBytes);
+	}
+
+	uint32_t findMemoryType(uint32_t memoryTypeBits, MemoryUsage usage) const
+	{
+		VkMemoryPropertyFlags required = 0;
+		VkMemoryPropertyFlags preferred = 0;
+		switch (usage)
+		{
+		case MemoryUsage::GpuOnly:
+			preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			break;
+		case MemoryUsage::CpuToGpu:
+			required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+			preferred = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			break;
+		case MemoryUsage::GpuToCpu:
+			required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+			preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+			break;
+		case MemoryUsage::GpuLazilyAllocated:
+			preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+			break;
+		}
+
+		// pick the type that has all required and the most preferred properties, avoiding lazily allocated memory unless asked for
+		std::optional<uint32_t> best;
+		int bestScore = -1;
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+		{
+			const VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+			const bool lazilyAllocated = flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+			if (!(memoryTypeBits & (1u << i)) || (flags & required) != required || (lazilyAllocated && usage != MemoryUsage::GpuLazilyAllocated))
+			{
+				continue;
+			}
+			// on a device group memory of a multi instance heap is replicated on every gpu, and such memory can't be mapped
+			const VkMemoryHeapFlags heapFlags = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].flags;
+			if (physicalDeviceCount > 1 && (required & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && (heapFlags & VK_MEMORY_HEAP_MULTI_INSTANCE_BIT))
+			{
+				continue;
+			}
+
+			int score = 0;
+			for (VkMemoryPropertyFlags bit = 1; bit != 0 && bit <= preferred; bit <<= 1)
+			{
+				if ((preferred & bit) && (flags & bit))
+				{
+					++score;
+				}
+			}
+			if (score > bestScore)
+			{
+				best = i;
+				bestScore = score;
+			}
+		}
+
+		if (!best)
+		{
+			throw std::runtime_error("failed to find a suitable memory type");
+		}
+		return *best;
+	}
+
+private:
+	VkDeviceSize getHeapReservedBytes(uint32_t heapIndex) const
+	{
+		VkDeviceSize reservedBytes = 0;
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+		{
+			if (memoryProperties.memoryTypes[i].heapIndex == heapIndex)
+			{
+				reservedBytes += typeStats[i].reservedBytes;
+			}
+		}
+		return reservedBytes;
+	}
+
+	// the last sample, plus whatever the allocator reserved or gave back since
+	HeapBudget getHeapBudget(uint32_t heapIndex) const
+	{
+		HeapBudget budget = heapBudgets[heapIndex];
+		const VkDeviceSize reservedBytes = getHeapReservedBytes(heapIndex);
+		budget.usage = reservedBytes >= sampledReservedBytes[heapIndex]
+			? budget.usage + (reservedBytes - sampledReservedBytes[heapIndex])
+			: budget.usage - std::min(budget.usage, sampledReservedBytes[heapIndex] - reservedBytes);
+		return budget;
+	}
+
+	// Called before size bytes of memoryTypeIndex are obtained from the driver. If that goes over the budget, empty blocks
+	// of the heap are freed first. The allocation is still attempted when that isn't enough, it may just be slower.
+	void reserveBudget(uint32_t memoryTypeIndex, VkDeviceSize size)
+	{
+		const uint32_t heapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+		HeapBudget budget = getHeapBudget(heapIndex);
+		if (budget.usage + size <= budget.budget)
+		{
+			return;
+		}
+
+		releaseEmptyBlocks(heapIndex);
+		budget = getHeapBudget(heapIndex);
+		if (budget.usage + size > budget.budget)
+		{
+			++overBudgetAllocationCount;
+		}
+	}
+
+	void releaseEmptyBlocks(uint32_t heapIndex)
+	{
+		for (auto block = blocks.begin(); block != blocks.end();)
+		{
+			if ((*block)->allocationCount != 0 || memoryProperties.memoryTypes[(*block)->memoryTypeIndex].heapIndex != heapIndex)
+			{
+				++block;
+				continue;
+			}
+
+			MemoryUsageStats& stats = typeStats[(*block)->memoryTypeIndex];
+			--stats.blockCount;
+			stats.reservedBytes -= (*block)->size;
+			--driverAllocationCount;
+			vkFreeMemory(device, (*block)->memory, nullptr);
+			block = blocks.erase(block);
+		}
+	}
+
+	VkDeviceSize getBlockSize(uint32_t memoryTypeIndex) const
+	{
+		// small heaps (like the 256MB host visible device local one) would be exhausted by a few full size blocks
+		const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+		return std::min(preferredBlockSize, heapSize / 8);
+	}
+
+	bool isHostCoherent(uint32_t memoryTypeIndex) const
+	{
+		return memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	}
+
+	bool isHostVisible(uint32_t memoryTypeIndex) const
+	{
+		return memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	}
+
+	VkMappedMemoryRange makeMappedRange(const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size) const
+	{
+		// flushed ranges have to be aligned to nonCoherentAtomSize, relative to the start of the VkDeviceMemory
+		const VkDeviceSize begin = (allocation.offset + offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+		const VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : allocation.offset + offset + size;
+
+		VkMappedMemoryRange range{};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = allocation.memory;
+		range.offset = begin;
+		range.size = alignUp(end - begin, nonCoherentAtomSize);
+
+		// dedicated allocations are sized exactly, aligning up may run past the end of the memory, which only VK_WHOLE_SIZE may reach
+		const VkDeviceSize memorySize = allocation.block ? static_cast<const Block*>(allocation.block)->size : allocation.size;
+		if (begin + range.size >= memorySize)
+		{
+			range.size = VK_WHOLE_SIZE;
+		}
+		return range;
+	}
+
+	VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void** mapped)
+	{
+		if (driverAllocationCount >= maxMemoryAllocationCount)
+		{
+			throw std::runtime_error("maxMemoryAllocationCount reached");
+		}
+
+		VkMemoryAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocateInfo.allocationSize = size;
+		allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(device, &allocateInfo, nullptr, &memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate device memory");
+		}
+
+		*mapped = nullptr;
+		if (isHostVisible(memoryTypeIndex) && vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+		{
+			vkFreeMemory(device, memory, nullptr);
+			throw std::runtime_error("failed to map device memory");
+		}
+
+		++driverAllocationCount;
+		return memory;
+	}
+
+	MemoryAllocation allocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex)
+	{
+		MemoryAllocation allocation;
+		allocation.memory = allocateDeviceMemory(size, memoryTypeIndex, &allocation.mapped);
+		allocation.size = size;
+		allocation.memoryTypeIndex = memoryTypeIndex;
+
+		MemoryUsageStats& stats = typeStats[memoryTypeIndex];
+		++stats.allocationCount;
+		++stats.dedicatedAllocationCount;
+		stats.reservedBytes += size;
+		stats.usedBytes += size;
+		return allocation;
+	}
+
+	Block& createBlock(uint32_t memoryTypeIndex, ResourceKind kind, VkDeviceSize size)
+	{
+		auto block = std::make_unique<Block>();
+		block->memory = allocateDeviceMemory(size, memoryTypeIndex, &block->mapped);
+		block->size = size;
+		block->memoryTypeIndex = memoryTypeIndex;
+		block->kind = kind;
+		block->freeRanges.emplace(0, size);
+
+		MemoryUsageStats& stats = typeStats[memoryTypeIndex];
+		++stats.blockCount;
+		stats.reservedBytes += size;
+
+		blocks.push_back(std::move(block));
+		return *blocks.back();
+	}
+
+	std::optional<MemoryAllocation> allocateFromBlock(Block& block, const VkMemoryRequirements& requirements)
+	{
+		for (auto range = block.freeRanges.begin(); range != block.freeRanges.end(); ++range)
+		{
+			const VkDeviceSize rangeOffset = range->first;
+			const VkDeviceSize rangeEnd = range->first + range->second;
+			const VkDeviceSize offset = alignUp(rangeOffset, requirements.alignment);
+			if (offset + requirements.size > rangeEnd)
+			{
+				continue;
+			}
+
+			// keep the unused space before and after the allocation free
+			block.freeRanges.erase(range);
+			if (offset > rangeOffset)
+			{
+				block.freeRanges.emplace(rangeOffset, offset - rangeOffset);
+			}
+			if (offset + requirements.size < rangeEnd)
+			{
+				block.freeRanges.emplace(offset + requirements.size, rangeEnd - offset - requirements.size);
+			}
+
+			MemoryAllocation allocation;
+			allocation.memory = block.memory;
+			allocation.offset = offset;
+			allocation.size = requirements.size;
+			allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+			allocation.memoryTypeIndex = block.memoryTypeIndex;
+			allocation.block = &block;
+
+			++block.allocationCount;
+			MemoryUsageStats& stats = typeStats[block.memoryTypeIndex];
+			++stats.allocationCount;
+			stats.usedBytes += requirements.size;
+			return allocation;
+		}
+
+		return std::nullopt;
+	}
+
+	void releaseRange(Block& block, VkDeviceSize offset, VkDeviceSize size)
+	{
+		auto inserted = block.freeRanges.emplace(offset, size).first;
+
+		// merge with the following range
+		auto next = std::next(inserted);
+		if (next != block.freeRanges.end() && inserted->first + inserted->second == next->first)
+		{
+			inserted->second += next->second;
+			block.freeRanges.erase(next);
+		}
+
+		// merge with the preceding range
+		if (inserted != block.freeRanges.begin())
+		{
+			auto previous = std::prev(inserted);
+			if (previous->first + previous->second == inserted->first)
+			{
+				previous->second += inserted->second;
+				block.freeRanges.erase(inserted);
+			}
+		}
+	}
+};
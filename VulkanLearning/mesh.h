@@ -0,0 +1,125 @@
+#pragma once
+
+#include <volk.h>
+
+#include "memoryAllocator.h"
+#include "uploadEngine.h"
+
+#include <stdexcept>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// Interleaved per-vertex attributes, vertex buffer binding 0
+struct Vertex
+{
+	float position[2];
+	float color[3];
+
+	static constexpr uint32_t BINDING = 0;
+};
+
+// Per-instance attributes, vertex buffer binding 1
+struct MeshInstance
+{
+	float position[2];
+	float scale;
+
+	static constexpr uint32_t BINDING = 1;
+};
+
+inline std::array<VkVertexInputBindingDescription, 2> getMeshBindingDescriptions()
+{
+	std::array<VkVertexInputBindingDescription, 2> bindings{};
+	bindings[0].binding = Vertex::BINDING;
+	bindings[0].stride = sizeof(Vertex);
+	bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	bindings[1].binding = MeshInstance::BINDING;
+	bindings[1].stride = sizeof(MeshInstance);
+	bindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+	return bindings;
+}
+
+// Locations match vertex.vert
+inline std::array<VkVertexInputAttributeDescription, 4> getMeshAttributeDescriptions()
+{
+	std::array<VkVertexInputAttributeDescription, 4> attributes{};
+	attributes[0] = { 0, Vertex::BINDING, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, position) };
+	attributes[1] = { 1, Vertex::BINDING, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color) };
+	attributes[2] = { 2, MeshInstance::BINDING, VK_FORMAT_R32G32_SFLOAT, offsetof(MeshInstance, position) };
+	attributes[3] = { 3, MeshInstance::BINDING, VK_FORMAT_R32_SFLOAT, offsetof(MeshInstance, scale) };
+	return attributes;
+}
+
+// Vertex and index buffer in device local memory. Indices are stored as 16 bit whenever the vertex count allows it.
+class Mesh
+{
+private:
+	MemoryAllocator* allocator = nullptr;
+	AllocatedBuffer vertexBuffer{};
+	AllocatedBuffer indexBuffer{};
+	VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+	uint32_t indexCount = 0;
+
+public:
+	// The data is uploaded through the upload engine, so the mesh is usable by the first frame that waits for uploads.
+	void create(MemoryAllocator& allocator, UploadEngine& uploadEngine, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		if (vertices.empty() || indices.empty())
+		{
+			throw std::runtime_error("a mesh needs vertices and indices");
+		}
+
+		this->allocator = &allocator;
+		indexCount = static_cast<uint32_t>(indices.size());
+		indexType = vertices.size() <= UINT16_MAX + 1 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+		const VkDeviceSize vertexSize = vertices.size() * sizeof(Vertex);
+		vertexBuffer = allocator.createBuffer(vertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly);
+		uploadEngine.uploadBuffer(vertexBuffer.buffer, 0, vertices.data(), vertexSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+		if (indexType == VK_INDEX_TYPE_UINT16)
+		{
+			std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+			uploadIndices(uploadEngine, shortIndices.data(), shortIndices.size() * sizeof(uint16_t));
+		}
+		else
+		{
+			uploadIndices(uploadEngine, indices.data(), indices.size() * sizeof(uint32_t));
+		}
+	}
+
+	void destroy()
+	{
+		allocator->destroyBuffer(vertexBuffer);
+		allocator->destroyBuffer(indexBuffer);
+		vertexBuffer = {};
+		indexBuffer = {};
+	}
+
+	// Binds the vertex buffer to Vertex::BINDING and the index buffer. The instance binding is left to the caller.
+	void bind(VkCommandBuffer commandBuffer) const
+	{
+		const VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, Vertex::BINDING, 1, &vertexBuffer.buffer, &offset);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, indexType);
+	}
+
+	uint32_t getIndexCount() const
+	{
+		return indexCount;
+	}
+
+	VkIndexType getIndexType() const
+	{
+		return indexType;
+	}
+
+private:
+	void uploadIndices(UploadEngine& uploadEngine, const void* data, VkDeviceSize size)
+	{
+		indexBuffer = allocator->createBuffer(size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly);
+		uploadEngine.uploadBuffer(indexBuffer.buffer, 0, data, size, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+	}
+};
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <volk.h>
+
+#include "memoryAllocator.h"
+#include "uploadEngine.h"
+#include "mesh.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+#include <array>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+// Matches Meshlet in meshlet.task and meshlet.mesh. The bounds are in mesh space, an instance moves and scales them.
+struct Meshlet
+{
+	float center[3]; // of the bounding sphere
+	float radius;
+	float coneAxis[3]; // average normal of the triangles, the normals of all of them lie in the cone around it
+	float coneCutoff; // faces away from a viewer in direction v if dot(v, coneAxis) < -coneCutoff, 1 if it never does
+	uint32_t vertexOffset; // into the meshlet vertices
+	uint32_t triangleOffset; // into the meshlet triangles
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+};
+
+// A mesh split into meshlets: small groups of triangles that reference at most MAX_VERTICES vertices, so a mesh
+// shader workgroup transforms each vertex once and the task shader can cull a whole meshlet before that.
+struct MeshletData
+{
+	// the limits glslang compiles meshlet.mesh with, the builder must not exceed them
+	static constexpr uint32_t MAX_VERTICES = 64;
+	static constexpr uint32_t MAX_TRIANGLES = 124;
+
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> vertices; // indices into the mesh's vertices, per meshlet
+	std::vector<uint32_t> triangles; // three 8 bit indices into the meshlet's vertices per triangle, the first in the lowest bits
+};
+
+// The sphere is centred on the bounding box of the vertices, which is close enough to the smallest one for culling.
+inline void computeMeshletBounds(Meshlet& meshlet, const MeshletData& data, const std::vector<Vertex>& vertices)
+{
+	auto position = [&](uint32_t local) {
+		const Vertex& vertex = vertices[data.vertices[meshlet.vertexOffset + local]];
+		return std::array<float, 3>{ vertex.position[0], vertex.position[1], 0 };
+	};
+
+	std::array<float, 3> min = position(0);
+	std::array<float, 3> max = min;
+	for (uint32_t i = 1; i < meshlet.vertexCount; ++i)
+	{
+		const auto p = position(i);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			min[axis] = std::min(min[axis], p[axis]);
+			max[axis] = std::max(max[axis], p[axis]);
+		}
+	}
+
+	float radiusSquared = 0;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		meshlet.center[axis] = (min[axis] + max[axis]) / 2;
+	}
+	for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+	{
+		const auto p = position(i);
+		float distanceSquared = 0;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			distanceSquared += (p[axis] - meshlet.center[axis]) * (p[axis] - meshlet.center[axis]);
+		}
+		radiusSquared = std::max(radiusSquared, distanceSquared);
+	}
+	meshlet.radius = std::sqrt(radiusSquared);
+
+	// Front faces are clockwise on screen, which is a positive z in the cross product of the edges since the view
+	// keeps the orientation of mesh space. Degenerate triangles can't be seen and don't widen the cone.
+	std::vector<std::array<float, 3>> normals;
+	std::array<float, 3> axis{};
+	for (uint32_t i = 0; i < meshlet.triangleCount; ++i)
+	{
+		const uint32_t packed = data.triangles[meshlet.triangleOffset + i];
+		const auto p0 = position(packed & 0xff);
+		const auto p1 = position((packed >> 8) & 0xff);
+		const auto p2 = position((packed >> 16) & 0xff);
+		const std::array<float, 3> e1{ p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		const std::array<float, 3> e2{ p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		std::array<float, 3> normal{ e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length == 0)
+		{
+			continue;
+		}
+		for (int c = 0; c < 3; ++c)
+		{
+			normal[c] /= length;
+			axis[c] += normal[c];
+		}
+		normals.push_back(normal);
+	}
+
+	const float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	meshlet.coneCutoff = 1; // never culled by the cone
+	meshlet.coneAxis[0] = 0;
+	meshlet.coneAxis[1] = 0;
+	meshlet.coneAxis[2] = 1;
+	if (axisLength == 0)
+	{
+		return;
+	}
+
+	// the cosine of the widest angle between a normal and the axis, above 0 the cone is narrower than a half space
+	float minDot = 1;
+	for (const auto& normal : normals)
+	{
+		minDot = std::min(minDot, (normal[0] * axis[0] + normal[1] * axis[1] + normal[2] * axis[2]) / axisLength);
+	}
+	for (int c = 0; c < 3; ++c)
+	{
+		meshlet.coneAxis[c] = axis[c] / axisLength;
+	}
+	if (minDot > 0)
+	{
+		// every normal faces away from v once the angle between v and the axis exceeds 90 degrees plus the widest angle
+		meshlet.coneCutoff = std::sqrt(1 - minDot * minDot);
+	}
+}
+
+// Walks the triangles in index order and starts a new meshlet whenever the next triangle would exceed a limit.
+// Neighbouring triangles of a mesh whose indices are ordered for the vertex cache share most of their vertices,
+// so the meshlets come out compact with few vertices referenced by more than one of them.
+inline MeshletData buildMeshlets(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+	uint32_t maxVertices = MeshletData::MAX_VERTICES, uint32_t maxTriangles = MeshletData::MAX_TRIANGLES)
+{
+	if (indices.size() % 3 != 0)
+	{
+		throw std::runtime_error("meshlets can only be built from triangle lists");
+	}
+	if (maxVertices < 3 || maxVertices > 256 || maxTriangles == 0)
+	{
+		throw std::runtime_error("invalid meshlet limits");
+	}
+
+	MeshletData data;
+	std::unordered_map<uint32_t, uint32_t> localIndices; // of the vertices in the meshlet being built
+
+	auto startMeshlet = [&] {
+		Meshlet meshlet{};
+		meshlet.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+		meshlet.triangleOffset = static_cast<uint32_t>(data.triangles.size());
+		data.meshlets.push_back(meshlet);
+		localIndices.clear();
+	};
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		uint32_t newVertices = 0;
+		for (size_t corner = 0; corner < 3; ++corner)
+		{
+			if (indices[i + corner] >= vertices.size())
+			{
+				throw std::runtime_error("mesh index out of range");
+			}
+			newVertices += localIndices.count(indices[i + corner]) == 0;
+		}
+
+		if (data.meshlets.empty() || data.meshlets.back().vertexCount + newVertices > maxVertices
+			|| data.meshlets.back().triangleCount == maxTriangles)
+		{
+			startMeshlet();
+		}
+
+		Meshlet& meshlet = data.meshlets.back();
+		uint32_t packed = 0;
+		for (size_t corner = 0; corner < 3; ++corner)
+		{
+			auto [local, inserted] = localIndices.try_emplace(indices[i + corner], meshlet.vertexCount);
+			if (inserted)
+			{
+				data.vertices.push_back(indices[i + corner]);
+				++meshlet.vertexCount;
+			}
+			packed |= local->second << (8 * corner);
+		}
+		data.triangles.push_back(packed);
+		++meshlet.triangleCount;
+	}
+
+	for (Meshlet& meshlet : data.meshlets)
+	{
+		computeMeshletBounds(meshlet, data, vertices);
+	}
+	return data;
+}
+
+// The vertices and meshlets of a mesh in storage buffers, read by the task and mesh shaders through bindless slots.
+class MeshletMesh
+{
+private:
+	MemoryAllocator* allocator = nullptr;
+	AllocatedBuffer vertexBuffer{};
+	AllocatedBuffer meshletBuffer{};
+	AllocatedBuffer meshletVertexBuffer{};
+	AllocatedBuffer meshletTriangleBuffer{};
+	uint32_t meshletCount = 0;
+	uint32_t triangleCount = 0;
+
+public:
+	// Uploaded through the upload engine like Mesh, dstStages are the shader stages that read the buffers.
+	void create(MemoryAllocator& allocator, UploadEngine& uploadEngine, const std::vector<Vertex>& vertices,
+		const MeshletData& data, VkPipelineStageFlags dstStages)
+	{
+		if (vertices.empty() || data.meshlets.empty())
+		{
+			throw std::runtime_error("a meshlet mesh needs vertices and meshlets");
+		}
+
+		this->allocator = &allocator;
+		meshletCount = static_cast<uint32_t>(data.meshlets.size());
+		triangleCount = static_cast<uint32_t>(data.triangles.size());
+		vertexBuffer = createBuffer(uploadEngine, vertices.data(), vertices.size() * sizeof(Vertex), dstStages);
+		meshletBuffer = createBuffer(uploadEngine, data.meshlets.data(), data.meshlets.size() * sizeof(Meshlet), dstStages);
+		meshletVertexBuffer = createBuffer(uploadEngine, data.vertices.data(), data.vertices.size() * sizeof(uint32_t), dstStages);
+		meshletTriangleBuffer = createBuffer(uploadEngine, data.triangles.data(), data.triangles.size() * sizeof(uint32_t), dstStages);
+	}
+
+	void destroy()
+	{
+		if (allocator == nullptr)
+		{
+			return;
+		}
+		allocator->destroyBuffer(vertexBuffer);
+		allocator->destroyBuffer(meshletBuffer);
+		allocator->destroyBuffer(meshletVertexBuffer);
+		allocator->destroyBuffer(meshletTriangleBuffer);
+		vertexBuffer = {};
+		meshletBuffer = {};
+		meshletVertexBuffer = {};
+		meshletTriangleBuffer = {};
+		allocator = nullptr;
+	}
+
+	VkBuffer getVertexBuffer() const
+	{
+		return vertexBuffer.buffer;
+	}
+
+	VkBuffer getMeshletBuffer() const
+	{
+		return meshletBuffer.buffer;
+	}
+
+	VkBuffer getMeshletVertexBuffer() const
+	{
+		return meshletVertexBuffer.buffer;
+	}
+
+	VkBuffer getMeshletTriangleBuffer() const
+	{
+		return meshletTriangleBuffer.buffer;
+	}
+
+	uint32_t getMeshletCount() const
+	{
+		return meshletCount;
+	}
+
+	uint32_t getTriangleCount() const
+	{
+		return triangleCount;
+	}
+
+private:
+	AllocatedBuffer createBuffer(UploadEngine& uploadEngine, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStages)
+	{
+		AllocatedBuffer buffer = allocator->createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly);
+		uploadEngine.uploadBuffer(buffer.buffer, 0, data, size, dstStages, VK_ACCESS_SHADER_READ_BIT);
+		return buffer;
+	}
+};
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <volk.h>
+
+#include "memoryAllocator.h"
+
+#include <stdexcept>
+#include <functional>
+#include <optional>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+// A rendered frame in host memory. pixels is only valid during the sink call.
+struct ReadbackFrame
+{
+	uint64_t frameNumber;
+	VkExtent2D extent;
+	VkFormat format;
+	uint32_t bytesPerPixel;
+	uint32_t rowPitch; // bytes
+	const uint8_t* pixels;
+};
+
+using ReadbackSink = std::function<void(const ReadbackFrame&)>;
+
+// Copies rendered frames into a ring of host visible buffers, one per frame in flight, without ever waiting for the GPU.
+// The copy is recorded at the end of the frame's own commands, so the frame's fence covers it. Once the fence
+// has signaled for the frame that reuses the slot, frame N - slotCount is handed to the sink.
+class ReadbackRing
+{
+private:
+	struct Slot
+	{
+		AllocatedBuffer buffer;
+		std::optional<uint64_t> pendingFrame; // copied into this slot, not yet collected
+	};
+
+	MemoryAllocator* allocator = nullptr;
+	VkExtent2D extent{};
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t bytesPerPixel = 0;
+	std::vector<Slot> slots;
+	ReadbackSink sink;
+	uint64_t collectedFrameCount = 0;
+
+public:
+	void create(MemoryAllocator& allocator, VkExtent2D extent, VkFormat format, uint32_t bytesPerPixel, size_t slotCount)
+	{
+		this->allocator = &allocator;
+		this->extent = extent;
+		this->format = format;
+		this->bytesPerPixel = bytesPerPixel;
+		collectedFrameCount = 0;
+
+		const VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * bytesPerPixel;
+		slots.resize(slotCount);
+		for (Slot& slot : slots)
+		{
+			slot.buffer = allocator.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuToCpu);
+			if (!slot.buffer.allocation.mapped)
+			{
+				throw std::runtime_error("readback memory isn't host visible");
+			}
+		}
+	}
+
+	void destroy()
+	{
+		for (Slot& slot : slots)
+		{
+			allocator->destroyBuffer(slot.buffer);
+		}
+		slots.clear();
+	}
+
+	void setSink(ReadbackSink sink)
+	{
+		this->sink = std::move(sink);
+	}
+
+	// The image has to be in TRANSFER_SRC_OPTIMAL and the buffer of the slot isn't synchronized, see RenderGraph.
+	void recordCopy(VkCommandBuffer commandBuffer, VkImage image, size_t slot) const
+	{
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0; // tightly packed
+		region.bufferImageHeight = 0;
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { extent.width, extent.height, 1 };
+		vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slots[slot].buffer.buffer, 1, &region);
+	}
+
+	// Call once the commands with the copy into slot were submitted.
+	void markSubmitted(size_t slot, uint64_t frameNumber)
+	{
+		slots[slot].pendingFrame = frameNumber;
+	}
+
+	// Hands the frame in slot to the sink, if there is one. Only call once the fence of the copy has signaled.
+	void collect(size_t slot)
+	{
+		Slot& entry = slots[slot];
+		if (!entry.pendingFrame)
+		{
+			return;
+		}
+
+		allocator->invalidate(entry.buffer.allocation);
+		if (sink)
+		{
+			ReadbackFrame frame{};
+			frame.frameNumber = *entry.pendingFrame;
+			frame.extent = extent;
+			frame.format = format;
+			frame.bytesPerPixel = bytesPerPixel;
+			frame.rowPitch = extent.width * bytesPerPixel;
+			frame.pixels = static_cast<const uint8_t*>(entry.buffer.allocation.mapped);
+			sink(frame);
+		}
+		entry.pendingFrame.reset();
+		++collectedFrameCount;
+	}
+
+	VkBuffer getBuffer(size_t slot) const
+	{
+		return slots[slot].buffer.buffer;
+	}
+
+	uint64_t getCollectedFrameCount() const
+	{
+		return collectedFrameCount;
+	}
+};
+
+// A readback sink that writes every frame as a binary PPM into a directory. The files are written by a background thread,
+// the sink only copies the pixels. If the disk can't keep up, the sink blocks once MAX_QUEUED_FRAMES are waiting.
+// Expects 8 bit RGBA frames, alpha is dropped.
+class FrameFileWriter
+{
+public:
+	static constexpr size_t MAX_QUEUED_FRAMES = 8;
+
+private:
+	struct QueuedFrame
+	{
+		uint64_t frameNumber = 0;
+		VkExtent2D extent{};
+		std::vector<uint8_t> rgb;
+	};
+
+	std::filesystem::path directory;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<QueuedFrame> queue;
+	bool stopping = false;
+	std::string error; // of the writer thread, rethrown by the next write or stop
+
+public:
+	~FrameFileWriter()
+	{
+		stopWriter();
+	}
+
+	void start(const std::string& directory)
+	{
+		this->directory = directory;
+		std::filesystem::create_directories(this->directory);
+		stopping = false;
+		writer = std::thread(&FrameFileWriter::writeLoop, this);
+	}
+
+	// Writes what is still queued.
+	void stop()
+	{
+		stopWriter();
+		if (!error.empty())
+		{
+			throw std::runtime_error(error);
+		}
+	}
+
+	void write(const ReadbackFrame& frame)
+	{
+		if (frame.format != VK_FORMAT_R8G8B8A8_UNORM && frame.format != VK_FORMAT_R8G8B8A8_SRGB)
+		{
+			throw std::runtime_error("frame file writer only supports 8 bit rgba frames");
+		}
+
+		QueuedFrame queued;
+		queued.frameNumber = frame.frameNumber;
+		queued.extent = frame.extent;
+		queued.rgb.resize(static_cast<size_t>(frame.extent.width) * frame.extent.height * 3);
+		uint8_t* out = queued.rgb.data();
+		for (uint32_t y = 0; y < frame.extent.height; ++y)
+		{
+			const uint8_t* in = frame.pixels + static_cast<size_t>(y) * frame.rowPitch;
+			for (uint32_t x = 0; x < frame.extent.width; ++x, in += 4, out += 3)
+			{
+				out[0] = in[0];
+				out[1] = in[1];
+				out[2] = in[2];
+			}
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return queue.size() < MAX_QUEUED_FRAMES || !error.empty(); });
+		if (!error.empty())
+		{
+			throw std::runtime_error(error);
+		}
+		queue.push_back(std::move(queued));
+		changed.notify_all();
+	}
+
+private:
+	void stopWriter()
+	{
+		if (!writer.joinable())
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		changed.notify_all();
+		writer.join();
+	}
+
+	void writeLoop()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			changed.wait(lock, [this] { return !queue.empty() || stopping; });
+			if (queue.empty())
+			{
+				return;
+			}
+
+			QueuedFrame frame = std::move(queue.front());
+			queue.pop_front();
+			changed.notify_all();
+
+			lock.unlock();
+			const bool written = writeFile(frame);
+			lock.lock();
+
+			if (!written)
+			{
+				error = "failed to write frame " + std::to_string(frame.frameNumber) + " to " + directory.string();
+				queue.clear();
+				changed.notify_all();
+				return;
+			}
+		}
+	}
+
+	bool writeFile(const QueuedFrame& frame) const
+	{
+		std::ostringstream name;
+		name << "frame_" << std::setw(6) << std::setfill('0') << frame.frameNumber << ".ppm";
+
+		std::ofstream file(directory / name.str(), std::ios::binary);
+		file << "P6\n" << frame.extent.width << ' ' << frame.extent.height << "\n255\n";
+		file.write(reinterpret_cast<const char*>(frame.rgb.data()), frame.rgb.size());
+		return static_cast<bool>(file);
+	}
+};
@@ -0,0 +1,63 @@
+# Packs every compiled shader (*.spv) next to this script into shaders.pack, the archive the app loads its shaders from.
+# The layout is described in shaderArchive.h. The archive is written to a temporary file and then moved over the old one,
+# so the app's hot reload never sees a half written archive.
+$ErrorActionPreference = "Stop"
+
+$magic = 0x4B504853 # "SHPK"
+$version = 1
+$nameSize = 48 # including the terminating zero
+$blobAlignment = 16
+$headerSize = 16
+$entrySize = $nameSize + 8
+
+$shaders = @(Get-ChildItem -Path $PSScriptRoot -Filter *.spv | Sort-Object Name)
+$output = Join-Path $PSScriptRoot "shaders.pack"
+$temporary = "$output.tmp"
+
+function Align([long]$value)
+{
+	return [long]([math]::Ceiling($value / $blobAlignment) * $blobAlignment)
+}
+
+$stream = [System.IO.File]::Create($temporary)
+$writer = New-Object System.IO.BinaryWriter($stream)
+try
+{
+	$writer.Write([uint32]$magic)
+	$writer.Write([uint32]$version)
+	$writer.Write([uint32]$shaders.Count)
+	$writer.Write([uint32]0)
+
+	$offset = Align ($headerSize + $entrySize * $shaders.Count)
+	foreach ($shader in $shaders)
+	{
+		$name = [System.Text.Encoding]::ASCII.GetBytes($shader.Name)
+		if ($name.Length -ge $nameSize)
+		{
+			throw "shader name $($shader.Name) is longer than $($nameSize - 1) characters"
+		}
+		if ($shader.Length % 4 -ne 0)
+		{
+			throw "$($shader.Name) is not SPIR-V, its size isn't a multiple of 4"
+		}
+
+		$writer.Write($name)
+		$writer.Write((New-Object byte[] ($nameSize - $name.Length)))
+		$writer.Write([uint32]$offset)
+		$writer.Write([uint32]$shader.Length)
+		$offset = Align ($offset + $shader.Length)
+	}
+
+	foreach ($shader in $shaders)
+	{
+		$writer.Write((New-Object byte[] ((Align $stream.Position) - $stream.Position)))
+		$writer.Write([System.IO.File]::ReadAllBytes($shader.FullName))
+	}
+}
+finally
+{
+	$writer.Close()
+}
+
+Move-Item -Force $temporary $output
+Write-Host "packed $($shaders.Count) shaders into $output"
\ No newline at end of file
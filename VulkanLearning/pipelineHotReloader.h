@@ -0,0 +1,187 @@
+#pragma once
+
+#include <volk.h>
+
+#include "timelineSemaphore.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <functional>
+#include <filesystem>
+#include <optional>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+// Rebuilds a pipeline on a background thread whenever one of its shader files changes.
+// The files are polled for a new modification time, which must stay the same for one more poll before the rebuild starts,
+// so a compiler that is still writing them isn't read half way. The rebuilt pipeline is only handed out at a frame boundary
+// and the one it replaces is queued for destruction once the last frame that could have used it has retired.
+class PipelineHotReloader
+{
+public:
+	using Builder = std::function<VkPipeline()>; // called on the background thread, may throw to keep the current pipeline
+
+	static constexpr auto POLL_INTERVAL = std::chrono::milliseconds(250);
+
+private:
+	struct WatchedFile
+	{
+		std::filesystem::path path;
+		std::filesystem::file_time_type lastWriteTime;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	std::string name;
+	Builder builder;
+
+	std::vector<WatchedFile> files;
+	std::thread watcher;
+	std::mutex mutex;
+	std::condition_variable stopRequested;
+	bool stopping = false;
+	VkPipeline rebuiltPipeline = VK_NULL_HANDLE; // guarded by mutex
+
+public:
+	// The builder must only use thread safe objects, like a pipeline cache created without the externally synchronized flag.
+	void start(VkDevice device, const std::string& name, const std::vector<std::filesystem::path>& paths, Builder builder)
+	{
+		this->device = device;
+		this->name = name;
+		this->builder = std::move(builder);
+
+		files.clear();
+		for (const auto& path : paths)
+		{
+			files.push_back({ path, getLastWriteTime(path) });
+		}
+
+		stopping = false;
+		watcher = std::thread(&PipelineHotReloader::watchLoop, this);
+	}
+
+	// Destroys the rebuilt pipeline if it was never handed out, the device must be idle.
+	void stop()
+	{
+		if (!watcher.joinable())
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		stopRequested.notify_one();
+		watcher.join();
+
+		if (rebuiltPipeline != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(device, rebuiltPipeline, nullptr);
+			rebuiltPipeline = VK_NULL_HANDLE;
+		}
+	}
+
+	// Call once per frame, before anything of the frame is recorded. Replaces pipeline with the rebuilt one if there is one
+	// and queues the old one for destruction after lastUsingFrame, the number of the latest frame that could use it.
+	// Returns true if it did.
+	bool swapAtFrameBoundary(VkPipeline& pipeline, RetirementQueue& retirement, uint64_t lastUsingFrame)
+	{
+		VkPipeline rebuilt;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			rebuilt = rebuiltPipeline;
+			rebuiltPipeline = VK_NULL_HANDLE;
+		}
+		if (rebuilt == VK_NULL_HANDLE)
+		{
+			return false;
+		}
+
+		retirement.push(lastUsingFrame, [device = device, retired = pipeline] { vkDestroyPipeline(device, retired, nullptr); });
+		pipeline = rebuilt;
+		return true;
+	}
+
+private:
+	static std::optional<std::filesystem::file_time_type> tryGetLastWriteTime(const std::filesystem::path& path)
+	{
+		std::error_code error;
+		auto time = std::filesystem::last_write_time(path, error);
+		if (error)
+		{
+			return std::nullopt; // e.g. deleted while the compiler replaces it
+		}
+		return time;
+	}
+
+	static std::filesystem::file_time_type getLastWriteTime(const std::filesystem::path& path)
+	{
+		return tryGetLastWriteTime(path).value_or(std::filesystem::file_time_type::min());
+	}
+
+	void watchLoop()
+	{
+		bool changeSeen = false;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!stopRequested.wait_for(lock, POLL_INTERVAL, [this] { return stopping; }))
+		{
+			lock.unlock();
+
+			bool changed = false;
+			bool missing = false;
+			for (auto& file : files)
+			{
+				const auto time = tryGetLastWriteTime(file.path);
+				if (!time)
+				{
+					missing = true;
+				}
+				else if (*time != file.lastWriteTime)
+				{
+					file.lastWriteTime = *time;
+					changed = true;
+				}
+			}
+
+			// rebuild one poll after the last change, once all files exist again
+			if (changeSeen && !changed && !missing)
+			{
+				changeSeen = false;
+				rebuild();
+			}
+			else if (changed)
+			{
+				changeSeen = true;
+			}
+
+			lock.lock();
+		}
+	}
+
+	void rebuild()
+	{
+		VkPipeline pipeline;
+		try
+		{
+			pipeline = builder();
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "failed to reload the " << name << " pipeline, keeping the current one: " << e.what() << '\n';
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (rebuiltPipeline != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(device, rebuiltPipeline, nullptr); // never handed out, so never used
+		}
+		rebuiltPipeline = pipeline;
+		std::cout << "reloaded the " << name << " pipeline\n";
+	}
+};
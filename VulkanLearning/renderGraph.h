@@ -0,0 +1,790 @@
+#pragma once
+
+#include <volk.h>
+
+#include "memoryAllocator.h"
+
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
+#include <optional>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// How a pass uses a resource. Decides the layout images are transitioned to and what the barriers in front of the pass wait for.
+enum class RenderGraphAccess
+{
+	ColorAttachment, // also resolve attachments
+	DepthAttachment,
+	FragmentSampled,
+	ComputeSampled,
+	FragmentStorageWrite,
+	ComputeStorageRead,
+	ComputeStorageWrite,
+	TransferRead,
+	TransferWrite,
+	IndirectRead,
+	VertexRead,
+	ShadingRateAttachment, // read by the rasterizer to pick the fragment size of every region
+	Present, // only as the final access of an imported image
+	HostRead // only as the final access of an imported resource
+};
+
+struct RenderGraphAccessInfo
+{
+	VkPipelineStageFlags stages;
+	VkAccessFlags access;
+	VkImageLayout layout; // for images
+	VkImageUsageFlags usage; // for images
+};
+
+inline RenderGraphAccessInfo getRenderGraphAccessInfo(RenderGraphAccess access)
+{
+	switch (access)
+	{
+	case RenderGraphAccess::ColorAttachment:
+		return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT };
+	case RenderGraphAccess::DepthAttachment:
+		return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT };
+	case RenderGraphAccess::FragmentSampled:
+		return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT };
+	case RenderGraphAccess::ComputeSampled:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT };
+	case RenderGraphAccess::FragmentStorageWrite:
+		return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+	case RenderGraphAccess::ComputeStorageRead:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+	case RenderGraphAccess::ComputeStorageWrite:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+	case RenderGraphAccess::TransferRead:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT };
+	case RenderGraphAccess::TransferWrite:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT };
+	case RenderGraphAccess::IndirectRead:
+		return { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0 };
+	case RenderGraphAccess::VertexRead:
+		return { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0 };
+	case RenderGraphAccess::ShadingRateAttachment:
+		return { VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR, VK_ACCESS_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR,
+			VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR, VK_IMAGE_USAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR };
+	case RenderGraphAccess::Present:
+		return { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0 };
+	case RenderGraphAccess::HostRead:
+		return { VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, 0 };
+	}
+	throw std::runtime_error("unknown render graph access");
+}
+
+// Passes declare which resources they use and how, the graph derives everything else once in compile():
+//  - passes that don't contribute to an imported resource and have no side effects are culled,
+//  - the barriers and layout transitions in front of every pass (and after the last one) are computed,
+//    so a pass only waits for what it actually depends on,
+//  - transient images are created with the usage their accesses need, and images whose lifetimes don't overlap
+//    share memory. Images that are only ever attachments get lazily allocated memory of their own instead,
+//    on tile based gpus they never need any.
+// Buffers are synchronized with global memory barriers, so the graph needs no handles for them.
+// Imported images are set again before every execute(), like the swapchain image of the frame.
+// A compiled graph is only read while executing, so it serves every frame in flight.
+class RenderGraph
+{
+public:
+	using ResourceId = uint32_t;
+	using PassId = uint32_t;
+
+	struct TransientImageDesc
+	{
+		VkFormat format;
+		VkExtent2D extent;
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	};
+
+	struct ResourceUse
+	{
+		ResourceId resource;
+		RenderGraphAccess access;
+	};
+
+	struct Stats
+	{
+		size_t passCount = 0;
+		size_t culledPassCount = 0;
+		size_t barrierCount = 0; // vkCmdPipelineBarrier calls per execute
+		VkDeviceSize transientBytes = 0; // memory of the aliased transient images
+		VkDeviceSize unaliasedTransientBytes = 0; // what they would need without aliasing
+	};
+
+private:
+	static constexpr uint32_t NO_PASS = UINT32_MAX;
+	static constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+		| VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+	struct Resource
+	{
+		std::string name;
+		bool isImage = false;
+		bool imported = false;
+		TransientImageDesc desc{};
+		VkPipelineStageFlags initialStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT; // of imported resources
+		VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkAccessFlags initialWrites = 0;
+		std::optional<RenderGraphAccess> finalAccess;
+
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		AllocatedImage dedicatedImage; // transient images with memory of their own
+
+		// filled in by compile()
+		uint32_t firstPass = NO_PASS; // indices into compiledPasses
+		uint32_t lastPass = NO_PASS;
+		VkImageUsageFlags usage = 0;
+		VkPipelineStageFlags aliasStages = 0; // everything that touches this image's memory, even in the previous frame
+		VkAccessFlags aliasWrites = 0;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		std::vector<ResourceUse> uses;
+		std::function<void(VkCommandBuffer)> record;
+		bool hasSideEffects;
+	};
+
+	struct ImageBarrier
+	{
+		ResourceId resource;
+		VkAccessFlags srcAccess;
+		VkAccessFlags dstAccess;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+	};
+
+	struct Barrier
+	{
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+		VkAccessFlags memorySrcAccess = 0; // for buffers
+		VkAccessFlags memoryDstAccess = 0;
+		std::vector<ImageBarrier> imageBarriers;
+
+		bool isEmpty() const
+		{
+			return srcStages == 0;
+		}
+	};
+
+	struct CompiledPass
+	{
+		PassId pass;
+		Barrier barrier; // in front of the pass
+	};
+
+	// where a transient image that shares memory with others is bound
+	struct Placement
+	{
+		ResourceId resource = 0;
+		VkMemoryRequirements requirements{};
+		VkDeviceSize offset = 0;
+	};
+
+	// how a resource was last used while computing the barriers
+	struct ResourceState
+	{
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags writeStages = 0;
+		VkAccessFlags writeAccess = 0;
+		VkPipelineStageFlags readStages = 0; // since the last write
+		VkAccessFlags readAccess = 0;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+
+	std::vector<CompiledPass> compiledPasses;
+	Barrier finalBarrier;
+	std::vector<MemoryAllocation> aliasedMemory;
+	Stats stats;
+	bool compiled = false;
+
+	std::vector<VkImageMemoryBarrier> imageBarrierScratch;
+
+public:
+	// The initial stages are the ones whatever produced the image before the graph ran waits in, e.g. the stage the
+	// acquire semaphore is waited for. A final access makes the graph leave the image ready for it.
+	// Initial writes are what those stages wrote and the first pass must see, e.g. when the previous frame on the same
+	// queue wrote the image without a final access.
+	ResourceId importImage(const std::string& name, VkPipelineStageFlags initialStages, VkImageLayout initialLayout,
+		std::optional<RenderGraphAccess> finalAccess = std::nullopt, VkAccessFlags initialWrites = 0)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.isImage = true;
+		resource.imported = true;
+		resource.initialStages = initialStages;
+		resource.initialLayout = initialLayout;
+		resource.initialWrites = initialWrites;
+		resource.finalAccess = finalAccess;
+		return addResource(std::move(resource));
+	}
+
+	// Earlier uses of the buffer have to be synchronized by whoever submitted them.
+	ResourceId importBuffer(const std::string& name, std::optional<RenderGraphAccess> finalAccess = std::nullopt)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.isImage = false;
+		resource.imported = true;
+		resource.finalAccess = finalAccess;
+		return addResource(std::move(resource));
+	}
+
+	// Created by compile() and only valid within the graph, its contents are undefined when its first pass starts.
+	ResourceId createTransientImage(const std::string& name, const TransientImageDesc& desc)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.isImage = true;
+		resource.imported = false;
+		resource.desc = desc;
+		return addResource(std::move(resource));
+	}
+
+	// Passes run in the order they were added. A pass with side effects is never culled.
+	PassId addPass(const std::string& name, const std::vector<ResourceUse>& uses, std::function<void(VkCommandBuffer)> record, bool hasSideEffects = false)
+	{
+		if (compiled)
+		{
+			throw std::runtime_error("render graph pass " + name + " was added after compiling");
+		}
+		for (const ResourceUse& use : uses)
+		{
+			if (use.resource >= resources.size())
+			{
+				throw std::runtime_error("render graph pass " + name + " uses an unknown resource");
+			}
+			if (use.access == RenderGraphAccess::Present || use.access == RenderGraphAccess::HostRead)
+			{
+				throw std::runtime_error("render graph pass " + name + " uses " + resources[use.resource].name + " with a final access");
+			}
+		}
+		passes.push_back({ name, uses, std::move(record), hasSideEffects });
+		return static_cast<PassId>(passes.size() - 1);
+	}
+
+	void compile(VkDevice device, MemoryAllocator& allocator)
+	{
+		this->device = device;
+		this->allocator = &allocator;
+
+		cullPasses();
+		computeLifetimesAndUsage();
+		createTransientImages();
+		computeBarriers();
+		compiled = true;
+	}
+
+	// Destroys the transient images and forgets all passes and resources, so the graph can be built again.
+	void destroy()
+	{
+		for (Resource& resource : resources)
+		{
+			if (resource.imported)
+			{
+				continue;
+			}
+			if (resource.view != VK_NULL_HANDLE)
+			{
+				vkDestroyImageView(device, resource.view, nullptr);
+			}
+			if (resource.dedicatedImage.image != VK_NULL_HANDLE)
+			{
+				allocator->destroyImage(resource.dedicatedImage);
+			}
+			else if (resource.image != VK_NULL_HANDLE)
+			{
+				vkDestroyImage(device, resource.image, nullptr);
+			}
+		}
+		for (MemoryAllocation& memory : aliasedMemory)
+		{
+			allocator->free(memory);
+		}
+
+		resources.clear();
+		passes.clear();
+		compiledPasses.clear();
+		finalBarrier = {};
+		aliasedMemory.clear();
+		stats = {};
+		compiled = false;
+	}
+
+	void setImportedImage(ResourceId id, VkImage image, VkImageView view = VK_NULL_HANDLE)
+	{
+		Resource& resource = resources[id];
+		if (!resource.imported || !resource.isImage)
+		{
+			throw std::runtime_error("render graph resource " + resource.name + " is not an imported image");
+		}
+		resource.image = image;
+		resource.view = view;
+	}
+
+	// VK_NULL_HANDLE for a transient image that was culled with all of its passes
+	VkImage getImage(ResourceId id) const
+	{
+		return resources[id].image;
+	}
+
+	VkImageView getImageView(ResourceId id) const
+	{
+		return resources[id].view;
+	}
+
+	const Stats& getStats() const
+	{
+		return stats;
+	}
+
+	// Records every pass that wasn't culled, with its barriers in front of it.
+	void execute(VkCommandBuffer commandBuffer)
+	{
+		if (!compiled)
+		{
+			throw std::runtime_error("render graph executed before compiling");
+		}
+		for (const CompiledPass& compiledPass : compiledPasses)
+		{
+			recordBarrier(commandBuffer, compiledPass.barrier);
+			passes[compiledPass.pass].record(commandBuffer);
+		}
+		recordBarrier(commandBuffer, finalBarrier);
+	}
+
+private:
+	ResourceId addResource(Resource resource)
+	{
+		if (compiled)
+		{
+			throw std::runtime_error("render graph resource " + resource.name + " was added after compiling");
+		}
+		resources.push_back(std::move(resource));
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	static bool isWrite(RenderGraphAccess access)
+	{
+		return getRenderGraphAccessInfo(access).access & WRITE_ACCESS;
+	}
+
+	static bool isDepthFormat(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	static bool hasStencil(VkFormat format)
+	{
+		return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+	}
+
+	static VkImageAspectFlags getAspectMask(VkFormat format)
+	{
+		if (!isDepthFormat(format))
+		{
+			return VK_IMAGE_ASPECT_COLOR_BIT;
+		}
+		return hasStencil(format) ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT : VK_IMAGE_ASPECT_DEPTH_BIT;
+	}
+
+	// Walks the passes backwards: a pass is needed if it has side effects or writes something a needed pass
+	// or the outside world reads. Everything a needed pass uses becomes needed in turn.
+	void cullPasses()
+	{
+		std::vector<bool> neededResources(resources.size());
+		for (size_t i = 0; i < resources.size(); ++i)
+		{
+			neededResources[i] = resources[i].imported;
+		}
+
+		std::vector<PassId> kept;
+		for (size_t i = passes.size(); i-- > 0;)
+		{
+			const Pass& pass = passes[i];
+			const bool needed = pass.hasSideEffects || std::any_of(pass.uses.begin(), pass.uses.end(),
+				[&](const ResourceUse& use) { return isWrite(use.access) && neededResources[use.resource]; });
+			if (!needed)
+			{
+				continue;
+			}
+			kept.push_back(static_cast<PassId>(i));
+			for (const ResourceUse& use : pass.uses)
+			{
+				neededResources[use.resource] = true;
+			}
+		}
+
+		compiledPasses.clear();
+		for (auto pass = kept.rbegin(); pass != kept.rend(); ++pass)
+		{
+			compiledPasses.push_back({ *pass, {} });
+		}
+		stats.passCount = passes.size();
+		stats.culledPassCount = passes.size() - compiledPasses.size();
+	}
+
+	void computeLifetimesAndUsage()
+	{
+		for (uint32_t i = 0; i < compiledPasses.size(); ++i)
+		{
+			for (const ResourceUse& use : passes[compiledPasses[i].pass].uses)
+			{
+				Resource& resource = resources[use.resource];
+				const RenderGraphAccessInfo info = getRenderGraphAccessInfo(use.access);
+				if (resource.firstPass == NO_PASS)
+				{
+					resource.firstPass = i;
+				}
+				resource.lastPass = i;
+				resource.usage |= info.usage;
+				resource.aliasStages |= info.stages;
+				resource.aliasWrites |= info.access & WRITE_ACCESS;
+			}
+		}
+	}
+
+	bool isUsedTransientImage(const Resource& resource) const
+	{
+		return !resource.imported && resource.isImage && resource.firstPass != NO_PASS;
+	}
+
+	VkImageCreateInfo makeImageCreateInfo(const Resource& resource) const
+	{
+		VkImageCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		createInfo.imageType = VK_IMAGE_TYPE_2D;
+		createInfo.format = resource.desc.format;
+		createInfo.extent = { resource.desc.extent.width, resource.desc.extent.height, 1 };
+		createInfo.mipLevels = 1;
+		createInfo.arrayLayers = 1;
+		createInfo.samples = resource.desc.samples;
+		createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		createInfo.usage = resource.usage;
+		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		return createInfo;
+	}
+
+	// Attachment-only images get lazily allocated memory of their own. The others are placed at the lowest offset
+	// where they don't overlap an image that is alive at the same time, per set of allowed memory types.
+	void createTransientImages()
+	{
+		constexpr VkImageUsageFlags ATTACHMENT_USAGE = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+
+		std::vector<Placement> placements;
+
+		for (ResourceId id = 0; id < resources.size(); ++id)
+		{
+			Resource& resource = resources[id];
+			if (!isUsedTransientImage(resource))
+			{
+				continue;
+			}
+
+			if ((resource.usage & ~ATTACHMENT_USAGE) == 0)
+			{
+				resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+				resource.dedicatedImage = allocator->createImage(makeImageCreateInfo(resource), MemoryUsage::GpuLazilyAllocated);
+				resource.image = resource.dedicatedImage.image;
+			}
+			else
+			{
+				const VkImageCreateInfo createInfo = makeImageCreateInfo(resource);
+				if (vkCreateImage(device, &createInfo, nullptr, &resource.image) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to create render graph image " + resource.name);
+				}
+				Placement placement;
+				placement.resource = id;
+				vkGetImageMemoryRequirements(device, resource.image, &placement.requirements);
+				placements.push_back(placement);
+			}
+			resource.view = createImageView(resource);
+		}
+
+		// big images first leaves the fewest gaps
+		std::sort(placements.begin(), placements.end(), [](const Placement& a, const Placement& b) { return a.requirements.size > b.requirements.size; });
+
+		std::vector<bool> placed(placements.size());
+		for (size_t i = 0; i < placements.size(); ++i)
+		{
+			if (placed[i])
+			{
+				continue;
+			}
+
+			// every image that allows the same memory types goes into one allocation
+			const uint32_t memoryTypeBits = placements[i].requirements.memoryTypeBits;
+			std::vector<size_t> group;
+			VkDeviceSize size = 0;
+			VkDeviceSize alignment = 1;
+			for (size_t j = i; j < placements.size(); ++j)
+			{
+				if (placed[j] || placements[j].requirements.memoryTypeBits != memoryTypeBits)
+				{
+					continue;
+				}
+				placements[j].offset = findAliasingOffset(placements, group, j);
+				group.push_back(j);
+				placed[j] = true;
+				size = std::max(size, placements[j].offset + placements[j].requirements.size);
+				alignment = std::max(alignment, placements[j].requirements.alignment);
+				stats.unaliasedTransientBytes += placements[j].requirements.size;
+			}
+
+			VkMemoryRequirements requirements{};
+			requirements.size = size;
+			requirements.alignment = alignment;
+			requirements.memoryTypeBits = memoryTypeBits;
+			aliasedMemory.push_back(allocator->allocate(requirements, MemoryUsage::GpuOnly, ResourceKind::Optimal));
+			const MemoryAllocation& memory = aliasedMemory.back();
+			stats.transientBytes += size;
+
+			for (size_t member : group)
+			{
+				Resource& resource = resources[placements[member].resource];
+				if (vkBindImageMemory(device, resource.image, memory.memory, memory.offset + placements[member].offset) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to bind memory of render graph image " + resource.name);
+				}
+				// whatever used the memory before the image's first pass has to be done with it, even in the previous frame
+				for (size_t other : group)
+				{
+					if (overlapsInMemory(placements[member], placements[other]))
+					{
+						const Resource& otherResource = resources[placements[other].resource];
+						resource.aliasStages |= otherResource.aliasStages;
+						resource.aliasWrites |= otherResource.aliasWrites;
+					}
+				}
+			}
+		}
+	}
+
+	static bool overlapsInMemory(const Placement& a, const Placement& b)
+	{
+		return a.offset < b.offset + b.requirements.size && b.offset < a.offset + a.requirements.size;
+	}
+
+	bool overlapsInTime(ResourceId a, ResourceId b) const
+	{
+		return resources[a].firstPass <= resources[b].lastPass && resources[b].firstPass <= resources[a].lastPass;
+	}
+
+	// the lowest offset at which the image overlaps no image of the group that is alive at the same time
+	VkDeviceSize findAliasingOffset(const std::vector<Placement>& placements, const std::vector<size_t>& group, size_t index) const
+	{
+		const Placement& candidate = placements[index];
+
+		std::vector<VkDeviceSize> offsets = { 0 };
+		for (size_t member : group)
+		{
+			offsets.push_back(alignUp(placements[member].offset + placements[member].requirements.size, candidate.requirements.alignment));
+		}
+		std::sort(offsets.begin(), offsets.end());
+
+		for (VkDeviceSize offset : offsets)
+		{
+			Placement moved = candidate;
+			moved.offset = offset;
+			const bool fits = std::none_of(group.begin(), group.end(), [&](size_t member) {
+				return overlapsInTime(candidate.resource, placements[member].resource) && overlapsInMemory(moved, placements[member]);
+			});
+			if (fits)
+			{
+				return offset;
+			}
+		}
+		throw std::runtime_error("failed to place render graph image"); // the offset after the last member always fits
+	}
+
+	VkImageView createImageView(const Resource& resource) const
+	{
+		VkImageViewCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		createInfo.image = resource.image;
+		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		createInfo.format = resource.desc.format;
+		createInfo.subresourceRange = { getAspectMask(resource.desc.format), 0, 1, 0, 1 };
+
+		VkImageView view;
+		if (vkCreateImageView(device, &createInfo, nullptr, &view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create view of render graph image " + resource.name);
+		}
+		return view;
+	}
+
+	ResourceState getInitialState(const Resource& resource) const
+	{
+		ResourceState state;
+		if (resource.imported)
+		{
+			// a layout transition has to wait for the stages even if there is nothing to make visible
+			state.layout = resource.initialLayout;
+			state.writeStages = resource.isImage ? resource.initialStages : 0;
+			state.writeAccess = resource.isImage ? resource.initialWrites : 0;
+		}
+		else
+		{
+			state.writeStages = resource.aliasStages;
+			state.writeAccess = resource.aliasWrites;
+		}
+		return state;
+	}
+
+	// Adds what is needed before the resource can be accessed like this to barrier and updates its state.
+	void addTransition(Barrier& barrier, ResourceId id, ResourceState& state, const RenderGraphAccessInfo& next, bool writes) const
+	{
+		const Resource& resource = resources[id];
+		const bool layoutChanges = resource.isImage && next.layout != state.layout;
+
+		VkPipelineStageFlags srcStages;
+		VkAccessFlags srcAccess = state.writeAccess;
+		if (layoutChanges || writes)
+		{
+			// write after read only needs the readers to be done, write after write also needs the writes to be available
+			srcStages = state.writeStages | state.readStages;
+		}
+		else if ((next.stages & ~state.readStages) || (next.access & ~state.readAccess))
+		{
+			srcStages = state.writeStages; // read after write, unless an earlier read already synchronized these stages
+		}
+		else
+		{
+			srcStages = 0;
+		}
+
+		if (srcStages != 0 || layoutChanges)
+		{
+			barrier.srcStages |= srcStages != 0 ? srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+			barrier.dstStages |= next.stages;
+			if (resource.isImage)
+			{
+				barrier.imageBarriers.push_back({ id, srcAccess, next.access, state.layout, next.layout });
+			}
+			else
+			{
+				barrier.memorySrcAccess |= srcAccess;
+				barrier.memoryDstAccess |= next.access;
+			}
+		}
+
+		if (layoutChanges || writes)
+		{
+			// a layout transition is a write as well, which later accesses must not overtake
+			state.writeStages = next.stages;
+			state.writeAccess = next.access & WRITE_ACCESS;
+			state.readStages = 0;
+			state.readAccess = 0;
+			if (resource.isImage)
+			{
+				state.layout = next.layout;
+			}
+			if (!writes)
+			{
+				state.readStages = next.stages;
+				state.readAccess = next.access;
+			}
+		}
+		else
+		{
+			state.readStages |= next.stages;
+			state.readAccess |= next.access;
+		}
+	}
+
+	void computeBarriers()
+	{
+		std::vector<ResourceState> states(resources.size());
+		for (ResourceId id = 0; id < resources.size(); ++id)
+		{
+			states[id] = getInitialState(resources[id]);
+		}
+
+		for (CompiledPass& compiledPass : compiledPasses)
+		{
+			for (const ResourceUse& use : passes[compiledPass.pass].uses)
+			{
+				addTransition(compiledPass.barrier, use.resource, states[use.resource], getRenderGraphAccessInfo(use.access), isWrite(use.access));
+			}
+		}
+
+		for (ResourceId id = 0; id < resources.size(); ++id)
+		{
+			const Resource& resource = resources[id];
+			if (resource.finalAccess && resource.firstPass != NO_PASS)
+			{
+				addTransition(finalBarrier, id, states[id], getRenderGraphAccessInfo(*resource.finalAccess), false);
+			}
+		}
+
+		stats.barrierCount = std::count_if(compiledPasses.begin(), compiledPasses.end(), [](const CompiledPass& pass) { return !pass.barrier.isEmpty(); })
+			+ (finalBarrier.isEmpty() ? 0 : 1);
+	}
+
+	void recordBarrier(VkCommandBuffer commandBuffer, const Barrier& barrier)
+	{
+		if (barrier.isEmpty())
+		{
+			return;
+		}
+
+		imageBarrierScratch.clear();
+		for (const ImageBarrier& imageBarrier : barrier.imageBarriers)
+		{
+			const Resource& resource = resources[imageBarrier.resource];
+			if (resource.image == VK_NULL_HANDLE)
+			{
+				throw std::runtime_error("render graph image " + resource.name + " was never set");
+			}
+
+			VkImageMemoryBarrier vkBarrier{};
+			vkBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			vkBarrier.srcAccessMask = imageBarrier.srcAccess;
+			vkBarrier.dstAccessMask = imageBarrier.dstAccess;
+			vkBarrier.oldLayout = imageBarrier.oldLayout;
+			vkBarrier.newLayout = imageBarrier.newLayout;
+			vkBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			vkBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			vkBarrier.image = resource.image;
+			vkBarrier.subresourceRange = { getAspectMask(resource.desc.format), 0, 1, 0, 1 }; // imported images have no format and are color images
+			imageBarrierScratch.push_back(vkBarrier);
+		}
+
+		VkMemoryBarrier memoryBarrier{};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = barrier.memorySrcAccess;
+		memoryBarrier.dstAccessMask = barrier.memoryDstAccess;
+		const bool hasMemoryBarrier = barrier.memorySrcAccess != 0 || barrier.memoryDstAccess != 0;
+
+		vkCmdPipelineBarrier(commandBuffer, barrier.srcStages, barrier.dstStages, 0,
+			hasMemoryBarrier ? 1 : 0, &memoryBarrier, 0, nullptr,
+			static_cast<uint32_t>(imageBarrierScratch.size()), imageBarrierScratch.data());
+	}
+};
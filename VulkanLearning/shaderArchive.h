@@ -0,0 +1,236 @@
+#pragma once
+
+#ifdef _WIN32
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	ifndef WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+#include <stdexcept>
+#include <optional>
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+// SPIR-V of every shader, packed into one file by packShaders.ps1 and memory mapped as a whole.
+// Layout, all little endian:
+//   header: magic "SHPK", version, entry count, reserved (uint32 each)
+//   index:  per entry a zero padded name, the blob's offset from the start of the file and its size in bytes
+//   blobs:  every offset is a multiple of BLOB_ALIGNMENT, so the code can be handed to vkCreateShaderModule in place
+class ShaderArchive
+{
+public:
+	static constexpr uint32_t MAGIC = 0x4B504853; // "SHPK"
+	static constexpr uint32_t VERSION = 1;
+	static constexpr size_t MAX_NAME_LENGTH = 47;
+	static constexpr uint32_t BLOB_ALIGNMENT = 16;
+
+	// Points into the mapping, valid until the archive is closed
+	struct ShaderCode
+	{
+		const uint32_t* code;
+		size_t size; // in bytes
+	};
+
+private:
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t reserved;
+	};
+
+	struct Entry
+	{
+		char name[MAX_NAME_LENGTH + 1];
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	static_assert(sizeof(Header) == 16 && sizeof(Entry) == 56, "must match packShaders.ps1");
+
+	std::string path;
+	const char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+
+public:
+	ShaderArchive() = default;
+	ShaderArchive(const ShaderArchive&) = delete;
+	ShaderArchive& operator=(const ShaderArchive&) = delete;
+
+	~ShaderArchive()
+	{
+		close();
+	}
+
+	// Maps the archive and checks that its index is consistent, throws if it isn't.
+	void open(const char* archivePath)
+	{
+		close();
+		path = archivePath;
+		map();
+
+		try
+		{
+			validate();
+		}
+		catch (...)
+		{
+			close();
+			throw;
+		}
+	}
+
+	// Unmaps the archive. Replacing the file while it's mapped fails on Windows, so it shouldn't stay open longer than needed.
+	void close()
+	{
+#ifdef _WIN32
+		if (data != nullptr)
+		{
+			UnmapViewOfFile(data);
+		}
+		if (mapping != nullptr)
+		{
+			CloseHandle(mapping);
+			mapping = nullptr;
+		}
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (data != nullptr)
+		{
+			munmap(const_cast<char*>(data), size);
+		}
+#endif
+		data = nullptr;
+		size = 0;
+	}
+
+	std::optional<ShaderCode> find(const char* name) const
+	{
+		if (data == nullptr)
+		{
+			return std::nullopt;
+		}
+
+		const Header& header = getHeader();
+		const Entry* entries = getEntries();
+		for (uint32_t i = 0; i < header.entryCount; ++i)
+		{
+			if (std::strncmp(entries[i].name, name, sizeof(entries[i].name)) == 0)
+			{
+				return ShaderCode{ reinterpret_cast<const uint32_t*>(data + entries[i].offset), entries[i].size };
+			}
+		}
+		return std::nullopt;
+	}
+
+	ShaderCode get(const char* name) const
+	{
+		if (auto code = find(name))
+		{
+			return *code;
+		}
+		throw std::runtime_error("shader " + std::string(name) + " is missing from " + path);
+	}
+
+private:
+	void map()
+	{
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		LARGE_INTEGER fileSize{};
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize))
+		{
+			close();
+			throw std::runtime_error("failed to open shader archive " + path);
+		}
+		size = static_cast<size_t>(fileSize.QuadPart);
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		data = mapping != nullptr ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+		if (data == nullptr)
+		{
+			close();
+			throw std::runtime_error("failed to map shader archive " + path);
+		}
+#else
+		const int file = ::open(path.c_str(), O_RDONLY);
+		struct stat status{};
+		if (file < 0 || fstat(file, &status) != 0)
+		{
+			if (file >= 0)
+			{
+				::close(file);
+			}
+			throw std::runtime_error("failed to open shader archive " + path);
+		}
+		size = static_cast<size_t>(status.st_size);
+
+		void* mapped = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+		::close(file); // the mapping keeps the file alive
+		if (mapped == MAP_FAILED)
+		{
+			size = 0;
+			throw std::runtime_error("failed to map shader archive " + path);
+		}
+		data = static_cast<const char*>(mapped);
+#endif
+	}
+
+	void validate() const
+	{
+		if (size < sizeof(Header) || getHeader().magic != MAGIC)
+		{
+			throw std::runtime_error(path + " is not a shader archive");
+		}
+		const Header& header = getHeader();
+		if (header.version != VERSION)
+		{
+			throw std::runtime_error(path + " has version " + std::to_string(header.version) + ", expected " + std::to_string(VERSION));
+		}
+		if (header.entryCount > (size - sizeof(Header)) / sizeof(Entry))
+		{
+			throw std::runtime_error(path + " is truncated");
+		}
+
+		const Entry* entries = getEntries();
+		for (uint32_t i = 0; i < header.entryCount; ++i)
+		{
+			const Entry& entry = entries[i];
+			if (entry.name[MAX_NAME_LENGTH] != '\0' || entry.offset % BLOB_ALIGNMENT != 0 || entry.size % sizeof(uint32_t) != 0
+				|| entry.offset > size || entry.size > size - entry.offset)
+			{
+				throw std::runtime_error(path + " has a broken index");
+			}
+		}
+	}
+
+	// the mapping is page aligned, so the header and the index are suitably aligned for direct access
+	const Header& getHeader() const
+	{
+		return *reinterpret_cast<const Header*>(data);
+	}
+
+	const Entry* getEntries() const
+	{
+		return reinterpret_cast<const Entry*>(data + sizeof(Header));
+	}
+};
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <volk.h>
+
+#include "memoryAllocator.h"
+#include "uploadEngine.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+
+// What VK_KHR_fragment_shading_rate offers on a gpu. Fragment sizes of 1x1, 1x2, 2x1 and 2x2 are always supported,
+// larger ones are clamped by the implementation to the largest supported size that fits.
+struct FragmentShadingRateSupport
+{
+	bool pipeline = false; // a rate per draw
+	bool attachment = false; // a rate per region of the framebuffer, read from an image
+	bool nonTrivialCombinerOps = false; // min, max and mul, otherwise a rate can only be kept or replaced
+	VkExtent2D minTexelSize{}; // pixels per texel of the attachment, powers of two
+	VkExtent2D maxTexelSize{};
+	VkExtent2D maxFragmentSize{};
+
+	static FragmentShadingRateSupport query(VkPhysicalDevice physicalDevice)
+	{
+		VkPhysicalDeviceFragmentShadingRateFeaturesKHR shadingRateFeatures{};
+		shadingRateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &shadingRateFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+		VkPhysicalDeviceFragmentShadingRatePropertiesKHR shadingRateProperties{};
+		shadingRateProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_PROPERTIES_KHR;
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &shadingRateProperties;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+		FragmentShadingRateSupport support;
+		support.pipeline = shadingRateFeatures.pipelineFragmentShadingRate;
+		support.attachment = shadingRateFeatures.pipelineFragmentShadingRate && shadingRateFeatures.attachmentFragmentShadingRate;
+		support.nonTrivialCombinerOps = shadingRateProperties.fragmentShadingRateNonTrivialCombinerOps;
+		support.minTexelSize = shadingRateProperties.minFragmentShadingRateAttachmentTexelSize;
+		support.maxTexelSize = shadingRateProperties.maxFragmentShadingRateAttachmentTexelSize;
+		support.maxFragmentSize = shadingRateProperties.maxFragmentSize;
+		return support;
+	}
+
+	// chain into the device create info, the attachment rate can't be enabled without the pipeline rate
+	static VkPhysicalDeviceFragmentShadingRateFeaturesKHR getRequiredFeatures(bool attachment)
+	{
+		VkPhysicalDeviceFragmentShadingRateFeaturesKHR features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+		features.pipelineFragmentShadingRate = VK_TRUE;
+		features.attachmentFragmentShadingRate = attachment;
+		return features;
+	}
+
+	// square, as close to preferred as the gpu allows
+	VkExtent2D chooseTexelSize(uint32_t preferred) const
+	{
+		const uint32_t size = std::clamp(preferred, std::max(minTexelSize.width, minTexelSize.height), std::min(maxTexelSize.width, maxTexelSize.height));
+		return { size, size };
+	}
+};
+
+// A fragment size as the value of a shading rate attachment texel: log2 of the width in bits 2-3, of the height in bits 0-1
+inline uint32_t encodeFragmentShadingRate(VkExtent2D fragmentSize)
+{
+	auto log2 = [](uint32_t size) { return size >= 4 ? 2u : size >= 2 ? 1u : 0u; };
+	return (log2(fragmentSize.width) << 2) | log2(fragmentSize.height);
+}
+
+// The shading rate attachment of the main pass and what the pass that writes it reads.
+// At the end of every frame a compute pass measures the luminance contrast of every texel sized tile of the finished
+// image and writes the fragment size the next frame shades that tile with, so flat regions are shaded coarsely.
+// There is one image for all frames in flight: the frames run one after the other on the graphics queue and the
+// render graph orders each frame's read after the previous frame's write.
+class AdaptiveShadingRate
+{
+public:
+	static constexpr VkFormat FORMAT = VK_FORMAT_R8_UINT; // required to support shading rate attachments
+	static constexpr uint32_t PREFERRED_TEXEL_SIZE = 16;
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;
+	VkExtent2D texelSize{};
+	VkSampler sampler = VK_NULL_HANDLE;
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+
+	// recreated with the frame images
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> sets; // one per frame image
+	AllocatedImage image{};
+	VkImageView view = VK_NULL_HANDLE;
+	VkExtent2D extent{};
+
+public:
+	// The set layout matches shadingRate.comp: the finished frame at binding 0, the rates at binding 1.
+	void create(VkDevice device, MemoryAllocator& allocator, VkExtent2D texelSize)
+	{
+		this->device = device;
+		this->allocator = &allocator;
+		this->texelSize = texelSize;
+
+		// the pass only fetches texels, the sampler is never used to filter
+		VkSamplerCreateInfo samplerCreateInfo{};
+		samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+		samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+		samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		if (vkCreateSampler(device, &samplerCreateInfo, nullptr, &sampler) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create shading rate sampler");
+		}
+
+		VkDescriptorSetLayoutBinding bindings[2]{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo{};
+		setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		setLayoutCreateInfo.bindingCount = 2;
+		setLayoutCreateInfo.pBindings = bindings;
+		if (vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &setLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create shading rate descriptor set layout");
+		}
+	}
+
+	void destroy()
+	{
+		destroyTargets();
+		vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+		vkDestroySampler(device, sampler, nullptr);
+		setLayout = VK_NULL_HANDLE;
+		sampler = VK_NULL_HANDLE;
+	}
+
+	// Creates the attachment for frames of frameExtent and a set for every frame image, which must be sampleable.
+	// Until the first frame has measured anything every tile is shaded at full rate, the upload that sets that
+	// leaves the image like the pass that writes it every frame would: in the general layout after a compute write.
+	void createTargets(UploadEngine& uploadEngine, VkExtent2D frameExtent, const std::vector<VkImageView>& frameViews)
+	{
+		extent = { (frameExtent.width + texelSize.width - 1) / texelSize.width, (frameExtent.height + texelSize.height - 1) / texelSize.height };
+
+		VkImageCreateInfo imageCreateInfo{};
+		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = FORMAT;
+		imageCreateInfo.extent = { extent.width, extent.height, 1 };
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		image = allocator->createImage(imageCreateInfo, MemoryUsage::GpuOnly);
+
+		VkImageViewCreateInfo viewCreateInfo{};
+		viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewCreateInfo.image = image.image;
+		viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCreateInfo.format = FORMAT;
+		viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		if (vkCreateImageView(device, &viewCreateInfo, nullptr, &view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create shading rate image view");
+		}
+
+		const std::vector<uint8_t> fullRate(size_t(extent.width) * extent.height, static_cast<uint8_t>(encodeFragmentShadingRate({ 1, 1 })));
+		uploadEngine.uploadImage(image.image, { extent.width, extent.height, 1 }, fullRate.data(), fullRate.size(),
+			VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+		createSets(frameViews);
+	}
+
+	void destroyTargets()
+	{
+		if (descriptorPool != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+			descriptorPool = VK_NULL_HANDLE;
+		}
+		sets.clear();
+		if (view != VK_NULL_HANDLE)
+		{
+			vkDestroyImageView(device, view, nullptr);
+			view = VK_NULL_HANDLE;
+		}
+		if (image.image != VK_NULL_HANDLE)
+		{
+			allocator->destroyImage(image);
+			image = {};
+		}
+	}
+
+	VkDescriptorSetLayout getSetLayout() const
+	{
+		return setLayout;
+	}
+
+	// reads the frame image with this index
+	VkDescriptorSet getSet(size_t frameImageIndex) const
+	{
+		return sets[frameImageIndex];
+	}
+
+	VkImage getImage() const
+	{
+		return image.image;
+	}
+
+	VkImageView getView() const
+	{
+		return view;
+	}
+
+	// in texels
+	VkExtent2D getExtent() const
+	{
+		return extent;
+	}
+
+	VkExtent2D getTexelSize() const
+	{
+		return texelSize;
+	}
+
+private:
+	void createSets(const std::vector<VkImageView>& frameViews)
+	{
+		const uint32_t setCount = static_cast<uint32_t>(frameViews.size());
+		const VkDescriptorPoolSize poolSizes[] = {
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount }
+		};
+
+		VkDescriptorPoolCreateInfo poolCreateInfo{};
+		poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolCreateInfo.maxSets = setCount;
+		poolCreateInfo.poolSizeCount = 2;
+		poolCreateInfo.pPoolSizes = poolSizes;
+		if (vkCreateDescriptorPool(device, &poolCreateInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create shading rate descriptor pool");
+		}
+
+		const std::vector<VkDescriptorSetLayout> setLayouts(setCount, setLayout);
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = descriptorPool;
+		allocateInfo.descriptorSetCount = setCount;
+		allocateInfo.pSetLayouts = setLayouts.data();
+		sets.resize(setCount);
+		if (vkAllocateDescriptorSets(device, &allocateInfo, sets.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate shading rate descriptor sets");
+		}
+
+		for (uint32_t i = 0; i < setCount; ++i)
+		{
+			const VkDescriptorImageInfo frameInfo{ sampler, frameViews[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			const VkDescriptorImageInfo rateInfo{ VK_NULL_HANDLE, view, VK_IMAGE_LAYOUT_GENERAL };
+
+			VkWriteDescriptorSet writes[2]{};
+			writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[0].dstSet = sets[i];
+			writes[0].dstBinding = 0;
+			writes[0].descriptorCount = 1;
+			writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writes[0].pImageInfo = &frameInfo;
+			writes[1] = writes[0];
+			writes[1].dstBinding = 1;
+			writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writes[1].pImageInfo = &rateInfo;
+			vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+		}
+	}
+};
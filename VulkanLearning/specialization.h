@@ -0,0 +1,116 @@
+#pragma once
+
+#include <volk.h>
+
+#include <type_traits>
+#include <array>
+#include <cstring>
+#include <cstdint>
+
+// One specialization constant, declared in GLSL as layout (constant_id = ID) const T name = default;
+// bool constants are stored as VkBool32, like SPIR-V expects.
+template<uint32_t ID, typename T>
+struct SpecializationConstant
+{
+	static_assert(std::is_same_v<T, bool> || std::is_same_v<T, int32_t> || std::is_same_v<T, uint32_t>
+		|| std::is_same_v<T, float> || std::is_same_v<T, double>, "SPIR-V specialization constants are bool, 32 bit integers or floats");
+
+	static constexpr uint32_t id = ID;
+	using Type = T;
+	using StorageType = std::conditional_t<std::is_same_v<T, bool>, VkBool32, T>;
+};
+
+// every value is aligned to its own size
+template<size_t N>
+constexpr std::array<uint32_t, N> computeSpecializationOffsets(const std::array<uint32_t, N>& sizes)
+{
+	std::array<uint32_t, N> offsets{};
+	uint32_t offset = 0;
+	for (size_t i = 0; i < N; ++i)
+	{
+		offset = (offset + sizes[i] - 1) / sizes[i] * sizes[i];
+		offsets[i] = offset;
+		offset += sizes[i];
+	}
+	return offsets;
+}
+
+template<size_t N>
+constexpr std::array<VkSpecializationMapEntry, N> buildSpecializationMapEntries(const std::array<uint32_t, N>& ids,
+	const std::array<uint32_t, N>& offsets, const std::array<uint32_t, N>& sizes)
+{
+	std::array<VkSpecializationMapEntry, N> entries{};
+	for (size_t i = 0; i < N; ++i)
+	{
+		entries[i] = { ids[i], offsets[i], sizes[i] };
+	}
+	return entries;
+}
+
+template<size_t N>
+constexpr bool hasUniqueSpecializationIds(const std::array<uint32_t, N>& ids)
+{
+	for (size_t i = 0; i < N; ++i)
+	{
+		for (size_t j = 0; j < i; ++j)
+		{
+			if (ids[i] == ids[j])
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// The values of a fixed set of specialization constants, laid out at compile time.
+// Different values give different pipelines from the same SPIR-V, and the pipeline cache keys them by these values,
+// so every variant is compiled once and found again on the next run.
+//
+//   using CullConstants = Specialization<SpecializationConstant<0, uint32_t>, SpecializationConstant<1, bool>>;
+//   CullConstants constants{ 64, true };
+//   VkSpecializationInfo info = constants.getInfo();
+template<typename... Constants>
+class Specialization
+{
+public:
+	static constexpr size_t COUNT = sizeof...(Constants);
+
+private:
+	static constexpr std::array<uint32_t, COUNT> SIZES = { sizeof(typename Constants::StorageType)... };
+
+	static constexpr std::array<uint32_t, COUNT> IDS = { Constants::id... };
+	static constexpr std::array<uint32_t, COUNT> OFFSETS = computeSpecializationOffsets(SIZES);
+	static constexpr uint32_t DATA_SIZE = COUNT == 0 ? 0 : OFFSETS[COUNT - 1] + SIZES[COUNT - 1];
+	static constexpr std::array<VkSpecializationMapEntry, COUNT> MAP_ENTRIES = buildSpecializationMapEntries(IDS, OFFSETS, SIZES);
+
+	static_assert(hasUniqueSpecializationIds(IDS), "every specialization constant id may only be used once");
+
+	alignas(8) uint8_t data[DATA_SIZE == 0 ? 1 : DATA_SIZE]{};
+
+public:
+	explicit Specialization(typename Constants::Type... values)
+	{
+		size_t index = 0;
+		(store<Constants>(index++, values), ...);
+	}
+
+	// Points into this object, which has to outlive the pipeline creation that uses it.
+	VkSpecializationInfo getInfo() const
+	{
+		VkSpecializationInfo info{};
+		info.mapEntryCount = static_cast<uint32_t>(COUNT);
+		info.pMapEntries = MAP_ENTRIES.data();
+		info.dataSize = DATA_SIZE;
+		info.pData = data;
+		return info;
+	}
+
+private:
+	template<typename Constant>
+	void store(size_t index, typename Constant::Type value)
+	{
+		const typename Constant::StorageType stored = static_cast<typename Constant::StorageType>(value);
+		std::memcpy(data + OFFSETS[index], &stored, sizeof(stored));
+	}
+};
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "jobSystem.h"
+
+#include <stdexcept>
+#include <functional>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <string>
+
+// Runs the steps of startup as soon as the steps they depend on have finished, independent steps run concurrently
+// on the job system's workers. Steps that have to stay on the main thread (like anything touching the window) are run
+// by the thread calling run(). Every step is timed, so the report shows where startup time goes.
+class StartupGraph
+{
+public:
+	using StepId = size_t;
+
+	enum class Affinity
+	{
+		AnyThread,
+		MainThread
+	};
+
+	struct StepTiming
+	{
+		std::string name;
+		double startMilliseconds = 0; // since run() was called
+		double durationMilliseconds = 0;
+		bool onMainThread = false;
+	};
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Step
+	{
+		std::string name;
+		std::function<void()> work;
+		Affinity affinity;
+		std::vector<StepId> dependents;
+		size_t pendingDependencies = 0;
+	};
+
+	std::vector<Step> steps;
+	std::vector<StepTiming> timings; // in the order the steps finished
+	double totalMilliseconds = 0;
+
+	// only valid during run()
+	std::mutex mutex;
+	std::condition_variable stateChanged;
+	std::deque<StepId> ready[2]; // indexed by Affinity
+	size_t finishedCount = 0;
+	std::exception_ptr error;
+	Clock::time_point runStart;
+
+public:
+	// A step may only depend on steps added before it, which keeps the graph free of cycles.
+	StepId add(const std::string& name, const std::vector<StepId>& dependencies, std::function<void()> work, Affinity affinity = Affinity::AnyThread)
+	{
+		const StepId id = steps.size();
+		for (StepId dependency : dependencies)
+		{
+			if (dependency >= id)
+			{
+				throw std::runtime_error("startup step " + name + " depends on a step that was added after it");
+			}
+			steps[dependency].dependents.push_back(id);
+		}
+		steps.push_back({ name, std::move(work), affinity, {}, dependencies.size() });
+		return id;
+	}
+
+	// Blocks until every step has run, a graph can only be run once. Must be called from the main thread and not from inside a job.
+	// If a step throws, the steps already running are finished, no new ones are started and the exception is rethrown.
+	void run(JobSystem& jobSystem)
+	{
+		runStart = Clock::now();
+		timings.clear();
+		finishedCount = 0;
+		error = nullptr;
+		for (StepId id = 0; id < steps.size(); ++id)
+		{
+			if (steps[id].pendingDependencies == 0)
+			{
+				ready[static_cast<size_t>(steps[id].affinity)].push_back(id);
+			}
+		}
+
+		// parallelFor blocks, so the workers are fed from another thread while this one runs the main thread steps
+		std::exception_ptr workerError;
+		std::thread feeder([&] {
+			try
+			{
+				jobSystem.parallelFor(jobSystem.getWorkerCount(), [this](size_t, size_t) { runSteps(Affinity::AnyThread); });
+			}
+			catch (...)
+			{
+				workerError = std::current_exception();
+			}
+		});
+		runSteps(Affinity::MainThread);
+		feeder.join();
+
+		totalMilliseconds = millisecondsSince(runStart);
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+		if (workerError)
+		{
+			std::rethrow_exception(workerError);
+		}
+	}
+
+	const std::vector<StepTiming>& getTimings() const
+	{
+		return timings;
+	}
+
+	double getTotalMilliseconds() const
+	{
+		return totalMilliseconds;
+	}
+
+	// Step names are identifiers, so they are written without escaping.
+	std::string toJson(double timeToFirstFrameMilliseconds) const
+	{
+		std::ostringstream json;
+		json << std::setprecision(3) << std::fixed;
+		json << "{\n\t\"total_ms\": " << totalMilliseconds << ",\n";
+		json << "\t\"time_to_first_frame_ms\": " << timeToFirstFrameMilliseconds << ",\n";
+		json << "\t\"steps\": [";
+		for (size_t i = 0; i < timings.size(); ++i)
+		{
+			const StepTiming& timing = timings[i];
+			json << (i == 0 ? "\n" : ",\n") << "\t\t{ \"name\": \"" << timing.name << "\""
+				<< ", \"start_ms\": " << timing.startMilliseconds
+				<< ", \"duration_ms\": " << timing.durationMilliseconds
+				<< ", \"thread\": \"" << (timing.onMainThread ? "main" : "worker") << "\" }";
+		}
+		json << "\n\t]\n}\n";
+		return json.str();
+	}
+
+private:
+	static double millisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Runs steps of the given affinity until all steps have finished or one of them failed.
+	void runSteps(Affinity affinity)
+	{
+		std::deque<StepId>& queue = ready[static_cast<size_t>(affinity)];
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			stateChanged.wait(lock, [&] { return !queue.empty() || finishedCount == steps.size() || error; });
+			if (finishedCount == steps.size() || error)
+			{
+				return;
+			}
+
+			const StepId id = queue.front();
+			queue.pop_front();
+			lock.unlock();
+
+			StepTiming timing;
+			timing.name = steps[id].name;
+			timing.onMainThread = affinity == Affinity::MainThread;
+			timing.startMilliseconds = millisecondsSince(runStart);
+			std::exception_ptr stepError;
+			try
+			{
+				steps[id].work();
+			}
+			catch (...)
+			{
+				stepError = std::current_exception();
+			}
+			timing.durationMilliseconds = millisecondsSince(runStart) - timing.startMilliseconds;
+
+			lock.lock();
+			timings.push_back(timing);
+			if (stepError)
+			{
+				if (!error)
+				{
+					error = stepError;
+				}
+			}
+			else
+			{
+				for (StepId dependent : steps[id].dependents)
+				{
+					if (--steps[dependent].pendingDependencies == 0)
+					{
+						ready[static_cast<size_t>(steps[dependent].affinity)].push_back(dependent);
+					}
+				}
+				++finishedCount;
+			}
+			stateChanged.notify_all();
+		}
+	}
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <volk.h>
+
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <deque>
+#include <cstdint>
+
+// A semaphore whose 64 bit counter only grows (VK_KHR_timeline_semaphore). Every submit to the queue it belongs to
+// signals the next value, so a single value says how far the queue has come: the CPU waits for or polls a value
+// instead of a fence per submit, and other queues wait for a value instead of a binary semaphore per submit.
+// Not thread safe, advance on the thread that submits to the queue.
+class TimelineSemaphore
+{
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	uint64_t lastSignalValue = 0; // the value of the latest submit
+	uint64_t completedValue = 0; // the value the counter had at the latest query
+
+public:
+	static bool isSupported(VkPhysicalDevice physicalDevice)
+	{
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+		timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &timelineFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+		return timelineFeatures.timelineSemaphore;
+	}
+
+	// chain into the device create info
+	static VkPhysicalDeviceTimelineSemaphoreFeatures getRequiredFeatures()
+	{
+		VkPhysicalDeviceTimelineSemaphoreFeatures features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		features.timelineSemaphore = VK_TRUE;
+		return features;
+	}
+
+	void create(VkDevice device)
+	{
+		this->device = device;
+		lastSignalValue = 0;
+		completedValue = 0;
+
+		VkSemaphoreTypeCreateInfo typeCreateInfo{};
+		typeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeCreateInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		createInfo.pNext = &typeCreateInfo;
+		if (vkCreateSemaphore(device, &createInfo, nullptr, &semaphore) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timeline semaphore");
+		}
+	}
+
+	void destroy()
+	{
+		vkDestroySemaphore(device, semaphore, nullptr);
+		semaphore = VK_NULL_HANDLE;
+	}
+
+	VkSemaphore get() const
+	{
+		return semaphore;
+	}
+
+	// The value the next submit signals. Only call when that submit is about to happen, the values can't have gaps
+	// as nothing would ever signal the missing ones.
+	uint64_t advance()
+	{
+		return ++lastSignalValue;
+	}
+
+	uint64_t getLastSignalValue() const
+	{
+		return lastSignalValue;
+	}
+
+	// Queries the counter, that doesn't block.
+	uint64_t getCompletedValue()
+	{
+		uint64_t value = 0;
+		if (vkGetSemaphoreCounterValueKHR(device, semaphore, &value) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to query timeline semaphore");
+		}
+		completedValue = std::max(completedValue, value);
+		return completedValue;
+	}
+
+	// Only queries the counter when the latest query hadn't reached value yet.
+	bool isCompleted(uint64_t value)
+	{
+		return value <= completedValue || value <= getCompletedValue();
+	}
+
+	void wait(uint64_t value)
+	{
+		if (value <= completedValue)
+		{
+			return;
+		}
+
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &semaphore;
+		waitInfo.pValues = &value;
+		if (vkWaitSemaphoresKHR(device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to wait for timeline semaphore");
+		}
+		completedValue = value;
+	}
+};
+
+// Destroys objects once the GPU is done with them, in batches. Each object is queued with the value of the timeline
+// (or frame counter) it is last used by, and everything up to the completed value is destroyed in one go,
+// so replacing an object never has to wait for the device to be idle.
+class RetirementQueue
+{
+private:
+	struct Entry
+	{
+		uint64_t value;
+		std::function<void()> destroy;
+	};
+
+	std::deque<Entry> entries; // by value, oldest first
+
+public:
+	// value must not be lower than that of anything queued before
+	void push(uint64_t value, std::function<void()> destroy)
+	{
+		if (!entries.empty() && value < entries.back().value)
+		{
+			throw std::runtime_error("retired objects have to be queued in timeline order");
+		}
+		entries.push_back({ value, std::move(destroy) });
+	}
+
+	// Destroys everything last used up to completedValue, returns how many objects that were.
+	size_t collect(uint64_t completedValue)
+	{
+		size_t count = 0;
+		while (!entries.empty() && entries.front().value <= completedValue)
+		{
+			entries.front().destroy();
+			entries.pop_front();
+			++count;
+		}
+		return count;
+	}
+
+	// The device must be idle.
+	void flush()
+	{
+		collect(UINT64_MAX);
+	}
+
+	size_t size() const
+	{
+		return entries.size();
+	}
+};
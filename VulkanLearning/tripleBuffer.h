@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+
+// Hands the latest value from one producer thread to one consumer thread without locks. There are three slots: the
+// producer writes one, the consumer reads another, and the third holds the latest published value. Publishing and
+// acquiring each swap a slot with the third one in a single atomic exchange, so neither side ever waits for the other
+// and the consumer skips values it was too slow for. The waits are only for pacing, they block on the atomics.
+template<typename T>
+class TripleBuffer
+{
+private:
+	static constexpr uint32_t INDEX_MASK = 3;
+	static constexpr uint32_t FRESH = 4; // set while the latest slot holds a value the consumer hasn't acquired
+
+	struct Slot
+	{
+		T value{};
+		uint64_t sequence = 0; // of the publish that wrote value
+	};
+
+	static constexpr uint64_t ABANDONED = UINT64_MAX;
+
+	std::array<Slot, 3> slots;
+	alignas(64) std::atomic<uint32_t> latest{ 1 };
+	alignas(64) uint32_t writeIndex = 0; // only touched by the producer
+	uint64_t writeSequence = 0;
+	alignas(64) uint32_t readIndex = 2; // only touched by the consumer
+	alignas(64) std::atomic<uint64_t> publishedSequence{ 0 };
+	alignas(64) std::atomic<uint64_t> acquiredSequence{ 0 };
+
+public:
+	// Producer: the slot to write the next value into. It holds an older value, overwrite all of it.
+	T& beginWrite()
+	{
+		return slots[writeIndex].value;
+	}
+
+	// Producer: makes the written slot the latest value, returns its sequence number starting at 1.
+	uint64_t publish()
+	{
+		slots[writeIndex].sequence = ++writeSequence;
+		writeIndex = latest.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+		publishedSequence.store(writeSequence, std::memory_order_release);
+		publishedSequence.notify_one();
+		return writeSequence;
+	}
+
+	// Producer: blocks until the consumer has acquired the value with this sequence number or a later one,
+	// or has stopped consuming.
+	void waitForAcquire(uint64_t sequence) const
+	{
+		uint64_t acquired = acquiredSequence.load(std::memory_order_acquire);
+		while (acquired < sequence)
+		{
+			acquiredSequence.wait(acquired, std::memory_order_acquire);
+			acquired = acquiredSequence.load(std::memory_order_acquire);
+		}
+	}
+
+	// Consumer: takes the latest value if it is newer than the one read() returns, returns whether it was.
+	bool acquire()
+	{
+		if ((latest.load(std::memory_order_relaxed) & FRESH) == 0)
+		{
+			return false;
+		}
+
+		readIndex = latest.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+		if (acquiredSequence.load(std::memory_order_relaxed) != ABANDONED)
+		{
+			acquiredSequence.store(slots[readIndex].sequence, std::memory_order_release);
+			acquiredSequence.notify_one();
+		}
+		return true;
+	}
+
+	// Consumer: blocks until a value later than sequence was published.
+	void waitForPublish(uint64_t sequence) const
+	{
+		uint64_t published = publishedSequence.load(std::memory_order_acquire);
+		while (published <= sequence)
+		{
+			publishedSequence.wait(published, std::memory_order_acquire);
+			published = publishedSequence.load(std::memory_order_acquire);
+		}
+	}
+
+	// Consumer: the value acquired last, default constructed before the first.
+	const T& read() const
+	{
+		return slots[readIndex].value;
+	}
+
+	// Consumer: the sequence number of read(), 0 before the first.
+	uint64_t getReadSequence() const
+	{
+		return slots[readIndex].sequence;
+	}
+
+	// Consumer: stops consuming, e.g. when the consumer thread fails. The producer's waits return from now on.
+	void abandon()
+	{
+		acquiredSequence.store(ABANDONED, std::memory_order_release);
+		acquiredSequence.notify_all();
+	}
+};
@@ -0,0 +1,518 @@
+#pragma once
+
+#include <volk.h>
+
+#include "memoryAllocator.h"
+#include "timelineSemaphore.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <optional>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Copies data into device local buffers and images on the transfer queue while the graphics queue keeps rendering.
+// Uploads are written to a persistently mapped staging ring and recorded into the current batch from any thread.
+// Once per frame the batch is submitted, and the graphics queue takes ownership of the resources
+// (queue family ownership transfer) and waits for the batch's semaphore in the frame that first uses them.
+// Given a timeline, every batch signals the next value on it instead of a fence and a binary semaphore of its own.
+class UploadEngine
+{
+public:
+	static constexpr VkDeviceSize DEFAULT_STAGING_SIZE = 64ull * 1024 * 1024;
+
+private:
+	static constexpr VkDeviceSize STAGING_ALIGNMENT = 16; // a multiple of every common texel size and of 4
+
+	struct Batch
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		VkSemaphore semaphore = VK_NULL_HANDLE; // signaled on the transfer queue, waited on by the graphics queue
+		uint64_t timelineValue = 0; // signaled instead of the two above with a timeline
+		VkDeviceSize stagingMarker = 0;
+		std::vector<VkBufferMemoryBarrier> bufferAcquires;
+		std::vector<VkImageMemoryBarrier> imageAcquires;
+		VkPipelineStageFlags dstStages = 0;
+		bool transferDone = false;
+		bool consumed = false; // the acquire barriers were recorded into a frame
+		size_t consumerFrame = 0;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	uint32_t transferFamily = 0;
+	uint32_t graphicsFamily = 0;
+	uint32_t deviceMask = 0; // every gpu of a device group, 0 without one
+	TimelineSemaphore* timeline = nullptr; // guarded by mutex
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+
+	AllocatedBuffer stagingBuffer;
+	RingAllocator stagingRing;
+	VkDeviceSize stagingAlignment = STAGING_ALIGNMENT;
+
+	std::mutex mutex;
+	std::condition_variable batchSubmitted;
+	std::thread::id submittingThread; // the only thread that touches the transfer queue (it may be the graphics queue), see beginFrame
+	Batch recording; // commandBuffer is null until the first upload after a submit
+	std::vector<Batch> inFlight; // submitted, oldest first
+	std::vector<Batch> freeBatches;
+
+	std::vector<VkSemaphore> waitSemaphores;
+	std::vector<VkPipelineStageFlags> waitStages;
+	std::vector<uint64_t> waitValues;
+
+public:
+	// On a device group the uploads have to go through the graphics queue: every gpu runs the copies into its own copy
+	// of the resource, but only one of them can signal the semaphore, so a barrier at the end of each batch orders the
+	// later frames of the other gpus after them. The timeline is owned by the caller, nothing else may signal it.
+	void create(VkDevice device, MemoryAllocator& allocator, VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily,
+		const VkPhysicalDeviceLimits& limits, TimelineSemaphore* timeline = nullptr, uint32_t deviceMask = 0, VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE)
+	{
+		if (deviceMask != 0 && transferFamily != graphicsFamily)
+		{
+			throw std::runtime_error("uploads on a device group have to use the graphics queue");
+		}
+		if (deviceMask != 0 && timeline != nullptr)
+		{
+			throw std::runtime_error("uploads on a device group can't signal a timeline");
+		}
+
+		this->device = device;
+		this->deviceMask = deviceMask;
+		this->timeline = timeline;
+		this->allocator = &allocator;
+		this->transferQueue = transferQueue;
+		this->transferFamily = transferFamily;
+		this->graphicsFamily = graphicsFamily;
+		submittingThread = std::this_thread::get_id();
+		stagingAlignment = std::max(STAGING_ALIGNMENT, limits.optimalBufferCopyOffsetAlignment);
+
+		VkCommandPoolCreateInfo poolCreateInfo{};
+		poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolCreateInfo.queueFamilyIndex = transferFamily;
+		poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		if (vkCreateCommandPool(device, &poolCreateInfo, nullptr, &commandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload command pool");
+		}
+
+		stagingBuffer = allocator.createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CpuToGpu);
+		stagingRing.reset(stagingSize);
+	}
+
+	// The device must be idle.
+	void destroy()
+	{
+		if (recording.commandBuffer != VK_NULL_HANDLE)
+		{
+			inFlight.push_back(std::move(recording));
+			recording = {};
+		}
+		for (auto& batch : inFlight)
+		{
+			freeBatches.push_back(std::move(batch));
+		}
+		inFlight.clear();
+
+		for (const auto& batch : freeBatches)
+		{
+			vkDestroyFence(device, batch.fence, nullptr);
+			vkDestroySemaphore(device, batch.semaphore, nullptr);
+		}
+		freeBatches.clear();
+
+		vkDestroyCommandPool(device, commandPool, nullptr);
+		allocator->destroyBuffer(stagingBuffer);
+	}
+
+	bool needsOwnershipTransfer() const
+	{
+		return transferFamily != graphicsFamily;
+	}
+
+	// Copies data into the buffer. dstStages and dstAccess describe how the graphics queue uses it afterwards.
+	// Uploads larger than half the staging buffer are split, so they never have to wait for the whole ring.
+	void uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+	{
+		const VkDeviceSize maxChunkSize = stagingBuffer.allocation.size / 2;
+		if (size > maxChunkSize)
+		{
+			for (VkDeviceSize chunkOffset = 0; chunkOffset < size; chunkOffset += maxChunkSize)
+			{
+				uploadBuffer(buffer, offset + chunkOffset, static_cast<const char*>(data) + chunkOffset,
+					std::min(maxChunkSize, size - chunkOffset), dstStages, dstAccess);
+			}
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		const VkDeviceSize stagingOffset = stage(lock, data, size);
+
+		VkBufferCopy region{};
+		region.srcOffset = stagingOffset;
+		region.dstOffset = offset;
+		region.size = size;
+		vkCmdCopyBuffer(recording.commandBuffer, stagingBuffer.buffer, buffer, 1, &region);
+
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = buffer;
+		barrier.offset = offset;
+		barrier.size = size;
+
+		if (needsOwnershipTransfer())
+		{
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+			vkCmdPipelineBarrier(recording.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+			// the matching acquire on the graphics queue
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = dstAccess;
+			recording.bufferAcquires.push_back(barrier);
+		}
+		// on a single queue family the semaphore alone makes the copy visible
+		recording.dstStages |= dstStages;
+	}
+
+	// Copies tightly packed texels into mip level 0 of a color image and leaves it in finalLayout.
+	// The image's previous contents are discarded.
+	void uploadImage(VkImage image, VkExtent3D extent, const void* data, VkDeviceSize size,
+		VkImageLayout finalLayout, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		const VkDeviceSize stagingOffset = stage(lock, data, size);
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		vkCmdPipelineBarrier(recording.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = stagingOffset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = extent;
+		vkCmdCopyBufferToImage(recording.commandBuffer, stagingBuffer.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+		// the layout transition happens here, and is repeated by the acquire when ownership is transferred
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = finalLayout;
+		if (needsOwnershipTransfer())
+		{
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+		}
+		vkCmdPipelineBarrier(recording.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		if (needsOwnershipTransfer())
+		{
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = dstAccess;
+			recording.imageAcquires.push_back(barrier);
+		}
+		recording.dstStages |= dstStages;
+	}
+
+	// Call once the fence of frameIndex has signaled, from the thread that submits the frames. Until the first call
+	// that's the thread that created the engine. Recycles finished batches and submits the uploads recorded since the last call.
+	void beginFrame(size_t frameIndex)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		submittingThread = std::this_thread::get_id();
+		retireBatches(frameIndex);
+		submitRecording();
+	}
+
+	// Records the acquire side of the ownership transfers of every submitted batch no frame has consumed yet,
+	// and collects the semaphores the frame's submit has to wait on. Must be recorded outside of a render pass.
+	void recordAcquireBarriers(VkCommandBuffer commandBuffer, size_t frameIndex)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		waitSemaphores.clear();
+		waitStages.clear();
+		waitValues.clear();
+
+		for (auto& batch : inFlight)
+		{
+			if (batch.consumed)
+			{
+				continue;
+			}
+
+			batch.consumed = true;
+			batch.consumerFrame = frameIndex;
+			if (timeline != nullptr && !waitSemaphores.empty())
+			{
+				// reaching the later value means the earlier batches are done as well
+				waitStages.back() |= batch.dstStages;
+				waitValues.back() = batch.timelineValue;
+			}
+			else
+			{
+				waitSemaphores.push_back(timeline != nullptr ? timeline->get() : batch.semaphore);
+				waitStages.push_back(batch.dstStages);
+				waitValues.push_back(batch.timelineValue);
+			}
+
+			if (!batch.bufferAcquires.empty() || !batch.imageAcquires.empty())
+			{
+				vkCmdPipelineBarrier(commandBuffer, batch.dstStages, batch.dstStages, 0, 0, nullptr,
+					batch.bufferAcquires.size(), batch.bufferAcquires.data(),
+					batch.imageAcquires.size(), batch.imageAcquires.data());
+			}
+		}
+	}
+
+	// valid until the next call to recordAcquireBarriers
+	const std::vector<VkSemaphore>& getWaitSemaphores() const
+	{
+		return waitSemaphores;
+	}
+
+	const std::vector<VkPipelineStageFlags>& getWaitStages() const
+	{
+		return waitStages;
+	}
+
+	// for a VkTimelineSemaphoreSubmitInfo, 0 for the binary semaphores
+	const std::vector<uint64_t>& getWaitValues() const
+	{
+		return waitValues;
+	}
+
+private:
+	// copies data into the staging ring and makes sure a batch is being recorded
+	VkDeviceSize stage(std::unique_lock<std::mutex>& lock, const void* data, VkDeviceSize size)
+	{
+		if (size > stagingBuffer.allocation.size)
+		{
+			throw std::runtime_error("upload is larger than the staging buffer");
+		}
+
+		std::optional<VkDeviceSize> offset = stagingRing.allocate(size, stagingAlignment);
+		while (!offset)
+		{
+			waitForOldestBatch(lock);
+			offset = stagingRing.allocate(size, stagingAlignment);
+		}
+
+		std::memcpy(static_cast<char*>(stagingBuffer.allocation.mapped) + *offset, data, size);
+		allocator->flush(stagingBuffer.allocation, *offset, size);
+
+		if (recording.commandBuffer == VK_NULL_HANDLE)
+		{
+			beginRecording();
+		}
+		return *offset;
+	}
+
+	// Frees up staging space when the ring is full. If the staging space is all used by the batch being recorded,
+	// it is submitted right away on the submitting thread, other threads wait for the next beginFrame to submit it.
+	void waitForOldestBatch(std::unique_lock<std::mutex>& lock)
+	{
+		auto isPending = [](const Batch& batch) { return !batch.transferDone; };
+		auto pending = std::find_if(inFlight.begin(), inFlight.end(), isPending);
+		while (pending == inFlight.end())
+		{
+			if (recording.commandBuffer == VK_NULL_HANDLE)
+			{
+				throw std::runtime_error("staging buffer is full but no upload is in flight");
+			}
+
+			if (std::this_thread::get_id() == submittingThread)
+			{
+				submitRecording();
+			}
+			else
+			{
+				batchSubmitted.wait(lock);
+			}
+			pending = std::find_if(inFlight.begin(), inFlight.end(), isPending);
+		}
+
+		if (timeline != nullptr)
+		{
+			timeline->wait(pending->timelineValue);
+		}
+		else
+		{
+			vkWaitForFences(device, 1, &pending->fence, VK_TRUE, UINT64_MAX);
+		}
+		pending->transferDone = true;
+		stagingRing.releaseUpTo(pending->stagingMarker);
+	}
+
+	void beginRecording()
+	{
+		if (freeBatches.empty())
+		{
+			recording = createBatch();
+		}
+		else
+		{
+			recording = std::move(freeBatches.back());
+			freeBatches.pop_back();
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(recording.commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin recording upload command buffer");
+		}
+	}
+
+	Batch createBatch()
+	{
+		Batch batch;
+
+		VkCommandBufferAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocateInfo.commandPool = commandPool;
+		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocateInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(device, &allocateInfo, &batch.commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate upload command buffer");
+		}
+
+		if (timeline != nullptr)
+		{
+			return batch;
+		}
+
+		VkFenceCreateInfo fenceCreateInfo{};
+		fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		VkSemaphoreCreateInfo semaphoreCreateInfo{};
+		semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		if (vkCreateFence(device, &fenceCreateInfo, nullptr, &batch.fence) != VK_SUCCESS ||
+			vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &batch.semaphore) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload synchronization objects");
+		}
+		return batch;
+	}
+
+	void submitRecording()
+	{
+		if (recording.commandBuffer == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		if (deviceMask != 0)
+		{
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			vkCmdPipelineBarrier(recording.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		if (vkEndCommandBuffer(recording.commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record upload command buffer");
+		}
+
+		const uint32_t signalDeviceIndex = 0;
+		VkDeviceGroupSubmitInfo deviceGroupSubmitInfo{};
+		deviceGroupSubmitInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO;
+		deviceGroupSubmitInfo.commandBufferCount = 1;
+		deviceGroupSubmitInfo.pCommandBufferDeviceMasks = &deviceMask;
+		deviceGroupSubmitInfo.signalSemaphoreCount = 1;
+		deviceGroupSubmitInfo.pSignalSemaphoreDeviceIndices = &signalDeviceIndex;
+
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+		timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		VkSemaphore signalSemaphore = recording.semaphore;
+		if (timeline != nullptr)
+		{
+			recording.timelineValue = timeline->advance();
+			timelineSubmitInfo.signalSemaphoreValueCount = 1;
+			timelineSubmitInfo.pSignalSemaphoreValues = &recording.timelineValue;
+			signalSemaphore = timeline->get();
+		}
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = deviceMask != 0 ? static_cast<const void*>(&deviceGroupSubmitInfo) : timeline != nullptr ? &timelineSubmitInfo : nullptr;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &recording.commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &signalSemaphore;
+		if (vkQueueSubmit(transferQueue, 1, &submitInfo, recording.fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit upload command buffer");
+		}
+
+		recording.stagingMarker = stagingRing.getMarker();
+		if (recording.dstStages == 0)
+		{
+			recording.dstStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		}
+		inFlight.push_back(std::move(recording));
+		recording = {};
+		batchSubmitted.notify_all();
+	}
+
+	// A batch can be reused once the transfer queue is done with it and the frame that waited on its semaphore has finished.
+	void retireBatches(size_t finishedFrame)
+	{
+		for (auto batch = inFlight.begin(); batch != inFlight.end();)
+		{
+			if (!batch->transferDone && isTransferDone(*batch))
+			{
+				batch->transferDone = true;
+				stagingRing.releaseUpTo(batch->stagingMarker);
+			}
+
+			if (batch->transferDone && batch->consumed && batch->consumerFrame == finishedFrame)
+			{
+				if (batch->fence != VK_NULL_HANDLE)
+				{
+					vkResetFences(device, 1, &batch->fence);
+				}
+				vkResetCommandBuffer(batch->commandBuffer, 0);
+				batch->bufferAcquires.clear();
+				batch->imageAcquires.clear();
+				batch->dstStages = 0;
+				batch->transferDone = false;
+				batch->consumed = false;
+				freeBatches.push_back(std::move(*batch));
+				batch = inFlight.erase(batch);
+			}
+			else
+			{
+				++batch;
+			}
+		}
+	}
+
+	bool isTransferDone(Batch& batch)
+	{
+		return timeline != nullptr ? timeline->isCompleted(batch.timelineValue) : vkGetFenceStatus(device, batch.fence) == VK_SUCCESS;
+	}
+};
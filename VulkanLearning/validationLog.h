@@ -0,0 +1,310 @@
+#pragma once
+
+#include <volk.h>
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+// Which debug messenger messages are kept. The messenger is created with the same masks, so the layers
+// don't even produce what is filtered out, and the sink can narrow them further at runtime.
+struct ValidationLogFilter
+{
+	VkDebugUtilsMessageSeverityFlagsEXT severities = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+	VkDebugUtilsMessageTypeFlagsEXT types = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
+		| VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
+		| VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+};
+
+// Takes debug messenger messages off the threads that report them. The callback copies a message into a fixed size,
+// lock free ring (any number of producers, one consumer) and returns, a background thread drains the ring and
+// prints in batches. Messages with the same messageIdNumber are printed at most MAX_REPEATS_PER_INTERVAL times
+// per REPEAT_INTERVAL, how many were suppressed is printed once the interval is over.
+// When the ring is full, messages are dropped and counted instead of blocking the driver.
+// Errors skip the ring and are printed right away, so they are on the console when the debugger breaks.
+class ValidationLogSink
+{
+public:
+	static constexpr size_t CAPACITY = 1024; // messages, a power of two
+	static constexpr size_t MAX_MESSAGE_LENGTH = 1024; // longer messages are truncated
+	static constexpr uint32_t MAX_REPEATS_PER_INTERVAL = 3;
+	static constexpr auto REPEAT_INTERVAL = std::chrono::seconds(5);
+	static constexpr auto DRAIN_INTERVAL = std::chrono::milliseconds(20);
+
+	// totals since start, filtered messages aren't counted
+	struct Counters
+	{
+		uint64_t errors = 0;
+		uint64_t warnings = 0;
+		uint64_t performanceWarnings = 0;
+		uint64_t suppressed = 0; // repeats that were not printed
+		uint64_t dropped = 0; // the ring was full
+	};
+
+private:
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "the ring is indexed with a mask");
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Slot
+	{
+		std::atomic<size_t> sequence; // == position when free to write, position + 1 once written
+		VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+		VkDebugUtilsMessageTypeFlagsEXT type;
+		int32_t messageIdNumber;
+		char message[MAX_MESSAGE_LENGTH];
+	};
+
+	struct Repeats
+	{
+		Clock::time_point intervalStart;
+		uint32_t printed = 0;
+		uint64_t suppressed = 0;
+	};
+
+	std::vector<Slot> slots = std::vector<Slot>(CAPACITY);
+	alignas(64) std::atomic<size_t> writePosition{ 0 };
+	alignas(64) size_t readPosition = 0; // only touched by the drain thread
+
+	std::atomic<VkDebugUtilsMessageSeverityFlagsEXT> severities{ 0 };
+	std::atomic<VkDebugUtilsMessageTypeFlagsEXT> types{ 0 };
+
+	std::atomic<uint64_t> errorCount{ 0 };
+	std::atomic<uint64_t> warningCount{ 0 };
+	std::atomic<uint64_t> performanceWarningCount{ 0 };
+	std::atomic<uint64_t> suppressedCount{ 0 };
+	std::atomic<uint64_t> droppedCount{ 0 };
+
+	std::unordered_map<int32_t, Repeats> repeats; // by messageIdNumber, only touched by the drain thread
+
+	std::thread drainThread;
+	std::mutex stopMutex;
+	std::condition_variable stopRequested;
+	bool stopping = false;
+
+public:
+	ValidationLogSink()
+	{
+		for (size_t i = 0; i < CAPACITY; ++i)
+		{
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	~ValidationLogSink()
+	{
+		stop();
+	}
+
+	void start(const ValidationLogFilter& filter)
+	{
+		setFilter(filter);
+		stopping = false;
+		drainThread = std::thread(&ValidationLogSink::drainLoop, this);
+	}
+
+	// Prints what is still queued. Call after the messenger is destroyed.
+	void stop()
+	{
+		if (!drainThread.joinable())
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(stopMutex);
+			stopping = true;
+		}
+		stopRequested.notify_one();
+		drainThread.join();
+	}
+
+	void setFilter(const ValidationLogFilter& filter)
+	{
+		severities.store(filter.severities, std::memory_order_relaxed);
+		types.store(filter.types, std::memory_order_relaxed);
+	}
+
+	// Called from the debug messenger callback, on whichever thread the message is reported.
+	void post(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type, const VkDebugUtilsMessengerCallbackDataEXT& data)
+	{
+		if ((severity & severities.load(std::memory_order_relaxed)) == 0 || (type & types.load(std::memory_order_relaxed)) == 0)
+		{
+			return;
+		}
+		count(severity, type);
+
+		if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+		{
+			std::cerr << "validation layer [error]: " << data.pMessage << std::endl;
+			return;
+		}
+
+		size_t position = writePosition.load(std::memory_order_relaxed);
+		Slot* slot;
+		for (;;)
+		{
+			slot = &slots[position & (CAPACITY - 1)];
+			const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+			const ptrdiff_t difference = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(position);
+			if (difference == 0)
+			{
+				if (writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (difference < 0)
+			{
+				droppedCount.fetch_add(1, std::memory_order_relaxed); // the drain thread hasn't freed this slot yet
+				return;
+			}
+			else
+			{
+				position = writePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		slot->severity = severity;
+		slot->type = type;
+		slot->messageIdNumber = data.messageIdNumber;
+		const char* message = data.pMessage != nullptr ? data.pMessage : "";
+		const size_t length = std::min(std::strlen(message), MAX_MESSAGE_LENGTH - 1);
+		std::memcpy(slot->message, message, length);
+		slot->message[length] = '\0';
+		slot->sequence.store(position + 1, std::memory_order_release);
+	}
+
+	Counters getCounters() const
+	{
+		Counters counters;
+		counters.errors = errorCount.load(std::memory_order_relaxed);
+		counters.warnings = warningCount.load(std::memory_order_relaxed);
+		counters.performanceWarnings = performanceWarningCount.load(std::memory_order_relaxed);
+		counters.suppressed = suppressedCount.load(std::memory_order_relaxed);
+		counters.dropped = droppedCount.load(std::memory_order_relaxed);
+		return counters;
+	}
+
+private:
+	void count(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type)
+	{
+		if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+		{
+			errorCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+		{
+			warningCount.fetch_add(1, std::memory_order_relaxed);
+			if (type & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT)
+			{
+				performanceWarningCount.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void drainLoop()
+	{
+		std::unique_lock<std::mutex> lock(stopMutex);
+		while (!stopping)
+		{
+			stopRequested.wait_for(lock, DRAIN_INTERVAL);
+			drain();
+		}
+		drain();
+
+		std::ostringstream summary;
+		reportIntervals(Clock::time_point::max(), summary);
+		std::cerr << summary.str() << std::flush;
+	}
+
+	void drain()
+	{
+		std::ostringstream batch;
+		const Clock::time_point now = Clock::now();
+		reportIntervals(now, batch);
+
+		for (;;)
+		{
+			Slot& slot = slots[readPosition & (CAPACITY - 1)];
+			if (slot.sequence.load(std::memory_order_acquire) != readPosition + 1)
+			{
+				break;
+			}
+
+			if (shouldPrint(slot.messageIdNumber, now))
+			{
+				batch << "validation layer [" << getSeverityName(slot.severity) << "]: " << slot.message << '\n';
+			}
+
+			slot.sequence.store(readPosition + CAPACITY, std::memory_order_release);
+			++readPosition;
+		}
+
+		const std::string text = batch.str();
+		if (!text.empty())
+		{
+			std::cerr << text << std::flush;
+		}
+	}
+
+	bool shouldPrint(int32_t messageIdNumber, Clock::time_point now)
+	{
+		Repeats& entry = repeats[messageIdNumber];
+		if (entry.printed == 0)
+		{
+			entry.intervalStart = now;
+		}
+		if (entry.printed < MAX_REPEATS_PER_INTERVAL)
+		{
+			++entry.printed;
+			return true;
+		}
+
+		++entry.suppressed;
+		suppressedCount.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	// Ends the intervals that are over at now, the next message with their id starts a new one.
+	void reportIntervals(Clock::time_point now, std::ostringstream& batch)
+	{
+		for (auto it = repeats.begin(); it != repeats.end();)
+		{
+			if (now != Clock::time_point::max() && now - it->second.intervalStart < REPEAT_INTERVAL)
+			{
+				++it;
+				continue;
+			}
+
+			if (it->second.suppressed != 0)
+			{
+				batch << "validation layer: suppressed " << it->second.suppressed << " repeats of message id " << it->first << '\n';
+			}
+			it = repeats.erase(it);
+		}
+	}
+
+	static const char* getSeverityName(VkDebugUtilsMessageSeverityFlagBitsEXT severity)
+	{
+		switch (severity)
+		{
+		case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT: return "verbose";
+		case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT: return "info";
+		case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT: return "warning";
+		case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT: return "error";
+		default: return "unknown";
+		}
+	}
+};
@@ -2,22 +2,27 @@
 #extension GL_KHR_vulkan_glsl : enable
 #extension GL_ARB_separate_shader_objects : enable
 
-vec2[] positions = vec2[](
-	vec2( 0.0, -0.5),
-	vec2( 0.5,  0.5),
-	vec2(-0.5,  0.5)
-);
+// per vertex
+layout (location = 0) in vec2 position;
+layout (location = 1) in vec3 color;
 
-vec3[] colors = vec3[](
-	vec3(1, 0, 0),
-	vec3(0, 1, 0),
-	vec3(0, 0, 1)
-);
+// per instance
+layout (location = 2) in vec2 instancePosition;
+layout (location = 3) in float instanceScale;
+
+// per frame, bound with a dynamic offset into the uniform ring
+layout (std140, set = 1, binding = 0) uniform ViewConstants
+{
+	vec2 viewScale;
+	vec2 viewOffset;
+};
 
 layout (location = 0) out vec3 vertColor;
+layout (location = 1) out vec2 vertTexCoord;
 
 void main()
 {
-	gl_Position = vec4(positions[gl_VertexIndex], 0, 1);
-	vertColor = colors[gl_VertexIndex];
+	gl_Position = vec4((instancePosition + position * instanceScale) * viewScale + viewOffset, 0, 1);
+	vertColor = color;
+	vertTexCoord = position + 0.5;
 }
\ No newline at end of file
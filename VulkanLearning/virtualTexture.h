@@ -0,0 +1,904 @@
+#pragma once
+
+#include <volk.h>
+
+#include "memoryAllocator.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <optional>
+#include <vector>
+#include <cstdint>
+
+// A huge RGBA8 texture of which only the tiles the scene actually samples are resident.
+// The fragment shader writes the tiles it wants into a feedback buffer, which is read back once the frame's fence has signaled.
+// Missing tiles are bound to pages of a fixed memory budget with vkQueueBindSparse, the least recently used tiles are evicted.
+// When the heap the pages come from runs short of budget, fewer pages are kept and the rest are given back to the allocator,
+// so only the coarser tiles (which are streamed first) stay resident until there is room again.
+// The shader clamps its LOD to what the residency map says is resident, so it never samples a missing tile.
+// Without sparse residency a small, fully resident image of the same content is used instead.
+class VirtualTexture
+{
+public:
+	static constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+	static constexpr uint32_t TEXEL_SIZE = 4;
+	static constexpr uint32_t MAX_MIP_LEVELS = 16;
+	static constexpr uint32_t MAX_TILE_UPLOADS_PER_FRAME = 32;
+	static constexpr uint32_t FALLBACK_EXTENT = 512;
+	static constexpr int64_t BUDGET_RESERVE = 64ll * 1024 * 1024; // of the pages' heap budget left to the rest of the app
+
+	// fills extent texels of mipLevel, starting at offset, tightly packed
+	using TileSource = std::function<void(uint32_t mipLevel, VkOffset2D offset, VkExtent2D extent, void* texels)>;
+
+	// layout of the residency buffer, matches fragment.frag
+	struct ResidencyHeader
+	{
+		uint32_t mipTailStart; // first mip level of the mip tail, which is always resident
+		uint32_t residencyColumns; // the residency map has one entry per tile of mip level 0
+		uint32_t residencyRows;
+		uint32_t tileWidth;
+		uint32_t tileHeight;
+		uint32_t padding[3];
+		uint32_t mips[MAX_MIP_LEVELS][4]; // tiles per row, tile rows, index of the first tile in the feedback buffer, unused
+	};
+
+private:
+	static constexpr uint32_t NO_PAGE = UINT32_MAX;
+
+	struct Tile
+	{
+		uint32_t mipLevel;
+		uint32_t x, y; // in tiles
+		uint32_t page = NO_PAGE;
+		uint64_t lastUsedFrame = 0;
+	};
+
+	struct PendingCopy
+	{
+		VkDeviceSize stagingOffset;
+		VkBufferImageCopy region;
+	};
+
+	struct Frame
+	{
+		AllocatedBuffer feedback; // written by the fragment shader
+		AllocatedBuffer residency; // written by the CPU
+		VkSemaphore bindFinished = VK_NULL_HANDLE;
+		bool bindSubmitted = false;
+		VkDeviceSize stagingMarker = 0;
+		std::vector<uint32_t> evictedPages; // reusable once this frame slot comes around again
+		std::vector<MemoryAllocation> releasedPages; // unbound by this frame's sparse bind, freed once the slot comes around again
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;
+	VkQueue sparseQueue = VK_NULL_HANDLE;
+	TileSource tileSource;
+	bool sparse = false;
+
+	VkExtent2D extent{};
+	uint32_t mipLevels = 1;
+	AllocatedImage fallbackImage; // only without sparse residency
+	VkImage image = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	VkSampler sampler = VK_NULL_HANDLE;
+	bool layoutInitialized = false;
+
+	VkExtent2D tileExtent{ 1, 1 };
+	uint32_t mipTailStart = 0;
+	std::vector<MemoryAllocation> mipTailMemory;
+	VkDeviceSize pageSize = 0;
+	VkMemoryRequirements pageRequirements{};
+	uint32_t pageMemoryTypeIndex = 0;
+	uint32_t pageBudget = 0;
+	uint32_t pageLimit = 0; // the page budget, lowered while the heap is short of memory
+	std::vector<MemoryAllocation> pages;
+	std::vector<uint32_t> pageOwners; // tile index bound to each page, or NO_PAGE
+	std::vector<uint32_t> freePages;
+	std::vector<uint32_t> unallocatedPages; // entries of pages whose memory was given back to the allocator
+
+	std::vector<Tile> tiles; // every tile of every mip level before the mip tail
+	std::vector<uint32_t> mipFirstTiles; // index of the first tile of each mip level
+	std::vector<uint32_t> residencyMap; // finest resident mip level per tile of mip level 0
+
+	AllocatedBuffer stagingBuffer;
+	RingAllocator stagingRing;
+	std::vector<PendingCopy> pendingCopies;
+
+	std::vector<Frame> frames;
+	size_t currentFrame = 0;
+	uint64_t frameCounter = 0;
+
+public:
+	static bool isSupported(VkPhysicalDevice physicalDevice, const VkPhysicalDeviceFeatures& enabledFeatures)
+	{
+		if (!enabledFeatures.sparseBinding || !enabledFeatures.sparseResidencyImage2D)
+		{
+			return false;
+		}
+
+		uint32_t propertyCount = 0;
+		vkGetPhysicalDeviceSparseImageFormatProperties(physicalDevice, FORMAT, VK_IMAGE_TYPE_2D, VK_SAMPLE_COUNT_1_BIT,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_TILING_OPTIMAL, &propertyCount, nullptr);
+		return propertyCount > 0;
+	}
+
+	// sparseQueue is ignored when sparse is false
+	void create(VkDevice device, MemoryAllocator& allocator, bool sparse, VkQueue sparseQueue, uint32_t size, VkDeviceSize memoryBudget, TileSource tileSource, size_t frameCount)
+	{
+		this->device = device;
+		this->allocator = &allocator;
+		this->sparse = sparse;
+		this->sparseQueue = sparseQueue;
+		this->tileSource = std::move(tileSource);
+		frames.resize(frameCount);
+
+		extent = { size, size };
+		mipLevels = 1;
+		while ((size >> mipLevels) > 0 && mipLevels < MAX_MIP_LEVELS)
+		{
+			++mipLevels;
+		}
+
+		VkDeviceSize stagingSize;
+		if (sparse)
+		{
+			createSparseImage(memoryBudget);
+
+			// every frame in flight may upload its tiles, the first one the mip tail as well, plus what is lost at the end of the ring
+			const VkDeviceSize tileSize = VkDeviceSize(tileExtent.width) * tileExtent.height * TEXEL_SIZE;
+			stagingSize = (MAX_TILE_UPLOADS_PER_FRAME * frameCount + 1) * tileSize + getMipTailTexelSize();
+		}
+		else
+		{
+			createFallbackImage();
+			stagingSize = VkDeviceSize(FALLBACK_EXTENT) * FALLBACK_EXTENT * TEXEL_SIZE;
+		}
+
+		stagingBuffer = allocator.createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CpuToGpu);
+		stagingRing.reset(stagingSize);
+
+		createImageView();
+		createSampler();
+		createFrames();
+
+		if (sparse)
+		{
+			stageMipTail();
+		}
+		else
+		{
+			stageFallbackImage();
+		}
+	}
+
+	// The device must be idle.
+	void destroy()
+	{
+		for (auto& frame : frames)
+		{
+			allocator->destroyBuffer(frame.feedback);
+			allocator->destroyBuffer(frame.residency);
+			vkDestroySemaphore(device, frame.bindFinished, nullptr);
+			for (auto& page : frame.releasedPages)
+			{
+				allocator->free(page);
+			}
+		}
+		frames.clear();
+
+		allocator->destroyBuffer(stagingBuffer);
+		vkDestroySampler(device, sampler, nullptr);
+		vkDestroyImageView(device, view, nullptr);
+
+		if (sparse)
+		{
+			vkDestroyImage(device, image, nullptr);
+			for (auto& page : pages)
+			{
+				allocator->free(page);
+			}
+			for (auto& memory : mipTailMemory)
+			{
+				allocator->free(memory);
+			}
+			pages.clear();
+			mipTailMemory.clear();
+		}
+		else
+		{
+			allocator->destroyImage(fallbackImage);
+		}
+	}
+
+	bool isSparse() const
+	{
+		return sparse;
+	}
+
+	VkImageView getView() const
+	{
+		return view;
+	}
+
+	VkSampler getSampler() const
+	{
+		return sampler;
+	}
+
+	VkBuffer getResidencyBuffer(size_t frameIndex) const
+	{
+		return frames[frameIndex].residency.buffer;
+	}
+
+	VkBuffer getFeedbackBuffer(size_t frameIndex) const
+	{
+		return frames[frameIndex].feedback.buffer;
+	}
+
+	uint32_t getResidentTileCount() const
+	{
+		size_t evictedPageCount = 0;
+		for (const auto& frame : frames)
+		{
+			evictedPageCount += frame.evictedPages.size();
+		}
+		return static_cast<uint32_t>(getAllocatedPageCount() - freePages.size() - evictedPageCount);
+	}
+
+	uint32_t getPageBudget() const
+	{
+		return pageBudget;
+	}
+
+	uint32_t getPageLimit() const
+	{
+		return pageLimit;
+	}
+
+	// Call once the fence of frameIndex has signaled. Reads back the feedback that frame slot produced,
+	// binds missing tiles on the sparse queue and stages their texels.
+	void beginFrame(size_t frameIndex)
+	{
+		currentFrame = frameIndex;
+		++frameCounter;
+
+		Frame& frame = frames[frameIndex];
+		frame.bindSubmitted = false;
+		stagingRing.releaseUpTo(frame.stagingMarker);
+		freePages.insert(freePages.end(), frame.evictedPages.begin(), frame.evictedPages.end());
+		frame.evictedPages.clear();
+		for (auto& page : frame.releasedPages)
+		{
+			allocator->free(page);
+		}
+		frame.releasedPages.clear();
+
+		if (sparse)
+		{
+			updatePageLimit();
+			streamTiles(readFeedback(frame));
+		}
+
+		frame.stagingMarker = stagingRing.getMarker();
+		writeResidency(frame);
+	}
+
+	// the semaphore this frame's graphics submit has to wait on at the transfer stage, if any
+	VkSemaphore getWaitSemaphore() const
+	{
+		return frames[currentFrame].bindSubmitted ? frames[currentFrame].bindFinished : VK_NULL_HANDLE;
+	}
+
+	// Copies the texels of the tiles bound this frame. Must be recorded outside of a render pass.
+	// The image stays in the general layout so tiles can be written while the rest of it is sampled.
+	void recordUploads(VkCommandBuffer commandBuffer)
+	{
+		if (!layoutInitialized)
+		{
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = image;
+			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+			barrier.subresourceRange.layerCount = 1;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+				0, 0, nullptr, 0, nullptr, 1, &barrier);
+			layoutInitialized = true;
+		}
+
+		if (pendingCopies.empty())
+		{
+			return;
+		}
+
+		for (const auto& copy : pendingCopies)
+		{
+			VkBufferImageCopy region = copy.region;
+			region.bufferOffset = copy.stagingOffset;
+			vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, image, VK_IMAGE_LAYOUT_GENERAL, 1, &region);
+		}
+		pendingCopies.clear();
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+private:
+	void createSparseImage(VkDeviceSize memoryBudget)
+	{
+		VkImageCreateInfo createInfo = makeImageCreateInfo(extent, mipLevels);
+		createInfo.flags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+		if (vkCreateImage(device, &createInfo, nullptr, &image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create sparse image");
+		}
+
+		vkGetImageMemoryRequirements(device, image, &pageRequirements);
+		pageSize = pageRequirements.alignment; // sparse memory is bound in blocks of the alignment
+		pageRequirements.size = pageSize;
+		pageMemoryTypeIndex = allocator->findMemoryType(pageRequirements.memoryTypeBits, MemoryUsage::GpuOnly);
+
+		uint32_t requirementCount = 0;
+		vkGetImageSparseMemoryRequirements(device, image, &requirementCount, nullptr);
+		std::vector<VkSparseImageMemoryRequirements> requirements(requirementCount);
+		vkGetImageSparseMemoryRequirements(device, image, &requirementCount, requirements.data());
+
+		std::vector<VkSparseMemoryBind> mipTailBinds;
+		bool foundColor = false;
+		for (const auto& requirement : requirements)
+		{
+			const bool metadata = requirement.formatProperties.aspectMask & VK_IMAGE_ASPECT_METADATA_BIT;
+			if (requirement.formatProperties.aspectMask & VK_IMAGE_ASPECT_COLOR_BIT)
+			{
+				foundColor = true;
+				tileExtent = { requirement.formatProperties.imageGranularity.width, requirement.formatProperties.imageGranularity.height };
+				mipTailStart = std::min(requirement.imageMipTailFirstLod, mipLevels);
+			}
+
+			// the mip tail of a single layer image is bound as one opaque range, and so is any metadata
+			if (requirement.imageMipTailFirstLod < mipLevels || metadata)
+			{
+				VkMemoryRequirements tailRequirements = pageRequirements;
+				tailRequirements.size = alignUp(requirement.imageMipTailSize, pageSize);
+				MemoryAllocation memory = allocator->allocate(tailRequirements, MemoryUsage::GpuOnly, ResourceKind::Optimal);
+
+				VkSparseMemoryBind bind{};
+				bind.resourceOffset = requirement.imageMipTailOffset;
+				bind.size = requirement.imageMipTailSize;
+				bind.memory = memory.memory;
+				bind.memoryOffset = memory.offset;
+				bind.flags = metadata ? VK_SPARSE_MEMORY_BIND_METADATA_BIT : 0;
+				mipTailBinds.push_back(bind);
+				mipTailMemory.push_back(memory);
+			}
+		}
+		if (!foundColor)
+		{
+			throw std::runtime_error("sparse image has no color memory requirements");
+		}
+
+		VkDeviceSize mipTailSize = 0;
+		for (const auto& memory : mipTailMemory)
+		{
+			mipTailSize += memory.size;
+		}
+		if (memoryBudget < mipTailSize + pageSize)
+		{
+			throw std::runtime_error("the virtual texture memory budget doesn't even fit the mip tail");
+		}
+		pageBudget = static_cast<uint32_t>((memoryBudget - mipTailSize) / pageSize);
+		pageLimit = pageBudget;
+
+		createTiles();
+		bindMipTail(mipTailBinds);
+	}
+
+	void bindMipTail(const std::vector<VkSparseMemoryBind>& binds)
+	{
+		if (binds.empty())
+		{
+			return;
+		}
+
+		VkSparseImageOpaqueMemoryBindInfo opaqueBindInfo{};
+		opaqueBindInfo.image = image;
+		opaqueBindInfo.bindCount = binds.size();
+		opaqueBindInfo.pBinds = binds.data();
+
+		VkBindSparseInfo bindInfo{};
+		bindInfo.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+		bindInfo.imageOpaqueBindCount = 1;
+		bindInfo.pImageOpaqueBinds = &opaqueBindInfo;
+
+		// happens once, before the first frame, so waiting for it is fine
+		if (vkQueueBindSparse(sparseQueue, 1, &bindInfo, VK_NULL_HANDLE) != VK_SUCCESS || vkQueueWaitIdle(sparseQueue) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to bind the mip tail of the sparse image");
+		}
+	}
+
+	void stageMipTail()
+	{
+		for (uint32_t mipLevel = mipTailStart; mipLevel < mipLevels; ++mipLevel)
+		{
+			stageRegion(mipLevel, { 0, 0 }, getMipExtent(mipLevel));
+		}
+	}
+
+	VkDeviceSize getMipTailTexelSize() const
+	{
+		VkDeviceSize size = 0;
+		for (uint32_t mipLevel = mipTailStart; mipLevel < mipLevels; ++mipLevel)
+		{
+			const VkExtent2D mipExtent = getMipExtent(mipLevel);
+			size += VkDeviceSize(mipExtent.width) * mipExtent.height * TEXEL_SIZE;
+		}
+		return size;
+	}
+
+	void createTiles()
+	{
+		for (uint32_t mipLevel = 0; mipLevel < mipTailStart; ++mipLevel)
+		{
+			mipFirstTiles.push_back(static_cast<uint32_t>(tiles.size()));
+			const VkExtent2D tileCount = getTileCount(mipLevel);
+			for (uint32_t y = 0; y < tileCount.height; ++y)
+			{
+				for (uint32_t x = 0; x < tileCount.width; ++x)
+				{
+					Tile tile;
+					tile.mipLevel = mipLevel;
+					tile.x = x;
+					tile.y = y;
+					tiles.push_back(tile);
+				}
+			}
+		}
+
+		const VkExtent2D residencyExtent = getTileCount(0);
+		residencyMap.assign(residencyExtent.width * residencyExtent.height, mipTailStart);
+	}
+
+	void createFallbackImage()
+	{
+		mipLevels = 1;
+		fallbackImage = allocator->createImage(makeImageCreateInfo({ FALLBACK_EXTENT, FALLBACK_EXTENT }, 1), MemoryUsage::GpuOnly);
+		image = fallbackImage.image;
+		tileExtent = { FALLBACK_EXTENT, FALLBACK_EXTENT };
+		mipTailStart = 0;
+		residencyMap.assign(1, 0);
+	}
+
+	void stageFallbackImage()
+	{
+		// same content as the mip level of the virtual texture that has the fallback's size
+		uint32_t sourceMipLevel = 0;
+		while ((extent.width >> sourceMipLevel) > FALLBACK_EXTENT)
+		{
+			++sourceMipLevel;
+		}
+
+		std::optional<VkDeviceSize> offset = stagingRing.allocate(VkDeviceSize(FALLBACK_EXTENT) * FALLBACK_EXTENT * TEXEL_SIZE, TEXEL_SIZE);
+		tileSource(sourceMipLevel, { 0, 0 }, { FALLBACK_EXTENT, FALLBACK_EXTENT }, static_cast<char*>(stagingBuffer.allocation.mapped) + *offset);
+		allocator->flush(stagingBuffer.allocation);
+
+		PendingCopy copy{};
+		copy.stagingOffset = *offset;
+		copy.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copy.region.imageSubresource.layerCount = 1;
+		copy.region.imageExtent = { FALLBACK_EXTENT, FALLBACK_EXTENT, 1 };
+		pendingCopies.push_back(copy);
+	}
+
+	VkImageCreateInfo makeImageCreateInfo(VkExtent2D imageExtent, uint32_t imageMipLevels) const
+	{
+		VkImageCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		createInfo.imageType = VK_IMAGE_TYPE_2D;
+		createInfo.format = FORMAT;
+		createInfo.extent = { imageExtent.width, imageExtent.height, 1 };
+		createInfo.mipLevels = imageMipLevels;
+		createInfo.arrayLayers = 1;
+		createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		createInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		return createInfo;
+	}
+
+	void createImageView()
+	{
+		VkImageViewCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		createInfo.image = image;
+		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		createInfo.format = FORMAT;
+		createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		createInfo.subresourceRange.levelCount = mipLevels;
+		createInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(device, &createInfo, nullptr, &view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create virtual texture view");
+		}
+	}
+
+	void createSampler()
+	{
+		// nearest mip filtering, so sampling a resident level never touches the finer one next to it
+		VkSamplerCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		createInfo.magFilter = VK_FILTER_LINEAR;
+		createInfo.minFilter = VK_FILTER_LINEAR;
+		createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		createInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		createInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		createInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		createInfo.minLod = 0;
+		createInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		if (vkCreateSampler(device, &createInfo, nullptr, &sampler) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create virtual texture sampler");
+		}
+	}
+
+	void createFrames()
+	{
+		const VkDeviceSize feedbackSize = std::max<size_t>(tiles.size(), 1) * sizeof(uint32_t);
+		const VkDeviceSize residencySize = sizeof(ResidencyHeader) + residencyMap.size() * sizeof(uint32_t);
+
+		VkSemaphoreCreateInfo semaphoreCreateInfo{};
+		semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		for (auto& frame : frames)
+		{
+			frame.feedback = allocator->createBuffer(feedbackSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuToCpu);
+			frame.residency = allocator->createBuffer(residencySize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::CpuToGpu);
+			std::memset(frame.feedback.allocation.mapped, 0, feedbackSize);
+			allocator->flush(frame.feedback.allocation);
+
+			if (vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frame.bindFinished) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create sparse bind semaphore");
+			}
+		}
+	}
+
+	VkExtent2D getMipExtent(uint32_t mipLevel) const
+	{
+		return { std::max(extent.width >> mipLevel, 1u), std::max(extent.height >> mipLevel, 1u) };
+	}
+
+	VkExtent2D getTileCount(uint32_t mipLevel) const
+	{
+		const VkExtent2D mipExtent = getMipExtent(mipLevel);
+		return { (mipExtent.width + tileExtent.width - 1) / tileExtent.width, (mipExtent.height + tileExtent.height - 1) / tileExtent.height };
+	}
+
+	uint32_t getTileIndex(uint32_t mipLevel, uint32_t x, uint32_t y) const
+	{
+		return mipFirstTiles[mipLevel] + y * getTileCount(mipLevel).width + x;
+	}
+
+	// returns the missing tiles the last frame of this slot asked for, coarsest first
+	std::vector<uint32_t> readFeedback(Frame& frame)
+	{
+		allocator->invalidate(frame.feedback.allocation);
+		uint32_t* feedback = static_cast<uint32_t*>(frame.feedback.allocation.mapped);
+
+		std::vector<uint32_t> missing;
+		for (uint32_t i = 0; i < tiles.size(); ++i)
+		{
+			if (feedback[i] == 0)
+			{
+				continue;
+			}
+
+			// a tile is only useful if everything coarser than it is resident too, so request the whole chain
+			for (uint32_t mipLevel = tiles[i].mipLevel; mipLevel < mipTailStart; ++mipLevel)
+			{
+				const uint32_t shift = mipLevel - tiles[i].mipLevel;
+				const uint32_t index = getTileIndex(mipLevel, tiles[i].x >> shift, tiles[i].y >> shift);
+				if (tiles[index].lastUsedFrame == frameCounter)
+				{
+					break; // already requested, and so is the rest of the chain
+				}
+
+				tiles[index].lastUsedFrame = frameCounter;
+				if (tiles[index].page == NO_PAGE)
+				{
+					missing.push_back(index);
+				}
+			}
+		}
+
+		std::memset(feedback, 0, tiles.size() * sizeof(uint32_t));
+		allocator->flush(frame.feedback.allocation);
+
+		std::sort(missing.begin(), missing.end(), [this](uint32_t a, uint32_t b) { return tiles[a].mipLevel > tiles[b].mipLevel; });
+		return missing;
+	}
+
+	std::optional<uint32_t> acquirePage()
+	{
+		if (!freePages.empty())
+		{
+			const uint32_t page = freePages.back();
+			freePages.pop_back();
+			return page;
+		}
+
+		if (getAllocatedPageCount() < pageLimit)
+		{
+			MemoryAllocation memory = allocator->allocate(pageRequirements, MemoryUsage::GpuOnly, ResourceKind::Optimal);
+			if (!unallocatedPages.empty())
+			{
+				const uint32_t page = unallocatedPages.back();
+				unallocatedPages.pop_back();
+				pages[page] = memory;
+				return page;
+			}
+
+			pages.push_back(memory);
+			pageOwners.push_back(NO_PAGE);
+			return static_cast<uint32_t>(pages.size() - 1);
+		}
+
+		return std::nullopt;
+	}
+
+	// pages with memory, whether free, evicted or bound to a resident tile
+	uint32_t getAllocatedPageCount() const
+	{
+		return static_cast<uint32_t>(pages.size() - unallocatedPages.size());
+	}
+
+	// Shrinks the page limit when less than BUDGET_RESERVE of the heap's budget is left, and lets it grow back towards
+	// the page budget once more than twice that is. Some pages are always allowed, so the coarse tiles keep streaming.
+	void updatePageLimit()
+	{
+		const int64_t available = allocator->getAvailableBytes(pageMemoryTypeIndex);
+		const uint32_t allocated = getAllocatedPageCount();
+		const uint32_t minPageLimit = std::min(pageBudget, MAX_TILE_UPLOADS_PER_FRAME);
+
+		if (available < BUDGET_RESERVE)
+		{
+			const int64_t excess = (BUDGET_RESERVE - available + static_cast<int64_t>(pageSize) - 1) / static_cast<int64_t>(pageSize);
+			pageLimit = std::max(static_cast<uint32_t>(std::max<int64_t>(allocated - excess, 0)), minPageLimit);
+		}
+		else if (available > 2 * BUDGET_RESERVE)
+		{
+			const int64_t room = (available - 2 * BUDGET_RESERVE) / static_cast<int64_t>(pageSize);
+			pageLimit = std::max(pageLimit, static_cast<uint32_t>(std::min<int64_t>(allocated + room, pageBudget)));
+		}
+	}
+
+	// Gives the memory of pages above the limit back to the allocator, free pages first. When there aren't enough,
+	// least recently used tiles are evicted, their pages follow once no frame in flight samples them anymore.
+	void releasePages(std::vector<VkSparseImageMemoryBind>& binds)
+	{
+		uint32_t allocated = getAllocatedPageCount();
+		while (allocated > pageLimit && !freePages.empty())
+		{
+			const uint32_t page = freePages.back();
+			freePages.pop_back();
+			unbindPreviousOwner(page, binds);
+			pageOwners[page] = NO_PAGE;
+			frames[currentFrame].releasedPages.push_back(pages[page]);
+			pages[page] = {};
+			unallocatedPages.push_back(page);
+			--allocated;
+		}
+
+		uint32_t evictedPageCount = 0;
+		for (const auto& frame : frames)
+		{
+			evictedPageCount += static_cast<uint32_t>(frame.evictedPages.size());
+		}
+		for (uint32_t evictions = 0; allocated > pageLimit + evictedPageCount && evictions < MAX_TILE_UPLOADS_PER_FRAME; ++evictions)
+		{
+			if (!evictLeastRecentlyUsedTile())
+			{
+				break;
+			}
+			++evictedPageCount;
+		}
+	}
+
+	// the page still holds the binding of the tile it was evicted from, unless that tile has been bound elsewhere since
+	void unbindPreviousOwner(uint32_t page, std::vector<VkSparseImageMemoryBind>& binds) const
+	{
+		const uint32_t previousOwner = pageOwners[page];
+		if (previousOwner != NO_PAGE && tiles[previousOwner].page == NO_PAGE)
+		{
+			binds.push_back(makeTileBind(tiles[previousOwner], VK_NULL_HANDLE, 0));
+		}
+	}
+
+	// Makes the least recently used tile that wasn't asked for this frame non-resident. Its page can only be reused
+	// once the frames in flight that may still sample it have finished.
+	bool evictLeastRecentlyUsedTile()
+	{
+		uint32_t victim = NO_PAGE;
+		for (uint32_t page = 0; page < pages.size(); ++page)
+		{
+			const uint32_t owner = pageOwners[page];
+			if (owner == NO_PAGE || tiles[owner].page != page || tiles[owner].lastUsedFrame == frameCounter) // free, already evicted or still needed
+			{
+				continue;
+			}
+			if (victim == NO_PAGE || tiles[owner].lastUsedFrame < tiles[pageOwners[victim]].lastUsedFrame)
+			{
+				victim = page;
+			}
+		}
+
+		if (victim != NO_PAGE)
+		{
+			tiles[pageOwners[victim]].page = NO_PAGE;
+			frames[currentFrame].evictedPages.push_back(victim);
+			// the page stays bound to the evicted tile until it is bound to another one, nothing samples it in the meantime
+		}
+		return victim != NO_PAGE;
+	}
+
+	void streamTiles(const std::vector<uint32_t>& missing)
+	{
+		std::vector<VkSparseImageMemoryBind> binds;
+		uint32_t evictions = 0;
+		releasePages(binds);
+
+		for (uint32_t tileIndex : missing)
+		{
+			if (binds.size() >= MAX_TILE_UPLOADS_PER_FRAME)
+			{
+				break;
+			}
+
+			std::optional<uint32_t> page = acquirePage();
+			if (!page)
+			{
+				// over budget this frame, make room for the next time this frame slot comes around
+				if (evictions++ < MAX_TILE_UPLOADS_PER_FRAME)
+				{
+					evictLeastRecentlyUsedTile();
+				}
+				continue;
+			}
+
+			Tile& tile = tiles[tileIndex];
+			unbindPreviousOwner(*page, binds);
+			pageOwners[*page] = tileIndex;
+			tile.page = *page;
+			binds.push_back(makeTileBind(tile, pages[*page].memory, pages[*page].offset));
+			stageTile(tile);
+		}
+
+		if (binds.empty())
+		{
+			return;
+		}
+
+		VkSparseImageMemoryBindInfo imageBindInfo{};
+		imageBindInfo.image = image;
+		imageBindInfo.bindCount = binds.size();
+		imageBindInfo.pBinds = binds.data();
+
+		Frame& frame = frames[currentFrame];
+		VkBindSparseInfo bindInfo{};
+		bindInfo.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+		bindInfo.imageBindCount = 1;
+		bindInfo.pImageBinds = &imageBindInfo;
+		bindInfo.signalSemaphoreCount = 1;
+		bindInfo.pSignalSemaphores = &frame.bindFinished;
+
+		if (vkQueueBindSparse(sparseQueue, 1, &bindInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to bind sparse image tiles");
+		}
+		frame.bindSubmitted = true;
+	}
+
+	VkSparseImageMemoryBind makeTileBind(const Tile& tile, VkDeviceMemory memory, VkDeviceSize memoryOffset) const
+	{
+		const VkExtent2D mipExtent = getMipExtent(tile.mipLevel);
+		const uint32_t x = tile.x * tileExtent.width;
+		const uint32_t y = tile.y * tileExtent.height;
+
+		VkSparseImageMemoryBind bind{};
+		bind.subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		bind.subresource.mipLevel = tile.mipLevel;
+		bind.offset = { static_cast<int32_t>(x), static_cast<int32_t>(y), 0 };
+		bind.extent = { std::min(tileExtent.width, mipExtent.width - x), std::min(tileExtent.height, mipExtent.height - y), 1 };
+		bind.memory = memory;
+		bind.memoryOffset = memoryOffset;
+		return bind;
+	}
+
+	void stageTile(const Tile& tile)
+	{
+		const VkSparseImageMemoryBind bind = makeTileBind(tile, VK_NULL_HANDLE, 0);
+		stageRegion(tile.mipLevel, { bind.offset.x, bind.offset.y }, { bind.extent.width, bind.extent.height });
+	}
+
+	void stageRegion(uint32_t mipLevel, VkOffset2D offset, VkExtent2D regionExtent)
+	{
+		const VkDeviceSize size = VkDeviceSize(regionExtent.width) * regionExtent.height * TEXEL_SIZE;
+		std::optional<VkDeviceSize> stagingOffset = stagingRing.allocate(size, TEXEL_SIZE);
+		if (!stagingOffset)
+		{
+			throw std::runtime_error("virtual texture staging buffer is full");
+		}
+
+		tileSource(mipLevel, offset, regionExtent, static_cast<char*>(stagingBuffer.allocation.mapped) + *stagingOffset);
+		allocator->flush(stagingBuffer.allocation, *stagingOffset, size);
+
+		PendingCopy copy{};
+		copy.stagingOffset = *stagingOffset;
+		copy.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copy.region.imageSubresource.mipLevel = mipLevel;
+		copy.region.imageSubresource.layerCount = 1;
+		copy.region.imageOffset = { offset.x, offset.y, 0 };
+		copy.region.imageExtent = { regionExtent.width, regionExtent.height, 1 };
+		pendingCopies.push_back(copy);
+	}
+
+	void writeResidency(Frame& frame)
+	{
+		if (sparse)
+		{
+			// the finest resident level covering each tile of mip level 0. Tiles are the same size on every level,
+			// so the tile covering (x, y) on level m is (x >> m, y >> m).
+			const VkExtent2D residencyExtent = getTileCount(0);
+			for (uint32_t y = 0; y < residencyExtent.height; ++y)
+			{
+				for (uint32_t x = 0; x < residencyExtent.width; ++x)
+				{
+					uint32_t resident = mipTailStart;
+					for (uint32_t mipLevel = mipTailStart; mipLevel-- > 0;)
+					{
+						if (tiles[getTileIndex(mipLevel, x >> mipLevel, y >> mipLevel)].page == NO_PAGE)
+						{
+							break;
+						}
+						resident = mipLevel;
+					}
+					residencyMap[y * residencyExtent.width + x] = resident;
+				}
+			}
+		}
+
+		ResidencyHeader header{};
+		header.mipTailStart = mipTailStart;
+		header.residencyColumns = sparse ? getTileCount(0).width : 1;
+		header.residencyRows = sparse ? getTileCount(0).height : 1;
+		header.tileWidth = tileExtent.width;
+		header.tileHeight = tileExtent.height;
+		for (uint32_t mipLevel = 0; mipLevel < mipTailStart; ++mipLevel)
+		{
+			const VkExtent2D tileCount = getTileCount(mipLevel);
+			header.mips[mipLevel][0] = tileCount.width;
+			header.mips[mipLevel][1] = tileCount.height;
+			header.mips[mipLevel][2] = mipFirstTiles[mipLevel];
+		}
+
+		char* mapped = static_cast<char*>(frame.residency.allocation.mapped);
+		std::memcpy(mapped, &header, sizeof(header));
+		std::memcpy(mapped + sizeof(header), residencyMap.data(), residencyMap.size() * sizeof(uint32_t));
+		allocator->flush(frame.residency.allocation);
+	}
+};